@@ -0,0 +1,470 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <zlib.h>
+
+#include "../headers/png.h"
+#include "../headers/png_to_bmp.h"
+#include "../headers/png_unfilter.h"
+#include "png_gen.h"
+
+#define BENCH_MAX_LIST 16
+#define BENCH_MAX_CASES 4096
+#define BENCH_STAGES 7
+
+static const char* usage =
+    "Usage: %s [--sizes 64x64,1024x768] [--types 0,2,3,4,6] [--depths 1,2,4,8,16] [--filters none,sub,up,avg,paeth,mixed]\n"
+    "          [--interlace 0,1] [--idat 8192] [--level 6] [--iterations 5] [--threads 1] [--cpu scalar|sse2|ssse3|avx2]\n"
+    "          [--inflate zlib|builtin] [--format 24|32|index|auto] [--thumbnail 4|8]"
+    "          [--label texte] [--csv resultats.csv] [--compare ancien.csv] [--threshold 10] [--bmp fichier.bmp] [--corpus dossier]";
+
+static const char* stage_names[BENCH_STAGES] = { "parse", "crc", "inflate", "unfilter", "place", "write", "total" };
+
+typedef struct BenchConfig {
+    uint32_t widths[BENCH_MAX_LIST], heights[BENCH_MAX_LIST];
+    int size_count;
+    int types[BENCH_MAX_LIST], type_count;
+    int depths[BENCH_MAX_LIST], depth_count;
+    int filters[BENCH_MAX_LIST], filter_count;
+    int interlaces[BENCH_MAX_LIST], interlace_count;
+    long idat_sizes[BENCH_MAX_LIST];
+    int idat_count;
+    int level, iterations, threads;
+    uint32_t thumbnail;
+    const char* label;
+    const char* csv;
+    const char* compare;
+    double threshold;
+    const char* bmp;
+    const char* corpus;
+    PngInflateEngine inflate_engine;
+    PngPixelFormat format;
+} BenchConfig;
+
+/* Meilleur temps de chaque étape sur les itérations, et quantité de données traitée par l'étape
+   (PNG lu et vérifié, données décompressées, pixels convertis, fichier BMP écrit). */
+typedef struct BenchResult {
+    char name[96];
+    PngGenSpec spec;
+    size_t png_bytes, raw_bytes, pixel_bytes, bmp_bytes;
+    double best[BENCH_STAGES];
+} BenchResult;
+
+static double monotonic_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int parse_int_list(const char* text, int* values, int* count) {
+    char* end;
+    *count = 0;
+    do {
+        if (*count == BENCH_MAX_LIST) return -1;
+        values[(*count)++] = (int)strtol(text, &end, 10);
+        if (end == text) return -1;
+        text = end + (*end == ',');
+    } while (*end == ',');
+    return *end == '\0' ? 0 : -1;
+}
+
+static int parse_sizes(const char* text, BenchConfig* config) {
+    config->size_count = 0;
+    while (*text) {
+        unsigned int w, h;
+        int consumed;
+        if (config->size_count == BENCH_MAX_LIST || sscanf(text, "%ux%u%n", &w, &h, &consumed) != 2 || w == 0 || h == 0) return -1;
+        config->widths[config->size_count] = w;
+        config->heights[config->size_count++] = h;
+        text += consumed;
+        if (*text == ',') text++;
+        else if (*text) return -1;
+    }
+    return config->size_count ? 0 : -1;
+}
+
+static int parse_filters(const char* text, BenchConfig* config) {
+    char buffer[256];
+    strncpy(buffer, text, sizeof(buffer) - 1);
+    buffer[sizeof(buffer) - 1] = '\0';
+    config->filter_count = 0;
+    for (char* name = strtok(buffer, ","); name; name = strtok(NULL, ",")) {
+        if (config->filter_count == BENCH_MAX_LIST || png_gen_parse_filter(name, &config->filters[config->filter_count++]) != 0) return -1;
+    }
+    return config->filter_count ? 0 : -1;
+}
+
+static size_t raw_size(const PngGenSpec* spec) {
+    static const int sx[] = {0, 4, 0, 2, 0, 1, 0}, sy[] = {0, 0, 4, 0, 2, 0, 1}, dx[] = {8, 8, 4, 4, 2, 2, 1}, dy[] = {8, 8, 8, 4, 4, 2, 2};
+    const size_t channels = spec->color_type == 2 ? 3 : spec->color_type == 4 ? 2 : spec->color_type == 6 ? 4 : 1;
+    size_t total = 0;
+    for (int p = 0; p < (spec->interlace ? 7 : 1); p++) {
+        uint32_t w = spec->interlace ? (spec->width > (uint32_t)sx[p] ? (spec->width - sx[p] + dx[p] - 1) / dx[p] : 0) : spec->width;
+        uint32_t h = spec->interlace ? (spec->height > (uint32_t)sy[p] ? (spec->height - sy[p] + dy[p] - 1) / dy[p] : 0) : spec->height;
+        if (w && h) total += (size_t)h * (1 + ((size_t)w * channels * spec->bit_depth + 7) / 8);
+    }
+    return total;
+}
+
+/* Le moteur intégré et les décodages sur plusieurs threads doivent rendre exactement les pixels obtenus avec zlib
+   sur un seul thread, ou échouer comme lui (img NULL). */
+static int check_against_zlib(const unsigned char* png_data, size_t png_size, const PngDecodeOptions* options, const PngImage* img) {
+    PngDecodeOptions reference_options = *options;
+    reference_options.inflate_engine = PNG_INFLATE_ZLIB;
+    reference_options.threads = 1;
+    reference_options.stats = NULL;
+    PngDecoder* reference = png_decoder_create();
+    PngImage expected;
+    int decoded = reference && png_decode_into(reference, png_data, png_size, &reference_options, &expected) == 0;
+    int status = !img ? (reference && !decoded ? 0 : -1) :
+                 (decoded && expected.final_pixel_size == img->final_pixel_size &&
+                  memcmp(expected.final_pixel_data, img->final_pixel_data, img->final_pixel_size) == 0) ? 0 : -1;
+    png_decoder_destroy(reference);
+    return status;
+}
+
+/* Flux zlib amputé de ses derniers octets (somme Adler-32, puis données) : le moteur intégré ne doit ni inventer
+   les octets manquants ni refuser ce que zlib accepte. */
+static int check_truncated_against_zlib(const PngGenSpec* spec, PngDecoder* decoder, const PngDecodeOptions* options) {
+    static const size_t cuts[] = { 2, 4, 5, 6, 8, 12 };
+    PngDecodeOptions builtin_options = *options;
+    builtin_options.stats = NULL;
+    int status = 0;
+    for (size_t c = 0; status == 0 && c < sizeof(cuts) / sizeof(cuts[0]); c++) {
+        PngGenSpec truncated = *spec;
+        truncated.truncate = cuts[c];
+        size_t png_size;
+        unsigned char* png_data = png_gen_build(&truncated, &png_size);
+        if (!png_data) return -1;
+        PngImage img;
+        int decoded = png_decode_into(decoder, png_data, png_size, &builtin_options, &img) == 0;
+        status = check_against_zlib(png_data, png_size, &builtin_options, decoded ? &img : NULL);
+        if (status != 0) fprintf(stderr, "%u octets retirés du flux : le moteur intégré %s, pas zlib\n", (unsigned)cuts[c], decoded ? "accepte" : "refuse");
+        free(png_data);
+    }
+    return status;
+}
+
+/* En-têtes IHDR hors norme sur une image de 16 x 4, avec des données de la taille annoncée : tous les décodeurs
+   doivent les refuser avant de toucher aux pixels. trns : 1 avant les données, 2 au milieu ; second_ihdr : IHDR
+   2048 x 2048 (données nulles à sa taille) 1 avant les données, 2 au milieu. */
+typedef struct BenchBadHeader {
+    const char* name;
+    uint8_t bit_depth, color_type, interlace;
+    int trns, second_ihdr;
+} BenchBadHeader;
+
+static const BenchBadHeader bad_headers[] = {
+    { "gris 12 bits avec tRNS", 12, 0, 0, 1, 0 },
+    { "gris 9 bits", 9, 0, 0, 0, 0 },
+    { "profondeur nulle", 0, 0, 0, 0, 0 },
+    { "palette 16 bits", 16, 3, 0, 0, 0 },
+    { "RGB 4 bits", 4, 2, 0, 0, 0 },
+    { "type de couleur 5", 8, 5, 0, 0, 0 },
+    { "entrelacement 2", 8, 0, 2, 0, 0 },
+    { "IHDR répété", 8, 2, 0, 0, 1 },
+    { "IHDR après IDAT", 8, 2, 0, 0, 2 },
+    { "IHDR après IDAT, entrelacé", 8, 2, 1, 0, 2 },
+    { "tRNS après IDAT", 8, 0, 0, 2, 0 },
+};
+
+static void put_be32(unsigned char* p, uint32_t v) { p[0] = (unsigned char)(v >> 24); p[1] = (unsigned char)(v >> 16); p[2] = (unsigned char)(v >> 8); p[3] = (unsigned char)v; }
+
+static unsigned char* put_chunk(unsigned char* p, const char* type, const unsigned char* data, uint32_t length) {
+    put_be32(p, length);
+    memcpy(p + 4, type, 4);
+    if (length) memcpy(p + 8, data, length);
+    put_be32(p + 8 + length, (uint32_t)crc32(0L, p + 4, 4 + length));
+    return p + 12 + length;
+}
+
+static unsigned char* build_bad_header(const BenchBadHeader* bad, size_t* size) {
+    static const unsigned char signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+    static const unsigned char trns[2] = {0, 0};
+    const uint32_t width = 16, height = 4, large = 2048;
+    const size_t channels = bad->color_type == 2 ? 3 : bad->color_type == 4 ? 2 : bad->color_type == 6 ? 4 : 1;
+    const size_t stride = 1 + (width * channels * bad->bit_depth + 7) / 8;
+    const size_t raw_size = bad->second_ihdr ? (size_t)large * (1 + large * channels * bad->bit_depth / 8) : height * stride;
+    unsigned char* raw = calloc(raw_size, 1);
+    uLongf compressed_size = compressBound(raw_size);
+    unsigned char* png = malloc(8 + 25 * 2 + 14 + 12 * 2 + compressed_size + 12);
+    unsigned char* compressed = malloc(compressed_size);
+    unsigned char ihdr[13], second[13];
+    if (raw && !bad->second_ihdr) for (size_t i = 0; i < raw_size; i++) raw[i] = i % stride ? (unsigned char)(i * 37) : 0;
+    int status = raw && png && compressed && compress(compressed, &compressed_size, raw, raw_size) == Z_OK ? 0 : -1;
+    free(raw);
+    if (status != 0) { free(png); free(compressed); return NULL; }
+    put_be32(ihdr, width); put_be32(ihdr + 4, height);
+    ihdr[8] = bad->bit_depth; ihdr[9] = bad->color_type; ihdr[10] = 0; ihdr[11] = 0; ihdr[12] = bad->interlace;
+    memcpy(second, ihdr, 13);
+    put_be32(second, large); put_be32(second + 4, large);
+    /* Les chunks « au milieu » suivent un premier IDAT de 16 octets, qui lance la décompression. */
+    const uint32_t head = bad->trns == 2 || bad->second_ihdr == 2 ? 16 : (uint32_t)compressed_size;
+    memcpy(png, signature, 8);
+    unsigned char* p = put_chunk(png + 8, "IHDR", ihdr, 13);
+    if (bad->trns == 1) p = put_chunk(p, "tRNS", trns, 2);
+    if (bad->second_ihdr == 1) p = put_chunk(p, "IHDR", second, 13);
+    p = put_chunk(p, "IDAT", compressed, head);
+    if (bad->trns == 2) p = put_chunk(p, "tRNS", trns, 2);
+    if (bad->second_ihdr == 2) p = put_chunk(p, "IHDR", second, 13);
+    if (head < compressed_size) p = put_chunk(p, "IDAT", compressed + head, (uint32_t)(compressed_size - head));
+    p = put_chunk(p, "IEND", NULL, 0);
+    free(compressed);
+    *size = (size_t)(p - png);
+    return png;
+}
+
+static int ignore_row(void* user, uint32_t y, const unsigned char* row) { (void)user; (void)y; (void)row; return 0; }
+
+/* Retourne le nombre d'en-têtes acceptés par png_decode_into, png_stream_from_file ou png_probe. */
+static int check_bad_headers(const BenchConfig* config, PngDecoder* decoder) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s.png", config->bmp);
+    PngDecodeOptions options;
+    png_options_init(&options);
+    /* Comme la ligne de commande : le tRNS fait choisir la sortie 32 bits. */
+    options.format = PNG_FORMAT_BMP_AUTO;
+    options.threads = config->threads;
+    options.inflate_engine = config->inflate_engine;
+    PngRowSink sink = { NULL, ignore_row, NULL };
+    int accepted = 0;
+    for (size_t i = 0; i < sizeof(bad_headers) / sizeof(bad_headers[0]); i++) {
+        size_t size;
+        unsigned char* data = build_bad_header(&bad_headers[i], &size);
+        FILE* f = data ? fopen(path, "wb") : NULL;
+        if (!f || fwrite(data, 1, size, f) != size) { if (f) fclose(f); free(data); return -1; }
+        fclose(f);
+        PngImage img;
+        PngInfo info;
+        /* png_probe s'arrête au premier IDAT : les chunks qui suivent ne le concernent pas. */
+        const bool probed = bad_headers[i].trns != 2 && bad_headers[i].second_ihdr != 2;
+        const char* decoder_name = png_decode_into(decoder, data, size, &options, &img) == 0 ? "png_decode_into" :
+                                   png_stream_from_file(path, &options, &sink) == 0 ? "png_stream_from_file" :
+                                   probed && png_probe(path, &info) == 0 ? "png_probe" : NULL;
+        if (decoder_name) {
+            fprintf(stderr, "En-tête invalide (%s) accepté par %s\n", bad_headers[i].name, decoder_name);
+            accepted++;
+        }
+        free(data);
+    }
+    remove(path);
+    return accepted;
+}
+
+static int run_case(const BenchConfig* config, PngDecoder* decoder, BenchResult* result) {
+    size_t png_size;
+    unsigned char* png_data = png_gen_build(&result->spec, &png_size);
+    if (!png_data) return -1;
+    if (config->corpus) {
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%s.png", config->corpus, result->name);
+        FILE* f = fopen(path, "wb");
+        if (f) { fwrite(png_data, 1, png_size, f); fclose(f); }
+    }
+    PngDecodeOptions options;
+    png_options_init(&options);
+    options.format = config->format;
+    options.threads = config->threads;
+    options.inflate_engine = config->inflate_engine;
+    options.thumbnail_scale = config->thumbnail;
+    result->png_bytes = png_size;
+    result->raw_bytes = raw_size(&result->spec);
+    result->pixel_bytes = (size_t)result->spec.width * result->spec.height * 3;
+    for (int s = 0; s < BENCH_STAGES; s++) result->best[s] = 1e30;
+    int status = 0;
+    for (int it = 0; status == 0 && it < config->iterations; it++) {
+        PngStats stats;
+        PngImage img;
+        memset(&stats, 0, sizeof(stats));
+        options.stats = &stats;
+        double start = monotonic_seconds();
+        status = png_decode_into(decoder, png_data, png_size, &options, &img);
+        if (status == 0) status = png_save_to_bmp_ex(NULL, config->bmp, &img, img.final_pixel_data, &stats);
+        double written = monotonic_seconds();
+        if (status == 0 && it == 0 && (png_inflate_resolve(options.inflate_engine) == PNG_INFLATE_BUILTIN || options.threads > 1)) {
+            status = check_against_zlib(png_data, png_size, &options, &img);
+            if (status == 0) status = check_truncated_against_zlib(&result->spec, decoder, &options);
+        }
+        if (status != 0) break;
+        result->bmp_bytes = (size_t)stats.bytes_out;
+        double times[BENCH_STAGES] = { stats.parse_seconds, stats.crc_seconds, stats.inflate_seconds, stats.unfilter_seconds, stats.place_seconds, stats.write_seconds, written - start };
+        for (int s = 0; s < BENCH_STAGES; s++) if (times[s] < result->best[s]) result->best[s] = times[s];
+    }
+    free(png_data);
+    return status;
+}
+
+static size_t stage_bytes(const BenchResult* r, int stage) {
+    switch (stage) {
+        case 0: case 1: return r->png_bytes;
+        case 2: case 3: return r->raw_bytes;
+        case 4: return r->pixel_bytes;
+        case 5: return r->bmp_bytes;
+        default: return r->png_bytes;
+    }
+}
+
+static double ns_per_pixel(const BenchResult* r, int stage) {
+    return r->best[stage] * 1e9 / ((double)r->spec.width * r->spec.height);
+}
+
+static double mb_per_second(const BenchResult* r, int stage) {
+    return r->best[stage] > 0 ? stage_bytes(r, stage) / r->best[stage] / 1e6 : 0.0;
+}
+
+static void write_csv_header(FILE* out) {
+    fprintf(out, "label,case,width,height,color_type,bit_depth,interlace,filter,idat_size,png_bytes,raw_bytes,iterations");
+    for (int s = 0; s < BENCH_STAGES; s++) fprintf(out, ",%s_ns_px,%s_mb_s", stage_names[s], stage_names[s]);
+    fprintf(out, "\n");
+}
+
+static void write_csv_row(FILE* out, const BenchConfig* config, const BenchResult* r) {
+    fprintf(out, "%s,%s,%u,%u,%d,%d,%d,%s,%zu,%zu,%zu,%d", config->label, r->name, r->spec.width, r->spec.height, r->spec.color_type, r->spec.bit_depth,
+            r->spec.interlace, png_gen_filter_name(r->spec.filter), r->spec.idat_size, r->png_bytes, r->raw_bytes, config->iterations);
+    for (int s = 0; s < BENCH_STAGES; s++) fprintf(out, ",%.3f,%.1f", ns_per_pixel(r, s), mb_per_second(r, s));
+    fprintf(out, "\n");
+}
+
+/* Compare le temps total par pixel avec un CSV d'un commit précédent ; retourne le nombre de régressions. */
+static int compare_results(const BenchConfig* config, const BenchResult* results, int count) {
+    FILE* old = fopen(config->compare, "r");
+    if (!old) {
+        fprintf(stderr, "Impossible d'ouvrir %s\n", config->compare);
+        return -1;
+    }
+    char line[2048];
+    int regressions = 0, matched = 0, total_column = -1;
+    if (fgets(line, sizeof(line), old)) {
+        int column = 0;
+        for (char* field = strtok(line, ",\r\n"); field; field = strtok(NULL, ",\r\n"), column++) {
+            if (strcmp(field, "total_ns_px") == 0) total_column = column;
+        }
+    }
+    while (total_column >= 0 && fgets(line, sizeof(line), old)) {
+        char* fields[64];
+        int n = 0;
+        for (char* field = strtok(line, ",\r\n"); field && n < 64; field = strtok(NULL, ",\r\n")) fields[n++] = field;
+        if (n <= total_column) continue;
+        for (int i = 0; i < count; i++) {
+            if (strcmp(results[i].name, fields[1]) != 0) continue;
+            double before = atof(fields[total_column]), now = ns_per_pixel(&results[i], BENCH_STAGES - 1);
+            double change = before > 0 ? (now - before) / before * 100.0 : 0.0;
+            int regressed = change > config->threshold;
+            regressions += regressed;
+            matched++;
+            fprintf(stderr, "%-40s %10.3f -> %10.3f ns/px  %+6.1f %%%s\n", results[i].name, before, now, change, regressed ? "  REGRESSION" : "");
+        }
+    }
+    fclose(old);
+    fprintf(stderr, "%d cas comparés, %d régressions au-delà de %.0f %%\n", matched, regressions, config->threshold);
+    return regressions;
+}
+
+int main(int argc, char* argv[]) {
+    BenchConfig config;
+    memset(&config, 0, sizeof(config));
+    parse_sizes("64x64,1024x768", &config);
+    parse_int_list("0,2,3,4,6", config.types, &config.type_count);
+    parse_int_list("1,2,4,8,16", config.depths, &config.depth_count);
+    parse_filters("none,sub,up,avg,paeth", &config);
+    parse_int_list("0,1", config.interlaces, &config.interlace_count);
+    config.idat_sizes[0] = 8192;
+    config.idat_count = 1;
+    config.level = 6;
+    config.iterations = 5;
+    config.threads = 1;
+    config.label = "courant";
+    config.threshold = 10.0;
+    config.bmp = "bench_output.bmp";
+    config.format = PNG_FORMAT_BMP;
+    PngCpuLevel cpu = PNG_CPU_BEST;
+    for (int i = 1; i < argc; i++) {
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        int error = value == NULL;
+        if (!error && strcmp(argv[i], "--sizes") == 0) error = parse_sizes(value, &config);
+        else if (!error && strcmp(argv[i], "--types") == 0) error = parse_int_list(value, config.types, &config.type_count);
+        else if (!error && strcmp(argv[i], "--depths") == 0) error = parse_int_list(value, config.depths, &config.depth_count);
+        else if (!error && strcmp(argv[i], "--filters") == 0) error = parse_filters(value, &config);
+        else if (!error && strcmp(argv[i], "--interlace") == 0) error = parse_int_list(value, config.interlaces, &config.interlace_count);
+        else if (!error && strcmp(argv[i], "--idat") == 0) {
+            int sizes[BENCH_MAX_LIST];
+            error = parse_int_list(value, sizes, &config.idat_count);
+            for (int k = 0; k < config.idat_count; k++) { config.idat_sizes[k] = sizes[k]; if (sizes[k] <= 0) error = -1; }
+        }
+        else if (!error && strcmp(argv[i], "--level") == 0) config.level = atoi(value);
+        else if (!error && strcmp(argv[i], "--iterations") == 0) error = (config.iterations = atoi(value)) <= 0;
+        else if (!error && strcmp(argv[i], "--threads") == 0) error = (config.threads = atoi(value)) <= 0;
+        else if (!error && strcmp(argv[i], "--cpu") == 0) {
+            static const char* names[] = { "scalar", "sse2", "ssse3", "avx2" };
+            error = -1;
+            for (int k = 0; k < 4; k++) if (strcmp(value, names[k]) == 0) { cpu = (PngCpuLevel)k; error = 0; }
+        }
+        else if (!error && strcmp(argv[i], "--inflate") == 0) error = png_inflate_parse_engine(value, &config.inflate_engine);
+        else if (!error && strcmp(argv[i], "--format") == 0) error = png_parse_format(value, &config.format);
+        else if (!error && strcmp(argv[i], "--thumbnail") == 0) error = (config.thumbnail = (uint32_t)atoi(value)) != 4 && config.thumbnail != 8;
+        else if (!error && strcmp(argv[i], "--label") == 0) config.label = value;
+        else if (!error && strcmp(argv[i], "--csv") == 0) config.csv = value;
+        else if (!error && strcmp(argv[i], "--compare") == 0) config.compare = value;
+        else if (!error && strcmp(argv[i], "--threshold") == 0) config.threshold = atof(value);
+        else if (!error && strcmp(argv[i], "--bmp") == 0) config.bmp = value;
+        else if (!error && strcmp(argv[i], "--corpus") == 0) config.corpus = value;
+        else error = -1;
+        if (error) {
+            fprintf(stderr, usage, argv[0]);
+            fprintf(stderr, "\n");
+            return EXIT_FAILURE;
+        }
+        i++;
+    }
+    fprintf(stderr, "Noyaux de défiltrage : %s, décompression : %s\n", png_unfilter_level_name(png_unfilter_init(cpu)), png_inflate_engine_name(config.inflate_engine));
+
+    BenchResult* results = calloc(BENCH_MAX_CASES, sizeof(BenchResult));
+    PngDecoder* decoder = png_decoder_create();
+    FILE* csv = config.csv ? fopen(config.csv, "w") : stdout;
+    if (!results || !decoder || !csv) {
+        fprintf(stderr, "Initialisation impossible.\n");
+        return EXIT_FAILURE;
+    }
+    write_csv_header(csv);
+    int count = 0, failures = check_bad_headers(&config, decoder) != 0;
+    for (int si = 0; si < config.size_count; si++)
+    for (int ti = 0; ti < config.type_count; ti++)
+    for (int di = 0; di < config.depth_count; di++)
+    for (int ii = 0; ii < config.interlace_count; ii++)
+    for (int fi = 0; fi < config.filter_count; fi++)
+    for (int ci = 0; ci < config.idat_count; ci++) {
+        if (!png_gen_valid((uint8_t)config.types[ti], (uint8_t)config.depths[di]) || count == BENCH_MAX_CASES) continue;
+        BenchResult* r = &results[count];
+        PngGenSpec* spec = &r->spec;
+        spec->width = config.widths[si];
+        spec->height = config.heights[si];
+        spec->color_type = (uint8_t)config.types[ti];
+        spec->bit_depth = (uint8_t)config.depths[di];
+        spec->interlace = (uint8_t)(config.interlaces[ii] != 0);
+        spec->filter = config.filters[fi];
+        spec->idat_size = (size_t)config.idat_sizes[ci];
+        spec->level = config.level;
+        spec->seed = 1;
+        snprintf(r->name, sizeof(r->name), "c%d_b%d_i%d_%s_%ux%u_idat%zu", spec->color_type, spec->bit_depth, spec->interlace,
+                 png_gen_filter_name(spec->filter), spec->width, spec->height, spec->idat_size);
+        if (run_case(&config, decoder, r) != 0) {
+            fprintf(stderr, "%-40s ECHEC\n", r->name);
+            failures++;
+            continue;
+        }
+        write_csv_row(csv, &config, r);
+        fprintf(stderr, "%-40s total %8.2f ns/px %8.1f MB/s | parse %6.1f crc %6.1f inflate %7.1f unfilter %7.1f place %7.1f write %7.1f MB/s\n",
+                r->name, ns_per_pixel(r, 6), mb_per_second(r, 6), mb_per_second(r, 0), mb_per_second(r, 1), mb_per_second(r, 2), mb_per_second(r, 3),
+                mb_per_second(r, 4), mb_per_second(r, 5));
+        count++;
+    }
+    if (csv != stdout) fclose(csv);
+    remove(config.bmp);
+    int regressions = config.compare ? compare_results(&config, results, count) : 0;
+    png_decoder_destroy(decoder);
+    free(results);
+    return (failures == 0 && regressions == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,197 @@
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "png_gen.h"
+
+static const int adam7_start_x[] = {0, 4, 0, 2, 0, 1, 0}; static const int adam7_start_y[] = {0, 0, 4, 0, 2, 0, 1};
+static const int adam7_step_x[]  = {8, 8, 4, 4, 2, 2, 1}; static const int adam7_step_y[]  = {8, 8, 8, 4, 4, 2, 2};
+
+static const char* filter_names[] = { "none", "sub", "up", "avg", "paeth" };
+
+typedef struct GenBuffer {
+    unsigned char* data;
+    size_t size, capacity;
+} GenBuffer;
+
+static int buffer_reserve(GenBuffer* b, size_t extra) {
+    if (b->size + extra <= b->capacity) return 0;
+    size_t capacity = b->capacity ? b->capacity : 4096;
+    while (capacity < b->size + extra) capacity *= 2;
+    unsigned char* grown = realloc(b->data, capacity);
+    if (!grown) return -1;
+    b->data = grown;
+    b->capacity = capacity;
+    return 0;
+}
+
+static void put_be32(unsigned char* p, uint32_t v) { p[0] = (unsigned char)(v >> 24); p[1] = (unsigned char)(v >> 16); p[2] = (unsigned char)(v >> 8); p[3] = (unsigned char)v; }
+
+static int put_chunk(GenBuffer* b, const char* type, const unsigned char* data, size_t length) {
+    if (buffer_reserve(b, length + 12) != 0) return -1;
+    unsigned char* p = b->data + b->size;
+    put_be32(p, (uint32_t)length);
+    memcpy(p + 4, type, 4);
+    if (length) memcpy(p + 8, data, length);
+    put_be32(p + 8 + length, (uint32_t)crc32(0L, p + 4, (uInt)(length + 4)));
+    b->size += length + 12;
+    return 0;
+}
+
+static uint32_t hash3(uint32_t x, uint32_t y, uint32_t z) {
+    uint32_t h = x * 73856093u ^ y * 19349663u ^ z * 83492791u;
+    h ^= h >> 13; h *= 0x5bd1e995u; h ^= h >> 15;
+    return h;
+}
+
+static int channel_count(uint8_t color_type) {
+    switch (color_type) { case 2: return 3; case 4: return 2; case 6: return 4; default: return 1; }
+}
+
+/* Échantillon 16 bits du canal c du pixel (x, y), réduit ensuite à la profondeur voulue. */
+static uint16_t sample(const PngGenSpec* spec, uint32_t x, uint32_t y, int c) {
+    uint32_t h = hash3(x, y, (uint32_t)c + spec->seed * 7u);
+    int alpha_channel = (spec->color_type == 4 || spec->color_type == 6) && c == channel_count(spec->color_type) - 1;
+    if (alpha_channel) {
+        uint32_t region = (x / 16 + y / 16) % 3;
+        if (region == 0) return 0;
+        if (region == 1) return 0xFFFF;
+        return (uint16_t)h;
+    }
+    uint32_t gradient = (uint32_t)(((uint64_t)x * 255 / spec->width + (uint64_t)y * 255 / spec->height + (uint64_t)c * 85) / 2) & 0xFF;
+    int v = (int)gradient + (int)(h & 15) - 8;
+    v = v < 0 ? 0 : (v > 255 ? 255 : v);
+    return (uint16_t)((v << 8) | ((h >> 8) & 0xFF));
+}
+
+static void build_row(const PngGenSpec* spec, uint32_t y, uint32_t start_x, uint32_t step_x, uint32_t count, unsigned char* row) {
+    const int channels = channel_count(spec->color_type);
+    const int bd = spec->bit_depth;
+    if (bd < 8) memset(row, 0, ((size_t)count * bd + 7) / 8);
+    size_t bit = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t x = start_x + i * step_x;
+        for (int c = 0; c < channels; c++) {
+            uint16_t v = sample(spec, x, y, c);
+            if (bd == 16) { *row++ = (unsigned char)(v >> 8); *row++ = (unsigned char)v; }
+            else if (bd == 8) *row++ = (unsigned char)(v >> 8);
+            else {
+                unsigned int packed = (unsigned int)(v >> (16 - bd));
+                row[bit / 8] |= (unsigned char)(packed << (8 - bd - bit % 8));
+                bit += (size_t)bd;
+            }
+        }
+    }
+}
+
+static int paeth(int a, int b, int c) {
+    int p = a + b - c, pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    return (pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c);
+}
+
+static void filter_row(int type, const unsigned char* row, const unsigned char* prev, size_t stride, size_t bpp, unsigned char* out) {
+    out[0] = (unsigned char)type;
+    for (size_t i = 0; i < stride; i++) {
+        int a = i >= bpp ? row[i - bpp] : 0, b = prev ? prev[i] : 0, c = (prev && i >= bpp) ? prev[i - bpp] : 0;
+        int pred = 0;
+        switch (type) { case 1: pred = a; break; case 2: pred = b; break; case 3: pred = (a + b) / 2; break; case 4: pred = paeth(a, b, c); break; }
+        out[i + 1] = (unsigned char)(row[i] - pred);
+    }
+}
+
+static int deflate_into(z_stream* zs, GenBuffer* out, const unsigned char* data, size_t size, int flush) {
+    zs->next_in = (Bytef*)data;
+    zs->avail_in = (uInt)size;
+    int ret;
+    do {
+        if (buffer_reserve(out, 65536) != 0) return -1;
+        zs->next_out = out->data + out->size;
+        zs->avail_out = 65536;
+        ret = deflate(zs, flush);
+        if (ret == Z_STREAM_ERROR) return -1;
+        out->size += 65536 - zs->avail_out;
+    } while (flush == Z_FINISH ? ret != Z_STREAM_END : zs->avail_out == 0);
+    return 0;
+}
+
+int png_gen_valid(uint8_t color_type, uint8_t bit_depth) {
+    switch (color_type) {
+        case 0: return bit_depth == 1 || bit_depth == 2 || bit_depth == 4 || bit_depth == 8 || bit_depth == 16;
+        case 3: return bit_depth == 1 || bit_depth == 2 || bit_depth == 4 || bit_depth == 8;
+        case 2: case 4: case 6: return bit_depth == 8 || bit_depth == 16;
+        default: return 0;
+    }
+}
+
+const char* png_gen_filter_name(int filter) {
+    return filter >= 0 && filter <= 4 ? filter_names[filter] : "mixed";
+}
+
+int png_gen_parse_filter(const char* name, int* filter) {
+    for (int i = 0; i < 5; i++) if (strcmp(name, filter_names[i]) == 0) { *filter = i; return 0; }
+    if (strcmp(name, "mixed") == 0) { *filter = PNG_GEN_FILTER_MIXED; return 0; }
+    return -1;
+}
+
+/* Les lignes sont filtrées et compressées au fil de l'eau : seules les données compressées sont gardées
+   en mémoire, ce qui permet de produire des images de 16k x 16k. */
+unsigned char* png_gen_build(const PngGenSpec* spec, size_t* size) {
+    if (!png_gen_valid(spec->color_type, spec->bit_depth) || spec->width == 0 || spec->height == 0) return NULL;
+    const size_t bits_per_pixel = (size_t)channel_count(spec->color_type) * spec->bit_depth;
+    const size_t bpp = bits_per_pixel < 8 ? 1 : bits_per_pixel / 8;
+    const size_t max_stride = ((size_t)spec->width * bits_per_pixel + 7) / 8;
+    GenBuffer png = { NULL, 0, 0 }, idat = { NULL, 0, 0 };
+    unsigned char* rows = malloc(max_stride * 2 + 1);
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    int status = rows && deflateInit(&zs, spec->level) == Z_OK ? 0 : -1;
+    unsigned char* row = rows, *prev = rows + max_stride, *filtered = NULL;
+    if (status == 0 && (filtered = malloc(max_stride + 1)) == NULL) status = -1;
+    for (int pass = 0; status == 0 && pass < (spec->interlace ? 7 : 1); pass++) {
+        uint32_t sx = spec->interlace ? adam7_start_x[pass] : 0, sy = spec->interlace ? adam7_start_y[pass] : 0;
+        uint32_t dx = spec->interlace ? adam7_step_x[pass] : 1, dy = spec->interlace ? adam7_step_y[pass] : 1;
+        uint32_t pass_w = spec->width > sx ? (spec->width - sx + dx - 1) / dx : 0;
+        uint32_t pass_h = spec->height > sy ? (spec->height - sy + dy - 1) / dy : 0;
+        if (pass_w == 0 || pass_h == 0) continue;
+        size_t stride = ((size_t)pass_w * bits_per_pixel + 7) / 8;
+        for (uint32_t py = 0; status == 0 && py < pass_h; py++) {
+            build_row(spec, sy + py * dy, sx, dx, pass_w, row);
+            int type = spec->filter == PNG_GEN_FILTER_MIXED ? (int)(py % 5) : spec->filter;
+            filter_row(type, row, py ? prev : NULL, stride, bpp, filtered);
+            status = deflate_into(&zs, &idat, filtered, stride + 1, Z_NO_FLUSH);
+            unsigned char* t = prev; prev = row; row = t;
+        }
+    }
+    if (status == 0) status = deflate_into(&zs, &idat, NULL, 0, Z_FINISH);
+    deflateEnd(&zs);
+    idat.size -= spec->truncate < idat.size ? spec->truncate : idat.size - 1;
+    free(rows);
+    free(filtered);
+
+    static const unsigned char signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+    unsigned char ihdr[13];
+    put_be32(ihdr, spec->width); put_be32(ihdr + 4, spec->height);
+    ihdr[8] = spec->bit_depth; ihdr[9] = spec->color_type; ihdr[10] = 0; ihdr[11] = 0; ihdr[12] = spec->interlace;
+    if (status == 0 && buffer_reserve(&png, 8) == 0) { memcpy(png.data, signature, 8); png.size = 8; } else status = -1;
+    if (status == 0) status = put_chunk(&png, "IHDR", ihdr, sizeof(ihdr));
+    if (status == 0 && spec->color_type == 3) {
+        unsigned char plte[256 * 3], trns[256];
+        size_t entries = (size_t)1 << spec->bit_depth;
+        for (size_t i = 0; i < entries; i++) {
+            uint32_t h = hash3((uint32_t)i, spec->seed, 99);
+            plte[i * 3] = (unsigned char)h; plte[i * 3 + 1] = (unsigned char)(h >> 8); plte[i * 3 + 2] = (unsigned char)(h >> 16);
+            trns[i] = (i % 4 == 0) ? 0 : (i % 4 == 1 ? 128 : 255);
+        }
+        status = put_chunk(&png, "PLTE", plte, entries * 3);
+        if (status == 0) status = put_chunk(&png, "tRNS", trns, entries);
+    }
+    size_t chunk = spec->idat_size ? spec->idat_size : idat.size;
+    for (size_t offset = 0; status == 0 && offset < idat.size; offset += chunk) {
+        status = put_chunk(&png, "IDAT", idat.data + offset, idat.size - offset < chunk ? idat.size - offset : chunk);
+    }
+    if (status == 0) status = put_chunk(&png, "IEND", NULL, 0);
+    free(idat.data);
+    if (status != 0) { free(png.data); return NULL; }
+    *size = png.size;
+    return png.data;
+}
@@ -0,0 +1,29 @@
+#ifndef PNG_GEN_H
+#define PNG_GEN_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Description d'une image PNG synthétique : dégradé bruité (ni trivialement compressible ni du bruit pur),
+   alpha mêlant pixels transparents, opaques et partiels, palette avec tRNS pour le type 3. */
+typedef struct PngGenSpec {
+    uint32_t width;
+    uint32_t height;
+    uint8_t color_type;
+    uint8_t bit_depth;
+    uint8_t interlace;
+    int filter;
+    size_t idat_size;
+    int level;
+    uint32_t seed;
+    size_t truncate; /* octets retirés de la fin du flux zlib (Adler-32 comprise) */
+} PngGenSpec;
+
+#define PNG_GEN_FILTER_MIXED (-1)
+
+int png_gen_valid(uint8_t color_type, uint8_t bit_depth);
+const char* png_gen_filter_name(int filter);
+int png_gen_parse_filter(const char* name, int* filter);
+unsigned char* png_gen_build(const PngGenSpec* spec, size_t* size);
+
+#endif
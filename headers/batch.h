@@ -0,0 +1,42 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include "png.h"
+#include "logger.h"
+#include "cache.h"
+
+typedef struct BatchJob {
+    char* input;
+    char* output;
+    size_t input_size;
+    int status;
+    double seconds;
+} BatchJob;
+
+typedef struct BatchList {
+    BatchJob* jobs;
+    size_t count;
+    size_t capacity;
+} BatchList;
+
+/* stats (facultatif) : reçoit la somme des compteurs de tous les fichiers du lot. cache (facultatif, ignoré en
+   flux) : les doublons du lot et des lots précédents sont rendus sans décodage. */
+typedef struct BatchConfig {
+    int threads;
+    int stream;
+    PngDecodeOptions options;
+    PngStats* stats;
+    PngCache* cache;
+} BatchConfig;
+
+int batch_add(BatchList* list, const char* input, const char* output);
+int batch_read_manifest(BatchList* list, FILE* manifest);
+int batch_scan_directory(BatchList* list, const char* input_dir, const char* output_dir);
+int batch_default_threads(void);
+int batch_run(Logger* logger, BatchList* list, const BatchConfig* config);
+void batch_print_summary(FILE* out, const BatchList* list);
+void batch_free(BatchList* list);
+
+#endif
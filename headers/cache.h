@@ -0,0 +1,36 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "png.h"
+#include "logger.h"
+
+/* Cache disque des conversions, adressé par le contenu : une entrée <clé>.bmp par couple (octets du PNG, options
+   qui changent le BMP). Les entrées sont publiées par renommage atomique (processus et threads concurrents sans
+   verrou), rendues par lien physique (copie si impossible) et évincées par ancienneté de dernier usage au-delà
+   de max_bytes. Partageable entre threads. */
+typedef struct PngCache PngCache;
+
+/* MurmurHash3 x64 128 bits du PNG, combiné aux options de sortie. */
+typedef struct PngCacheKey {
+    uint64_t h1, h2;
+} PngCacheKey;
+
+typedef struct PngCacheCounters {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t stores;
+    uint64_t evictions;
+} PngCacheCounters;
+
+PngCache* png_cache_open(Logger* logger, const char* dir, uint64_t max_bytes);
+void png_cache_close(PngCache* cache);
+void png_cache_key(const unsigned char* data, size_t size, const PngDecodeOptions* options, PngCacheKey* key);
+/* 0 : output a été créé depuis le cache (succès compté) ; -1 : absent (échec compté). */
+int png_cache_fetch(PngCache* cache, const PngCacheKey* key, const char* output);
+/* Publie le BMP déjà écrit dans output sous la clé. */
+int png_cache_store(PngCache* cache, const PngCacheKey* key, const char* output);
+void png_cache_counters(PngCache* cache, PngCacheCounters* counters);
+
+#endif
@@ -1,16 +1,45 @@
-#ifndef LOGGER_H
-#define LOGGER_H
-
-#include <stdio.h>
-
-typedef struct Logger {
-    FILE* file;
-    char filename[256];
-} Logger;
-
-int log_init(Logger* logger, const char* filename);
-void log_close(Logger* logger);
-void log_message(Logger* logger, const char* format, ...);
-void log_error(Logger* logger, const char* format, ...);
-
-#endif 
\ No newline at end of file
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <stdio.h>
+
+typedef enum LogLevel {
+    LOG_LEVEL_DEBUG = 0,
+    LOG_LEVEL_INFO,
+    LOG_LEVEL_ERROR,
+    LOG_LEVEL_NONE
+} LogLevel;
+
+/* Niveau minimal compilé : log_debug disparaît complètement des builds -DNDEBUG
+   (ou avec -DLOG_COMPILED_LEVEL=1). */
+#ifndef LOG_COMPILED_LEVEL
+#ifdef NDEBUG
+#define LOG_COMPILED_LEVEL LOG_LEVEL_INFO
+#else
+#define LOG_COMPILED_LEVEL LOG_LEVEL_DEBUG
+#endif
+#endif
+
+struct LogRing;
+
+/* Chaque Logger a sa propre destination et son propre thread d'écriture : les messages sont formatés par
+   l'appelant dans un anneau sans verrou puis écrits en arrière-plan. */
+typedef struct Logger {
+    FILE* file;
+    char filename[256];
+    LogLevel level;
+    struct LogRing* ring;
+} Logger;
+
+/* filename "-" : sortie d'erreur. Le fichier est ouvert en ajout, des lignes entières par écriture. */
+int log_init(Logger* logger, const char* filename);
+void log_close(Logger* logger);
+void log_set_level(Logger* logger, LogLevel level);
+int log_parse_level(const char* name, LogLevel* level);
+void log_write(Logger* logger, LogLevel level, const char* format, ...);
+void log_message(Logger* logger, const char* format, ...);
+void log_error(Logger* logger, const char* format, ...);
+
+#define log_debug(logger, ...) do { if (LOG_COMPILED_LEVEL <= LOG_LEVEL_DEBUG) log_write((logger), LOG_LEVEL_DEBUG, __VA_ARGS__); } while (0)
+
+#endif
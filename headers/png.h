@@ -1,37 +1,192 @@
-#ifndef PNG_H
-#define PNG_H
-
-#include <stdint.h>
-#include <stddef.h>
-#include <stdbool.h>
-#include "logger.h"
-
-typedef struct {
-    uint8_t r, g, b, a;
-} RGBA;
-
-typedef struct {
-    uint16_t r, g, b;
-} RGB16;
-
-typedef struct PngImage {
-    uint32_t width;
-    uint32_t height;
-    uint8_t bit_depth;
-    uint8_t color_type;
-    uint8_t bytes_per_pixel; 
-    uint8_t interlace_method;
-    unsigned char* final_pixel_data; 
-    size_t final_pixel_size;
-    RGBA* palette;
-    unsigned int palette_size;
-    float file_gamma;
-    bool has_transparency_key;
-    RGB16 transparency_key;
-} PngImage;
-
-PngImage* png_load_from_data(const unsigned char* data, size_t size);
-PngImage* png_load_from_file(const char *fname);
-void png_destroy(PngImage* png);
-
+#ifndef PNG_H
+#define PNG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "logger.h"
+#include "png_inflate.h"
+
+typedef struct {
+    uint8_t r, g, b, a;
+} RGBA;
+
+typedef struct {
+    uint16_t r, g, b;
+} RGB16;
+
+/* PNG_FORMAT_RGB : lignes RGB contiguës de haut en bas. Les formats BMP donnent un tableau de pixels BMP (de bas
+   en haut, lignes complétées à un multiple de 4 octets), prêt à être écrit tel quel :
+   PNG_FORMAT_BMP : 24 bits BGR, composé sur le fond.
+   PNG_FORMAT_BMP32 : 32 bits BGRA sans composition, alpha conservé (en-tête BITMAPV5).
+   PNG_FORMAT_BMP_INDEXED : index 1, 4 ou 8 bits de la palette PNG ou des niveaux de gris (types 3 et 0 jusqu'à
+   8 bits), avec la table des couleurs composées sur le fond ; 24 bits pour les autres images.
+   PNG_FORMAT_BMP_AUTO : 32 bits si l'image a de l'alpha (type 4 ou 6, tRNS), index si elle le permet, 24 bits sinon.
+   Les vignettes sont toujours en 24 bits ; pixel_format de l'image décodée donne le format retenu. */
+typedef enum PngPixelFormat {
+    PNG_FORMAT_RGB = 0,
+    PNG_FORMAT_BMP,
+    PNG_FORMAT_BMP32,
+    PNG_FORMAT_BMP_INDEXED,
+    PNG_FORMAT_BMP_AUTO
+} PngPixelFormat;
+
+typedef struct PngImage {
+    uint32_t width;
+    uint32_t height;
+    uint8_t bit_depth;
+    uint8_t color_type;
+    uint8_t bytes_per_pixel; 
+    uint8_t interlace_method;
+    /* Bits par pixel de sortie : 24, 32, ou 1/4/8 en index (1/4 seulement pour une image non entrelacée décodée
+       en entier, 8 sinon). index_colors : couleurs des index (1 << bits_per_pixel entrées). */
+    uint8_t bits_per_pixel;
+    RGBA* index_colors;
+    unsigned int index_color_count;
+    unsigned char* final_pixel_data; 
+    size_t final_pixel_size;
+    size_t row_size;
+    PngPixelFormat pixel_format;
+    bool owns_pixels;
+    RGBA* palette;
+    unsigned int palette_size;
+    float file_gamma;
+    bool has_transparency_key;
+    RGB16 transparency_key;
+} PngImage;
+
+#define PNG_FILTER_TYPES 5
+
+/* Compteurs remplis par png_load_from_file/_data (options->stats), png_decode_into, png_stream_from_file et
+   png_save_to_bmp_ex. Les durées (secondes, horloge monotone) et les compteurs s'additionnent d'un appel à
+   l'autre, peak_buffer_bytes garde le maximum : mettre à zéro avant usage, png_stats_add pour agréger.
+   parse : parcours des chunks hors CRC et décompression ; place : conversion des couleurs et placement.
+   Passes Adam7 : dimensions de la dernière image entrelacée décodée (pass_count à 0 sinon). Le décodage en
+   flux ne mesure que la durée totale ; ses compteurs sont complets. Pour une découpe ou une vignette d'image
+   non entrelacée, le défiltrage est compté dans place. cache_hits / cache_misses : conversions servies ou non par
+   le cache disque (--cache), remplis par l'appelant. */
+typedef struct PngStats {
+    double read_seconds;
+    double parse_seconds;
+    double crc_seconds;
+    double inflate_seconds;
+    double unfilter_seconds;
+    double place_seconds;
+    double write_seconds;
+    double total_seconds;
+    uint64_t images;
+    uint64_t bytes_in;
+    uint64_t bytes_inflated;
+    uint64_t bytes_out;
+    uint64_t chunks;
+    uint64_t idat_chunks;
+    uint64_t peak_buffer_bytes;
+    uint64_t filter_rows[PNG_FILTER_TYPES];
+    uint64_t cache_hits;
+    uint64_t cache_misses;
+    uint32_t pass_count;
+    uint32_t pass_width[7];
+    uint32_t pass_height[7];
+} PngStats;
+
+typedef struct PngRect {
+    uint32_t x, y, width, height;
+} PngRect;
+
+typedef enum PngResizeFilter {
+    PNG_RESIZE_BOX = 0,
+    PNG_RESIZE_BILINEAR
+} PngResizeFilter;
+
+/* scale > 0 : facteur appliqué aux deux dimensions. Sinon width et/ou height (l'autre à 0 garde les proportions) ;
+   tout à 0 : pas de redimensionnement. BOX : moyenne des pixels source couverts ; BILINEAR : filtre triangle
+   élargi au facteur de réduction (interpolation bilinéaire à l'agrandissement). */
+typedef struct PngResize {
+    uint32_t width, height;
+    double scale;
+    PngResizeFilter filter;
+} PngResize;
+
+/* Fournit le tampon de sortie une fois l'en-tête lu ; NULL pour abandonner le décodage. */
+typedef unsigned char* (*PngPixelAllocator)(void* user, const PngImage* png, size_t size);
+
+typedef struct PngDecodeOptions {
+    RGBA background;
+    int threads;
+    PngPixelFormat format;
+    PngPixelAllocator allocate;
+    void* allocate_user;
+    PngStats* stats;
+    /* 0 : image complète. 4 ou 8 : vignette 1/4 ou 1/8 (passes Adam7 1 à 3 ou passe 1 seule pour une image
+       entrelacée, moyenne par blocs sinon) ; width et height de l'image décodée sont ceux de la vignette. */
+    uint32_t thumbnail_scale;
+    /* width à 0 : image complète. Sinon seul ce rectangle (rogné aux bords de l'image) est décodé : la
+       décompression s'arrête après sa dernière ligne et seules ses colonnes sont converties. Incompatible avec
+       thumbnail_scale et le décodage en flux. */
+    PngRect crop;
+    /* Image rééchantillonnée en 24 bits au fil du défiltrage, sans image pleine taille en mémoire ; width et height
+       de l'image décodée sont ceux de la sortie. Incompatible avec thumbnail_scale, crop et le décodage en flux. */
+    PngResize resize;
+    /* Décompression des décodages complets ; vignettes, découpes et flux passent toujours par zlib. */
+    PngInflateEngine inflate_engine;
+} PngDecodeOptions;
+
+/* Métadonnées lues par png_probe (chunks précédant le premier IDAT). */
+typedef struct PngInfo {
+    uint32_t width;
+    uint32_t height;
+    uint8_t bit_depth;
+    uint8_t color_type;
+    uint8_t interlace_method;
+    float file_gamma;
+    unsigned int palette_size;
+    RGBA palette[256];
+    bool has_transparency_key;
+    RGB16 transparency_key;
+} PngInfo;
+
+typedef struct PngRowSink {
+    int (*begin)(void* user, const PngImage* png);
+    int (*row)(void* user, uint32_t y, const unsigned char* rgb_row);
+    void* user;
+} PngRowSink;
+
+typedef struct PngFileMap {
+    const unsigned char* data;
+    size_t size;
+    bool mapped;
+} PngFileMap;
+
+/* Contexte de décodage réutilisable : ses tampons de travail sont conservés et agrandis d'un décodage à
+   l'autre. Non partageable entre threads (un décodeur par thread). */
+typedef struct PngDecoder PngDecoder;
+
+void png_options_init(PngDecodeOptions* options);
+/* auto, 24, 32 ou index. */
+int png_parse_format(const char* name, PngPixelFormat* format);
+/* box ou bilinear. */
+int png_parse_resize_filter(const char* name, PngResizeFilter* filter);
+int png_probe(const char* fname, PngInfo* info);
+size_t png_row_size(uint32_t width, uint32_t bits_per_pixel, PngPixelFormat format);
+PngImage* png_load_from_data(const unsigned char* data, size_t size);
+PngImage* png_load_from_data_ex(const unsigned char* data, size_t size, const PngDecodeOptions* options);
+PngImage* png_load_from_file(const char *fname);
+PngImage* png_load_from_file_ex(const char *fname, const PngDecodeOptions* options);
+int png_stream_from_file(const char* fname, const PngDecodeOptions* options, const PngRowSink* sink);
+int png_map_file(const char* fname, PngFileMap* map);
+/* Lit fptr (stdin, tube) jusqu'à la fin dans un tampon libéré par png_unmap_file ; fptr reste ouvert. */
+int png_read_stream(FILE* fptr, PngFileMap* map);
+void png_unmap_file(PngFileMap* map);
+void png_destroy(PngImage* png);
+PngDecoder* png_decoder_create(void);
+void png_decoder_destroy(PngDecoder* dec);
+/* Décode dans *out sans allocation en régime établi. Les pixels (sauf options->allocate) et la palette
+   appartiennent au décodeur et restent valides jusqu'au décodage suivant ; ne pas appeler png_destroy sur out. */
+int png_decode_into(PngDecoder* dec, const unsigned char* data, size_t size, const PngDecodeOptions* options, PngImage* out);
+/* Motif du dernier échec de png_decode_into (chaîne vide après un succès). */
+const char* png_decoder_error(const PngDecoder* dec);
+void png_stats_add(PngStats* total, const PngStats* stats);
+void png_stats_write_json(FILE* out, const PngStats* stats);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,35 @@
+#ifndef PNG_APNG_H
+#define PNG_APNG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "png.h"
+#include "logger.h"
+
+#define PNG_APNG_DISPOSE_NONE 0
+#define PNG_APNG_DISPOSE_BACKGROUND 1
+#define PNG_APNG_DISPOSE_PREVIOUS 2
+#define PNG_APNG_BLEND_SOURCE 0
+#define PNG_APNG_BLEND_OVER 1
+
+/* Contrôle d'une image de l'animation (fcTL). */
+typedef struct PngApngFrame {
+    uint32_t width, height, x_offset, y_offset;
+    uint16_t delay_num, delay_den;
+    uint8_t dispose_op, blend_op;
+} PngApngFrame;
+
+/* Reçoit chaque image composée, dans l'ordre : canvas a les dimensions de l'animation, en BMP 32 bits (BGRA, alpha
+   conservé) ou 24 bits (composé sur le fond) ; ses pixels ne restent valides que pendant l'appel. */
+typedef int (*PngApngSink)(void* user, uint32_t index, const PngImage* canvas, const PngApngFrame* frame);
+
+/* Décode toutes les images d'un APNG (acTL, fcTL, fdAT) et les compose dans l'ordre (dispose_op, blend_op).
+   Chaque image est décompressée, défiltrée et convertie indépendamment par options->threads threads, au plus
+   deux fois plus d'images en avance que de threads ; la composition et sink restent séquentielles. Un PNG sans
+   acTL donne une seule image. Format : 24 bits si options->format vaut PNG_FORMAT_BMP ou PNG_FORMAT_BMP_INDEXED,
+   32 bits sinon. thumbnail_scale, crop et resize ne s'appliquent pas. */
+int png_apng_decode(Logger* logger, const unsigned char* data, size_t size, const PngDecodeOptions* options, PngApngSink sink, void* user);
+/* Écrit une image BMP par image de l'animation : "sortie.bmp" donne sortie_0000.bmp, sortie_0001.bmp... */
+int png_apng_to_bmp(Logger* logger, const unsigned char* data, size_t size, const char* output, const PngDecodeOptions* options);
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef PNG_COMPOSITE_H
+#define PNG_COMPOSITE_H
+
+#include <stdint.h>
+#include "png.h"
+
+typedef struct PngCompositor {
+    float to_linear[256];
+    float alpha[256];
+    uint8_t opaque[256];
+    float background_linear[3];
+    uint8_t background[3];
+    float thresholds[256];
+} PngCompositor;
+
+/* Dernières tables construites (environ 100 µs de calcul), reprises telles quelles pour le même gamma et le
+   même fond : un décodeur réutilisé ne les reconstruit pas d'une image à l'autre. */
+typedef struct PngCompositorCache {
+    PngCompositor compositor;
+    float gamma;
+    RGBA background;
+    bool ready;
+} PngCompositorCache;
+
+void png_compositor_init(PngCompositor* compositor, float gamma, RGBA background);
+const PngCompositor* png_compositor_cached(PngCompositorCache* cache, float gamma, RGBA background);
+
+static inline uint8_t png_compositor_encode(const PngCompositor* compositor, float linear) {
+    unsigned int k = 0;
+    for (unsigned int step = 128; step != 0; step >>= 1) {
+        if (linear >= compositor->thresholds[k + step]) k += step;
+    }
+    return (uint8_t)k;
+}
+
+static inline void png_composite_pixel(const PngCompositor* compositor, uint8_t r, uint8_t g, uint8_t b, uint8_t a, unsigned char* out) {
+    if (a == 255) {
+        out[0] = compositor->opaque[r]; out[1] = compositor->opaque[g]; out[2] = compositor->opaque[b];
+    } else if (a == 0) {
+        out[0] = compositor->background[0]; out[1] = compositor->background[1]; out[2] = compositor->background[2];
+    } else {
+        const float alpha_f = compositor->alpha[a];
+        out[0] = png_compositor_encode(compositor, compositor->to_linear[r] * alpha_f + compositor->background_linear[0] * (1.0f - alpha_f));
+        out[1] = png_compositor_encode(compositor, compositor->to_linear[g] * alpha_f + compositor->background_linear[1] * (1.0f - alpha_f));
+        out[2] = png_compositor_encode(compositor, compositor->to_linear[b] * alpha_f + compositor->background_linear[2] * (1.0f - alpha_f));
+    }
+}
+
+#endif
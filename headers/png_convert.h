@@ -0,0 +1,28 @@
+#ifndef PNG_CONVERT_H
+#define PNG_CONVERT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "png.h"
+#include "png_composite.h"
+
+typedef struct PngConverter PngConverter;
+
+typedef void (*PngRowConverter)(const PngConverter* conv, const unsigned char* src, uint32_t count, unsigned char* dst, size_t dst_step);
+
+struct PngConverter {
+    PngRowConverter convert;
+    PngCompositor compositor;
+    uint8_t lut[256][4];
+    uint8_t expand[256 * 8];
+    bool has_key;
+    RGB16 key;
+    uint8_t index_bits;
+};
+
+/* Convertisseur choisi selon png->pixel_format (déjà résolu, jamais PNG_FORMAT_BMP_AUTO) et png->bits_per_pixel.
+   cache (facultatif) : tables de composition conservées d'un appel à l'autre. */
+int png_converter_init(PngConverter* conv, const PngImage* png, RGBA background, PngCompositorCache* cache);
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef PNG_INFLATE_H
+#define PNG_INFLATE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* PNG_INFLATE_DEFAULT : moteur intégré, ou zlib si le projet est compilé avec -DPNG_INFLATE_USE_ZLIB. */
+typedef enum PngInflateEngine {
+    PNG_INFLATE_DEFAULT = 0,
+    PNG_INFLATE_ZLIB,
+    PNG_INFLATE_BUILTIN
+} PngInflateEngine;
+
+typedef enum PngInflateStatus {
+    PNG_INFLATE_OK = 0,
+    PNG_INFLATE_BAD_HEADER,
+    PNG_INFLATE_BAD_BLOCK,
+    PNG_INFLATE_BAD_STORED,
+    PNG_INFLATE_BAD_CODES,
+    PNG_INFLATE_BAD_SYMBOL,
+    PNG_INFLATE_BAD_DISTANCE,
+    PNG_INFLATE_TRUNCATED,
+    PNG_INFLATE_SHORT,
+    PNG_INFLATE_BAD_CHECKSUM
+} PngInflateStatus;
+
+/* Décompresse un flux zlib complet et contigu dans out, dont la taille exacte est connue (IHDR). Les données
+   au-delà de out_size sont ignorées, comme avec zlib ; un flux qui s'arrête avant est une erreur.
+   *produced reçoit le nombre d'octets écrits. */
+PngInflateStatus png_inflate(const unsigned char* in, size_t in_size, unsigned char* out, size_t out_size, size_t* produced);
+PngInflateEngine png_inflate_resolve(PngInflateEngine engine);
+const char* png_inflate_engine_name(PngInflateEngine engine);
+int png_inflate_parse_engine(const char* name, PngInflateEngine* engine);
+const char* png_inflate_status_string(PngInflateStatus status);
+
+#endif
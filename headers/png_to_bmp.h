@@ -1,9 +1,29 @@
-#ifndef PNG_TO_BMP_H
-#define PNG_TO_BMP_H
-
-#include "png.h"
-#include "logger.h"
-
-int png_save_to_bmp(Logger* logger, const char* output_filename, const PngImage* png, const unsigned char* pixel_data);
-
+#ifndef PNG_TO_BMP_H
+#define PNG_TO_BMP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "png.h"
+#include "logger.h"
+
+int png_save_to_bmp(Logger* logger, const char* output_filename, const PngImage* png, const unsigned char* pixel_data);
+/* stats (facultatif) : ajoute la durée d'écriture et les octets écrits. */
+int png_save_to_bmp_ex(Logger* logger, const char* output_filename, const PngImage* png, const unsigned char* pixel_data, PngStats* stats);
+/* Tampon agrandi par realloc : data NULL et capacity 0 au départ, à libérer par free. size : octets utiles. */
+typedef struct PngBuffer {
+    unsigned char* data;
+    size_t size;
+    size_t capacity;
+} PngBuffer;
+
+/* Agrandit data pour au moins size octets (size inchangé). */
+int png_buffer_reserve(PngBuffer* buffer, size_t size);
+
+/* Convertit un PNG en mémoire en fichier BMP complet dans out, sans accès au système de fichiers. Les pixels
+   sont décodés à leur place dans out (options->allocate est remplacé) ; un format PNG_FORMAT_RGB donne du 24 bits.
+   _ex : decoder réutilisé d'un appel à l'autre (png_decoder_error pour le motif d'un échec). */
+int png_to_bmp_memory(const uint8_t* in, size_t size, PngBuffer* out, const PngDecodeOptions* options);
+int png_to_bmp_memory_ex(PngDecoder* decoder, const uint8_t* in, size_t size, PngBuffer* out, const PngDecodeOptions* options);
+int png_stream_to_bmp(Logger* logger, const char* input_filename, const char* output_filename, const PngDecodeOptions* options);
+
 #endif 
\ No newline at end of file
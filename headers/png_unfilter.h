@@ -0,0 +1,26 @@
+#ifndef PNG_UNFILTER_H
+#define PNG_UNFILTER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef enum PngCpuLevel {
+    PNG_CPU_SCALAR = 0,
+    PNG_CPU_SSE2,
+    PNG_CPU_SSSE3,
+    PNG_CPU_AVX2,
+    PNG_CPU_BEST
+} PngCpuLevel;
+
+typedef void (*PngUnfilterKernel)(unsigned char* dst, const unsigned char* src, const unsigned char* prev, size_t stride);
+
+/* Noyaux du meilleur niveau pris en charge par le processeur, choisis une seule fois (thread-safe) ; appelée par
+   chaque décodage, si bien que les programmes qui intègrent la bibliothèque n'ont rien à faire. */
+void png_unfilter_ensure_init(void);
+/* Limite les noyaux à max_level (--cpu) et retourne le niveau retenu. A appeler avant de lancer des décodages. */
+PngCpuLevel png_unfilter_init(PngCpuLevel max_level);
+const char* png_unfilter_level_name(PngCpuLevel level);
+int png_unfilter_row(uint8_t filter_type, const unsigned char* src, unsigned char* dst, const unsigned char* prev_line, size_t stride, size_t filter_bpp);
+int png_unfilter_row_reference(uint8_t filter_type, const unsigned char* src, unsigned char* dst, const unsigned char* prev_line, size_t stride, size_t filter_bpp);
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "png.h"
+#include "png_to_bmp.h"
+#include "logger.h"
+
+/* Protocole du mode --serve, entiers en petit-boutiste.
+   Requête : "PBRQ", type (1 octet), format (1 octet, SERVER_FORMAT_DEFAULT ou PngPixelFormat), drapeaux
+   (1 octet, SERVER_FLAG_BACKGROUND), 1 octet nul, fond 0x00RRGGBB (4 octets), taille des données (4 octets),
+   puis les données : le PNG (SERVER_REQUEST_DATA) ou "source.png" / "source.png<TAB>destination.bmp" lus et
+   écrits par le serveur (SERVER_REQUEST_PATH).
+   Réponse : "PBRS", statut ServerStatus (4 octets), taille (4 octets), puis le BMP (données, ou chemin sans
+   destination), rien (chemin avec destination) ou le motif de l'échec. */
+#define SERVER_REQUEST_HEADER_SIZE 16
+#define SERVER_REPLY_HEADER_SIZE 12
+#define SERVER_REQUEST_DATA 1
+#define SERVER_REQUEST_PATH 2
+#define SERVER_FORMAT_DEFAULT 0xFF
+#define SERVER_FLAG_BACKGROUND 1
+
+typedef enum ServerStatus {
+    SERVER_OK = 0,
+    SERVER_BAD_REQUEST,
+    SERVER_TOO_LARGE,
+    SERVER_DECODE_FAILED,
+    SERVER_IO_ERROR
+} ServerStatus;
+
+typedef struct ServerRequest {
+    uint8_t kind;
+    uint8_t format;
+    bool has_background;
+    RGBA background;
+    uint32_t size;
+} ServerRequest;
+
+/* threads : connexions servies simultanément, chacune par un thread et son décodeur. queue_length : connexions
+   acceptées en attente d'un thread ; au-delà le serveur cesse d'accepter et les clients attendent dans la file du
+   noyau. max_input : taille maximale des données d'une requête. */
+typedef struct ServerConfig {
+    const char* socket_path;
+    int threads;
+    int queue_length;
+    size_t max_input;
+    PngDecodeOptions options;
+    PngStats* stats;
+} ServerConfig;
+
+/* Sert jusqu'à SIGINT ou SIGTERM, puis termine les requêtes en cours et retourne. */
+int server_run(Logger* logger, const ServerConfig* config);
+int server_connect(const char* socket_path);
+int server_send_request(int fd, const ServerRequest* request, const void* data);
+/* payload reçoit le BMP ou le motif de l'échec ; -1 si la connexion est rompue. */
+int server_read_reply(int fd, ServerStatus* status, PngBuffer* payload);
+const char* server_status_string(ServerStatus status);
+
+#endif
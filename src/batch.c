@@ -0,0 +1,299 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "../headers/batch.h"
+#include "../headers/png_to_bmp.h"
+
+typedef struct WorkQueue {
+    pthread_mutex_t lock;
+    size_t* items;
+    size_t head;
+    size_t tail;
+} WorkQueue;
+
+struct BatchRun;
+
+typedef struct Worker {
+    pthread_t thread;
+    int index;
+    struct BatchRun* run;
+    PngDecoder* decoder;
+    PngStats stats;
+} Worker;
+
+typedef struct BatchRun {
+    Logger* logger;
+    BatchList* list;
+    const BatchConfig* config;
+    WorkQueue* queues;
+    Worker* workers;
+    int worker_count;
+} BatchRun;
+
+typedef struct SizedJob {
+    size_t size;
+    size_t index;
+} SizedJob;
+
+static char* duplicate_string(const char* s) {
+    size_t len = strlen(s);
+    char* copy = malloc(len + 1);
+    if (copy) memcpy(copy, s, len + 1);
+    return copy;
+}
+
+static double monotonic_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int batch_add(BatchList* list, const char* input, const char* output) {
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 64;
+        BatchJob* jobs = realloc(list->jobs, capacity * sizeof(BatchJob));
+        if (!jobs) return -1;
+        list->jobs = jobs;
+        list->capacity = capacity;
+    }
+    BatchJob* job = &list->jobs[list->count];
+    memset(job, 0, sizeof(*job));
+    job->input = duplicate_string(input);
+    job->output = duplicate_string(output);
+    if (!job->input || !job->output) { free(job->input); free(job->output); return -1; }
+    job->status = -1;
+    list->count++;
+    return 0;
+}
+
+int batch_read_manifest(BatchList* list, FILE* manifest) {
+    char line[8192];
+    while (fgets(line, sizeof(line), manifest)) {
+        size_t len = strcspn(line, "\r\n");
+        line[len] = '\0';
+        if (len == 0 || line[0] == '#') continue;
+        char* separator = strchr(line, '\t');
+        if (!separator) separator = strpbrk(line, " ");
+        if (!separator) return -1;
+        char* output = separator;
+        *output++ = '\0';
+        while (*output == ' ' || *output == '\t') output++;
+        if (*output == '\0' || batch_add(list, line, output) != 0) return -1;
+    }
+    return 0;
+}
+
+static bool has_png_extension(const char* name) {
+    size_t len = strlen(name);
+    if (len < 4) return false;
+    const char* ext = name + len - 4;
+    return ext[0] == '.' && (ext[1] == 'p' || ext[1] == 'P') && (ext[2] == 'n' || ext[2] == 'N') && (ext[3] == 'g' || ext[3] == 'G');
+}
+
+int batch_scan_directory(BatchList* list, const char* input_dir, const char* output_dir) {
+    DIR* dir = opendir(input_dir);
+    if (!dir) return -1;
+    struct dirent* entry;
+    int status = 0;
+    while (status == 0 && (entry = readdir(dir)) != NULL) {
+        if (!has_png_extension(entry->d_name)) continue;
+        size_t name_len = strlen(entry->d_name);
+        char* input = malloc(strlen(input_dir) + name_len + 2);
+        char* output = malloc(strlen(output_dir) + name_len + 2);
+        if (!input || !output) { free(input); free(output); status = -1; break; }
+        sprintf(input, "%s/%s", input_dir, entry->d_name);
+        sprintf(output, "%s/%.*s.bmp", output_dir, (int)(name_len - 4), entry->d_name);
+        struct stat st;
+        if (stat(input, &st) == 0 && S_ISREG(st.st_mode)) status = batch_add(list, input, output);
+        free(input);
+        free(output);
+    }
+    closedir(dir);
+    return status;
+}
+
+int batch_default_threads(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+#endif
+}
+
+static int convert_job(Worker* worker, BatchJob* job) {
+    BatchRun* run = worker->run;
+    PngDecodeOptions options = run->config->options;
+    options.stats = run->config->stats ? &worker->stats : NULL;
+    if (run->config->stream) {
+        return png_stream_to_bmp(run->logger, job->input, job->output, &options);
+    }
+    double start = monotonic_seconds();
+    PngFileMap map;
+    if (png_map_file(job->input, &map) != 0) {
+        log_error(run->logger, "Lecture impossible : %s", job->input);
+        return -1;
+    }
+    if (options.stats) {
+        double elapsed = monotonic_seconds() - start;
+        options.stats->read_seconds += elapsed;
+        options.stats->total_seconds += elapsed;
+    }
+    PngCacheKey key;
+    if (run->config->cache) {
+        png_cache_key(map.data, map.size, &options, &key);
+        int hit = png_cache_fetch(run->config->cache, &key, job->output) == 0;
+        if (options.stats) {
+            if (hit) options.stats->cache_hits++;
+            else options.stats->cache_misses++;
+        }
+        if (hit) {
+            png_unmap_file(&map);
+            log_debug(run->logger, "Trouvé dans le cache : %s", job->input);
+            return 0;
+        }
+    }
+    /* Le décodeur du thread garde ses tampons d'un fichier à l'autre. */
+    PngImage img;
+    int status = png_decode_into(worker->decoder, map.data, map.size, &options, &img);
+    png_unmap_file(&map);
+    if (status != 0) {
+        log_error(run->logger, "Echec du décodage : %s (%s)", job->input, png_decoder_error(worker->decoder));
+        return -1;
+    }
+    status = png_save_to_bmp_ex(run->logger, job->output, &img, img.final_pixel_data, options.stats);
+    if (status == 0 && run->config->cache) png_cache_store(run->config->cache, &key, job->output);
+    return status;
+}
+
+/* Le propriétaire prend en tête (les plus gros fichiers d'abord), les voleurs prennent en queue. */
+static bool queue_pop(WorkQueue* queue, size_t* job, bool steal) {
+    bool found = false;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->head < queue->tail) {
+        *job = steal ? queue->items[--queue->tail] : queue->items[queue->head++];
+        found = true;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return found;
+}
+
+static void* worker_main(void* arg) {
+    Worker* worker = arg;
+    BatchRun* run = worker->run;
+    for (;;) {
+        size_t job;
+        bool found = queue_pop(&run->queues[worker->index], &job, false);
+        for (int k = 1; !found && k < run->worker_count; k++) {
+            found = queue_pop(&run->queues[(worker->index + k) % run->worker_count], &job, true);
+        }
+        if (!found) break;
+        BatchJob* current = &run->list->jobs[job];
+        double start = monotonic_seconds();
+        current->status = convert_job(worker, current);
+        current->seconds = monotonic_seconds() - start;
+    }
+    return NULL;
+}
+
+static int compare_sized_jobs(const void* a, const void* b) {
+    const SizedJob* x = a;
+    const SizedJob* y = b;
+    if (x->size != y->size) return x->size < y->size ? 1 : -1;
+    return x->index < y->index ? -1 : (x->index > y->index);
+}
+
+int batch_run(Logger* logger, BatchList* list, const BatchConfig* config) {
+    if (list->count == 0) return 0;
+    int worker_count = config->threads > 0 ? config->threads : batch_default_threads();
+    if ((size_t)worker_count > list->count) worker_count = (int)list->count;
+    BatchRun run = { logger, list, config, NULL, NULL, worker_count };
+    SizedJob* order = malloc(list->count * sizeof(SizedJob));
+    run.queues = calloc(worker_count, sizeof(WorkQueue));
+    run.workers = calloc(worker_count, sizeof(Worker));
+    int status = -1;
+    if (!order || !run.queues || !run.workers) goto cleanup;
+    for (size_t i = 0; i < list->count; i++) {
+        struct stat st;
+        list->jobs[i].input_size = (stat(list->jobs[i].input, &st) == 0) ? (size_t)st.st_size : 0;
+        order[i].size = list->jobs[i].input_size;
+        order[i].index = i;
+    }
+    qsort(order, list->count, sizeof(SizedJob), compare_sized_jobs);
+    for (int w = 0; w < worker_count; w++) {
+        run.queues[w].items = malloc((list->count / worker_count + 1) * sizeof(size_t));
+        if (!run.queues[w].items) goto cleanup;
+        pthread_mutex_init(&run.queues[w].lock, NULL);
+    }
+    for (int w = 0; w < worker_count; w++) {
+        run.workers[w].decoder = png_decoder_create();
+        if (!run.workers[w].decoder) goto cleanup;
+    }
+    for (size_t i = 0; i < list->count; i++) {
+        WorkQueue* queue = &run.queues[i % worker_count];
+        queue->items[queue->tail++] = order[i].index;
+    }
+    log_message(logger, "Traitement par lot : %zu fichiers sur %d threads.", list->count, worker_count);
+    int started = 0;
+    for (int w = 0; w < worker_count; w++) {
+        run.workers[w].index = w;
+        run.workers[w].run = &run;
+        if (pthread_create(&run.workers[w].thread, NULL, worker_main, &run.workers[w]) != 0) break;
+        started++;
+    }
+    if (started == 0) worker_main(&run.workers[0]);
+    for (int w = 0; w < started; w++) pthread_join(run.workers[w].thread, NULL);
+    if (config->stats) for (int w = 0; w < worker_count; w++) png_stats_add(config->stats, &run.workers[w].stats);
+    status = 0;
+    for (size_t i = 0; i < list->count; i++) if (list->jobs[i].status != 0) status = -1;
+cleanup:
+    if (run.queues) {
+        for (int w = 0; w < worker_count; w++) {
+            if (run.queues[w].items) pthread_mutex_destroy(&run.queues[w].lock);
+            free(run.queues[w].items);
+        }
+    }
+    if (run.workers) for (int w = 0; w < worker_count; w++) png_decoder_destroy(run.workers[w].decoder);
+    free(run.queues);
+    free(run.workers);
+    free(order);
+    return status;
+}
+
+void batch_print_summary(FILE* out, const BatchList* list) {
+    size_t succeeded = 0;
+    double total = 0.0;
+    for (size_t i = 0; i < list->count; i++) {
+        const BatchJob* job = &list->jobs[i];
+        fprintf(out, "%s\t%.1f ms\t%s -> %s\n", job->status == 0 ? "OK" : "ECHEC", job->seconds * 1000.0, job->input, job->output);
+        if (job->status == 0) succeeded++;
+        total += job->seconds;
+    }
+    fprintf(out, "Total : %zu fichiers, %zu réussis, %zu échecs, %.1f ms de conversion cumulée\n", list->count, succeeded, list->count - succeeded, total * 1000.0);
+}
+
+void batch_free(BatchList* list) {
+    for (size_t i = 0; i < list->count; i++) {
+        free(list->jobs[i].input);
+        free(list->jobs[i].output);
+    }
+    free(list->jobs);
+    list->jobs = NULL;
+    list->count = list->capacity = 0;
+}
@@ -0,0 +1,316 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "../headers/cache.h"
+
+/* À changer quand le BMP produit pour un même PNG et les mêmes options change : les anciennes entrées ne sont
+   plus jamais trouvées et finissent évincées. */
+#define CACHE_FORMAT_VERSION 1
+
+static uint64_t rotl64(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+static uint64_t fmix64(uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+static uint64_t load_le64(const unsigned char* p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+/* MurmurHash3_x64_128 (Austin Appleby, domaine public), lecture petit-boutiste quelle que soit la machine. */
+static void murmur3_128(const unsigned char* data, size_t size, uint64_t seed, uint64_t* out1, uint64_t* out2) {
+    const uint64_t c1 = 0x87c37b91114253d5ULL, c2 = 0x4cf5ad432745937fULL;
+    uint64_t h1 = seed, h2 = seed;
+    const size_t blocks = size / 16;
+    for (size_t i = 0; i < blocks; i++) {
+        uint64_t k1 = load_le64(data + i * 16), k2 = load_le64(data + i * 16 + 8);
+        k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+        h1 = rotl64(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+        k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+        h2 = rotl64(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+    }
+    const unsigned char* tail = data + blocks * 16;
+    uint64_t k1 = 0, k2 = 0;
+    switch (size & 15) {
+        case 15: k2 ^= (uint64_t)tail[14] << 48; /* fall through */
+        case 14: k2 ^= (uint64_t)tail[13] << 40; /* fall through */
+        case 13: k2 ^= (uint64_t)tail[12] << 32; /* fall through */
+        case 12: k2 ^= (uint64_t)tail[11] << 24; /* fall through */
+        case 11: k2 ^= (uint64_t)tail[10] << 16; /* fall through */
+        case 10: k2 ^= (uint64_t)tail[9] << 8; /* fall through */
+        case 9: k2 ^= (uint64_t)tail[8];
+            k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+            /* fall through */
+        case 8: k1 ^= (uint64_t)tail[7] << 56; /* fall through */
+        case 7: k1 ^= (uint64_t)tail[6] << 48; /* fall through */
+        case 6: k1 ^= (uint64_t)tail[5] << 40; /* fall through */
+        case 5: k1 ^= (uint64_t)tail[4] << 32; /* fall through */
+        case 4: k1 ^= (uint64_t)tail[3] << 24; /* fall through */
+        case 3: k1 ^= (uint64_t)tail[2] << 16; /* fall through */
+        case 2: k1 ^= (uint64_t)tail[1] << 8; /* fall through */
+        case 1: k1 ^= (uint64_t)tail[0];
+            k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+    }
+    h1 ^= (uint64_t)size; h2 ^= (uint64_t)size;
+    h1 += h2; h2 += h1;
+    h1 = fmix64(h1); h2 = fmix64(h2);
+    h1 += h2; h2 += h1;
+    *out1 = h1;
+    *out2 = h2;
+}
+
+static void put_le32(unsigned char* p, uint32_t v) {
+    p[0] = (unsigned char)v; p[1] = (unsigned char)(v >> 8); p[2] = (unsigned char)(v >> 16); p[3] = (unsigned char)(v >> 24);
+}
+
+/* Empreinte du PNG puis, par-dessus, les options qui changent le BMP (pas le moteur de décompression ni les
+   threads). */
+void png_cache_key(const unsigned char* data, size_t size, const PngDecodeOptions* options, PngCacheKey* key) {
+    unsigned char block[64];
+    uint64_t h1, h2;
+    murmur3_128(data, size, CACHE_FORMAT_VERSION, &h1, &h2);
+    for (int i = 0; i < 8; i++) { block[i] = (unsigned char)(h1 >> (8 * i)); block[8 + i] = (unsigned char)(h2 >> (8 * i)); }
+    put_le32(block + 16, (uint32_t)options->format);
+    put_le32(block + 20, ((uint32_t)options->background.r << 16) | ((uint32_t)options->background.g << 8) | options->background.b);
+    put_le32(block + 24, options->thumbnail_scale);
+    put_le32(block + 28, options->crop.x);
+    put_le32(block + 32, options->crop.y);
+    put_le32(block + 36, options->crop.width);
+    put_le32(block + 40, options->crop.height);
+    put_le32(block + 44, options->resize.width);
+    put_le32(block + 48, options->resize.height);
+    uint64_t scale_bits;
+    memcpy(&scale_bits, &options->resize.scale, sizeof(scale_bits));
+    put_le32(block + 52, (uint32_t)scale_bits);
+    put_le32(block + 56, (uint32_t)(scale_bits >> 32));
+    put_le32(block + 60, (uint32_t)options->resize.filter);
+    murmur3_128(block, sizeof(block), 0, &key->h1, &key->h2);
+}
+
+#ifdef _WIN32
+
+PngCache* png_cache_open(Logger* logger, const char* dir, uint64_t max_bytes) {
+    (void)dir; (void)max_bytes;
+    log_error(logger, "Le cache de conversion n'est pas disponible sous Windows.");
+    return NULL;
+}
+
+void png_cache_close(PngCache* cache) { (void)cache; }
+int png_cache_fetch(PngCache* cache, const PngCacheKey* key, const char* output) { (void)cache; (void)key; (void)output; return -1; }
+int png_cache_store(PngCache* cache, const PngCacheKey* key, const char* output) { (void)cache; (void)key; (void)output; return -1; }
+void png_cache_counters(PngCache* cache, PngCacheCounters* counters) { (void)cache; memset(counters, 0, sizeof(*counters)); }
+
+#else
+
+#include <time.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* Fichiers temporaires d'un processus interrompu : supprimés à l'éviction au-delà de cet âge. */
+#define CACHE_STALE_TEMP_SECONDS 3600
+
+struct PngCache {
+    pthread_mutex_t lock;
+    Logger* logger;
+    char* dir;
+    uint64_t max_bytes;
+    /* Estimation : chaque processus ne voit que ses propres ajouts, l'éviction recompte le dossier. */
+    uint64_t total_bytes;
+    uint64_t temp_counter;
+    PngCacheCounters counters;
+};
+
+typedef struct CacheEntry {
+    char* name;
+    uint64_t size;
+    double used;
+} CacheEntry;
+
+static bool is_entry_name(const char* name) {
+    size_t len = strlen(name);
+    return len == 32 + 4 && strcmp(name + 32, ".bmp") == 0 && strspn(name, "0123456789abcdef") == 32;
+}
+
+static char* entry_path(const PngCache* cache, const PngCacheKey* key) {
+    char* path = malloc(strlen(cache->dir) + 1 + 32 + 4 + 1);
+    if (path) sprintf(path, "%s/%016llx%016llx.bmp", cache->dir, (unsigned long long)key->h1, (unsigned long long)key->h2);
+    return path;
+}
+
+static int copy_file(const char* source, const char* destination) {
+    int in = open(source, O_RDONLY);
+    if (in < 0) return -1;
+    int out = open(destination, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out < 0) { close(in); return -1; }
+    char buffer[65536];
+    ssize_t got;
+    int status = 0;
+    while (status == 0 && (got = read(in, buffer, sizeof(buffer))) != 0) {
+        if (got < 0) { if (errno != EINTR) status = -1; continue; }
+        for (ssize_t done = 0; status == 0 && done < got; ) {
+            ssize_t put = write(out, buffer + done, (size_t)(got - done));
+            if (put < 0 && errno != EINTR) status = -1;
+            else if (put > 0) done += put;
+        }
+    }
+    close(in);
+    if (close(out) != 0) status = -1;
+    if (status != 0) unlink(destination);
+    return status;
+}
+
+static int compare_entries(const void* a, const void* b) {
+    const CacheEntry* x = a;
+    const CacheEntry* y = b;
+    return x->used < y->used ? -1 : x->used > y->used;
+}
+
+/* Recompte le dossier et supprime les entrées les moins récemment utilisées jusqu'à 90 % de max_bytes.
+   Appelé verrou pris. */
+static void cache_evict(PngCache* cache) {
+    DIR* dir = opendir(cache->dir);
+    if (!dir) return;
+    CacheEntry* entries = NULL;
+    size_t count = 0, capacity = 0;
+    uint64_t total = 0;
+    time_t now = time(NULL);
+    struct dirent* item;
+    char* path = malloc(strlen(cache->dir) + 256 + 2);
+    while (path && (item = readdir(dir)) != NULL) {
+        struct stat st;
+        sprintf(path, "%s/%.255s", cache->dir, item->d_name);
+        if (strncmp(item->d_name, ".tmp-", 5) == 0) {
+            if (stat(path, &st) == 0 && now - st.st_mtime > CACHE_STALE_TEMP_SECONDS) unlink(path);
+            continue;
+        }
+        if (!is_entry_name(item->d_name) || stat(path, &st) != 0 || !S_ISREG(st.st_mode)) continue;
+        if (count == capacity) {
+            size_t grown = capacity ? capacity * 2 : 256;
+            CacheEntry* resized = realloc(entries, grown * sizeof(CacheEntry));
+            if (!resized) break;
+            entries = resized;
+            capacity = grown;
+        }
+        entries[count].name = malloc(strlen(item->d_name) + 1);
+        if (!entries[count].name) break;
+        strcpy(entries[count].name, item->d_name);
+        entries[count].size = (uint64_t)st.st_size;
+        entries[count].used = st.st_mtim.tv_sec + st.st_mtim.tv_nsec / 1e9;
+        total += (uint64_t)st.st_size;
+        count++;
+    }
+    closedir(dir);
+    qsort(entries, count, sizeof(CacheEntry), compare_entries);
+    const uint64_t target = cache->max_bytes / 10 * 9;
+    for (size_t i = 0; path && i < count && total > target; i++) {
+        sprintf(path, "%s/%s", cache->dir, entries[i].name);
+        if (unlink(path) == 0) {
+            total -= entries[i].size;
+            cache->counters.evictions++;
+        }
+    }
+    for (size_t i = 0; i < count; i++) free(entries[i].name);
+    free(entries);
+    free(path);
+    cache->total_bytes = total;
+}
+
+PngCache* png_cache_open(Logger* logger, const char* dir, uint64_t max_bytes) {
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        log_error(logger, "Impossible de créer le dossier du cache '%s': %s", dir, strerror(errno));
+        return NULL;
+    }
+    PngCache* cache = calloc(1, sizeof(PngCache));
+    if (!cache || !(cache->dir = malloc(strlen(dir) + 1))) {
+        free(cache);
+        return NULL;
+    }
+    strcpy(cache->dir, dir);
+    cache->logger = logger;
+    cache->max_bytes = max_bytes;
+    pthread_mutex_init(&cache->lock, NULL);
+    /* Premier comptage du dossier, et mise au plafond s'il a été réduit depuis la dernière exécution. */
+    cache->max_bytes = UINT64_MAX;
+    cache_evict(cache);
+    cache->max_bytes = max_bytes;
+    if (cache->total_bytes > max_bytes) cache_evict(cache);
+    return cache;
+}
+
+void png_cache_close(PngCache* cache) {
+    if (!cache) return;
+    pthread_mutex_destroy(&cache->lock);
+    free(cache->dir);
+    free(cache);
+}
+
+int png_cache_fetch(PngCache* cache, const PngCacheKey* key, const char* output) {
+    char* path = entry_path(cache, key);
+    int status = -1;
+    struct stat st;
+    if (path && stat(path, &st) == 0) {
+        /* Le lien remplace un BMP existant ; sur un autre système de fichiers, copie. */
+        unlink(output);
+        status = link(path, output) == 0 ? 0 : copy_file(path, output);
+        /* Dernier usage : la date de modification sert d'horloge LRU. */
+        if (status == 0) utimensat(AT_FDCWD, path, NULL, 0);
+    }
+    free(path);
+    pthread_mutex_lock(&cache->lock);
+    if (status == 0) cache->counters.hits++;
+    else cache->counters.misses++;
+    pthread_mutex_unlock(&cache->lock);
+    return status;
+}
+
+int png_cache_store(PngCache* cache, const PngCacheKey* key, const char* output) {
+    char* path = entry_path(cache, key);
+    char* temp = malloc(strlen(cache->dir) + 64);
+    struct stat st;
+    int status = -1;
+    if (path && temp && stat(output, &st) == 0 && S_ISREG(st.st_mode)) {
+        pthread_mutex_lock(&cache->lock);
+        unsigned long long serial = (unsigned long long)cache->temp_counter++;
+        pthread_mutex_unlock(&cache->lock);
+        sprintf(temp, "%s/.tmp-%ld-%llu", cache->dir, (long)getpid(), serial);
+        /* Nom temporaire puis renommage : une entrée visible est toujours complète. */
+        if (link(output, temp) == 0 || copy_file(output, temp) == 0) {
+            status = rename(temp, path);
+            if (status != 0) unlink(temp);
+        }
+    }
+    if (status != 0) log_error(cache->logger, "Impossible d'ajouter '%s' au cache: %s", output, strerror(errno));
+    pthread_mutex_lock(&cache->lock);
+    if (status == 0) {
+        cache->counters.stores++;
+        cache->total_bytes += (uint64_t)st.st_size;
+        if (cache->total_bytes > cache->max_bytes) cache_evict(cache);
+    }
+    pthread_mutex_unlock(&cache->lock);
+    free(path);
+    free(temp);
+    return status;
+}
+
+void png_cache_counters(PngCache* cache, PngCacheCounters* counters) {
+    pthread_mutex_lock(&cache->lock);
+    *counters = cache->counters;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+#endif
@@ -1,68 +1,241 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <stdarg.h>
-#include <time.h>
-#include <string.h>
-
-#include "../headers/logger.h"
-
-static void get_timestamp(char* buffer, size_t buffer_size) {
-    time_t now = time(NULL);
-    strftime(buffer, buffer_size, "%Y-%m-%d %H:%M:%S", localtime(&now));
-}
-
-int log_init(Logger* logger, const char* filename) {
-    if (logger == NULL || filename == NULL) {
-        return -1;
-    }
-    errno_t err = fopen_s(&logger->file, filename, "w");
-    if (err != 0) {
-        perror("FATAL ERROR: Unable to open log file");
-        logger->file = NULL;
-        return -1;
-    }
-    strncpy(logger->filename, filename, sizeof(logger->filename) - 1);
-    logger->filename[sizeof(logger->filename) - 1] = '\0';
-    char time_buffer[30];
-    get_timestamp(time_buffer, sizeof(time_buffer));
-    fprintf(logger->file, "Log started at: %s\n\n", time_buffer);
-    fflush(logger->file);
-    return 0;
-}
-
-void log_close(Logger* logger) {
-    if (logger != NULL && logger->file != NULL) {
-        fprintf(logger->file, "\n--- End of log ---\n");
-        fclose(logger->file);
-        logger->file = NULL;
-    }
-}
-
-static void log_generic(Logger* logger, const char* level, const char* format, va_list args) {
-    if (logger == NULL || logger->file == NULL) {
-        return;
-    }
-    char time_buffer[30];
-    get_timestamp(time_buffer, sizeof(time_buffer));
-    fprintf(logger->file, "[%s] [%s] ", time_buffer, level);
-    vfprintf(logger->file, format, args);
-    size_t len = strlen(format);
-    if (len == 0 || (len > 0 && format[len - 1] != '\n')) {
-        fputc('\n', logger->file);
-    }
-    fflush(logger->file);
-}
-
-void log_message(Logger* logger, const char* format, ...) {
-    va_list args;
-    va_start(args, format);
-    log_generic(logger, "MESSAGE", format, args);
-    va_end(args);
-}
-
-void log_error(Logger* logger, const char* format, ...) {
-    va_list args;
-    va_start(args, format);
-    log_generic(logger, "ERROR", format, args);
-    va_end(args);
-}
\ No newline at end of file
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "../headers/logger.h"
+
+#define LOG_RING_SLOTS 256
+#define LOG_MESSAGE_SIZE 1024
+#define LOG_WRITE_BUFFER (64 * 1024)
+#define LOG_IDLE_WAIT_NS (50 * 1000000L)
+
+typedef struct LogSlot {
+    size_t sequence;
+    LogLevel level;
+    time_t time;
+    char text[LOG_MESSAGE_SIZE];
+} LogSlot;
+
+/* File bornée multi-producteurs / un consommateur (numéros de séquence par case, sans verrou).
+   Le mutex et la condition ne servent qu'à réveiller le thread d'écriture quand il dort. */
+struct LogRing {
+    LogSlot slots[LOG_RING_SLOTS];
+    size_t enqueue_pos;
+    size_t dequeue_pos;
+    int sleeping;
+    int stopping;
+    pthread_t writer;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    time_t cached_second;
+    char cached_stamp[32];
+    size_t buffer_used;
+    char buffer[LOG_WRITE_BUFFER];
+};
+
+static const char* level_names[] = { "DEBUG", "MESSAGE", "ERROR" };
+
+static void get_timestamp(time_t now, char* buffer, size_t buffer_size) {
+    struct tm local;
+#ifdef _WIN32
+    localtime_s(&local, &now);
+#else
+    localtime_r(&now, &local);
+#endif
+    strftime(buffer, buffer_size, "%Y-%m-%d %H:%M:%S", &local);
+}
+
+static void ring_flush(Logger* logger) {
+    struct LogRing* ring = logger->ring;
+    if (ring->buffer_used == 0) return;
+    fwrite(ring->buffer, 1, ring->buffer_used, logger->file);
+    ring->buffer_used = 0;
+}
+
+/* Vide les cases prêtes dans le tampon d'écriture ; l'horodatage n'est reformaté qu'une fois par seconde. */
+static size_t ring_drain(Logger* logger) {
+    struct LogRing* ring = logger->ring;
+    size_t drained = 0;
+    for (;;) {
+        LogSlot* slot = &ring->slots[ring->dequeue_pos & (LOG_RING_SLOTS - 1)];
+        if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != ring->dequeue_pos + 1) break;
+        if (slot->time != ring->cached_second) {
+            ring->cached_second = slot->time;
+            get_timestamp(slot->time, ring->cached_stamp, sizeof(ring->cached_stamp));
+        }
+        if (LOG_WRITE_BUFFER - ring->buffer_used < LOG_MESSAGE_SIZE + 64) ring_flush(logger);
+        size_t len = strlen(slot->text);
+        const char* newline = (len == 0 || slot->text[len - 1] != '\n') ? "\n" : "";
+        int n = snprintf(ring->buffer + ring->buffer_used, LOG_WRITE_BUFFER - ring->buffer_used, "[%s] [%s] %s%s", ring->cached_stamp, level_names[slot->level], slot->text, newline);
+        if (n > 0) ring->buffer_used += (size_t)n;
+        __atomic_store_n(&slot->sequence, ring->dequeue_pos + LOG_RING_SLOTS, __ATOMIC_RELEASE);
+        __atomic_store_n(&ring->dequeue_pos, ring->dequeue_pos + 1, __ATOMIC_RELAXED);
+        drained++;
+    }
+    ring_flush(logger);
+    return drained;
+}
+
+static int ring_ready(const struct LogRing* ring) {
+    const LogSlot* slot = &ring->slots[ring->dequeue_pos & (LOG_RING_SLOTS - 1)];
+    return __atomic_load_n(&slot->sequence, __ATOMIC_SEQ_CST) == ring->dequeue_pos + 1;
+}
+
+static void* log_writer_main(void* arg) {
+    Logger* logger = arg;
+    struct LogRing* ring = logger->ring;
+    for (;;) {
+        if (ring_drain(logger) > 0) continue;
+        if (__atomic_load_n(&ring->stopping, __ATOMIC_ACQUIRE)) {
+            if (ring_drain(logger) == 0) break;
+            continue;
+        }
+        pthread_mutex_lock(&ring->lock);
+        __atomic_store_n(&ring->sleeping, 1, __ATOMIC_SEQ_CST);
+        if (!ring_ready(ring) && !__atomic_load_n(&ring->stopping, __ATOMIC_SEQ_CST)) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += LOG_IDLE_WAIT_NS;
+            if (deadline.tv_nsec >= 1000000000L) { deadline.tv_sec++; deadline.tv_nsec -= 1000000000L; }
+            pthread_cond_timedwait(&ring->wake, &ring->lock, &deadline);
+        }
+        __atomic_store_n(&ring->sleeping, 0, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&ring->lock);
+    }
+    return NULL;
+}
+
+static void ring_wake(struct LogRing* ring) {
+    pthread_mutex_lock(&ring->lock);
+    pthread_cond_signal(&ring->wake);
+    pthread_mutex_unlock(&ring->lock);
+}
+
+int log_init(Logger* logger, const char* filename) {
+    if (logger == NULL || filename == NULL) {
+        return -1;
+    }
+    memset(logger, 0, sizeof(*logger));
+    logger->level = LOG_LEVEL_INFO;
+    logger->file = strcmp(filename, "-") == 0 ? stderr : fopen(filename, "a");
+    if (logger->file == NULL) {
+        perror("FATAL ERROR: Unable to open log file");
+        return -1;
+    }
+    /* Le thread d'écriture assemble lui-même des lignes entières : pas de second tampon côté stdio. */
+    setvbuf(logger->file, NULL, _IONBF, 0);
+    strncpy(logger->filename, filename, sizeof(logger->filename) - 1);
+    logger->filename[sizeof(logger->filename) - 1] = '\0';
+    char time_buffer[30];
+    get_timestamp(time(NULL), time_buffer, sizeof(time_buffer));
+    fprintf(logger->file, "Log started at: %s\n\n", time_buffer);
+    struct LogRing* ring = calloc(1, sizeof(struct LogRing));
+    if (ring == NULL) {
+        log_close(logger);
+        return -1;
+    }
+    for (size_t i = 0; i < LOG_RING_SLOTS; i++) ring->slots[i].sequence = i;
+    ring->cached_second = (time_t)-1;
+    pthread_mutex_init(&ring->lock, NULL);
+    pthread_cond_init(&ring->wake, NULL);
+    logger->ring = ring;
+    if (pthread_create(&ring->writer, NULL, log_writer_main, logger) != 0) {
+        pthread_mutex_destroy(&ring->lock);
+        pthread_cond_destroy(&ring->wake);
+        free(ring);
+        logger->ring = NULL;
+        log_close(logger);
+        return -1;
+    }
+    return 0;
+}
+
+void log_close(Logger* logger) {
+    if (logger == NULL || logger->file == NULL) {
+        return;
+    }
+    struct LogRing* ring = logger->ring;
+    if (ring != NULL) {
+        __atomic_store_n(&ring->stopping, 1, __ATOMIC_SEQ_CST);
+        ring_wake(ring);
+        pthread_join(ring->writer, NULL);
+        pthread_mutex_destroy(&ring->lock);
+        pthread_cond_destroy(&ring->wake);
+        free(ring);
+        logger->ring = NULL;
+    }
+    fprintf(logger->file, "\n--- End of log ---\n");
+    if (logger->file != stderr) fclose(logger->file);
+    logger->file = NULL;
+}
+
+void log_set_level(Logger* logger, LogLevel level) {
+    if (logger != NULL) logger->level = level;
+}
+
+int log_parse_level(const char* name, LogLevel* level) {
+    static const char* names[] = { "debug", "info", "error", "none" };
+    for (int i = 0; i <= LOG_LEVEL_NONE; i++) {
+        if (strcmp(name, names[i]) == 0) { *level = (LogLevel)i; return 0; }
+    }
+    return -1;
+}
+
+/* Réserve une case (attente active si l'anneau est plein : aucun message n'est perdu), y formate le
+   message puis la publie. Aucun verrou ni appel système sur ce chemin, sauf pour réveiller l'écrivain. */
+static void log_generic(Logger* logger, LogLevel level, const char* format, va_list args) {
+    if (logger == NULL || logger->ring == NULL || level < logger->level) {
+        return;
+    }
+    struct LogRing* ring = logger->ring;
+    size_t pos = __atomic_load_n(&ring->enqueue_pos, __ATOMIC_RELAXED);
+    LogSlot* slot;
+    for (;;) {
+        slot = &ring->slots[pos & (LOG_RING_SLOTS - 1)];
+        intptr_t diff = (intptr_t)__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) - (intptr_t)pos;
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&ring->enqueue_pos, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+        } else {
+            if (diff < 0) { ring_wake(ring); sched_yield(); }
+            pos = __atomic_load_n(&ring->enqueue_pos, __ATOMIC_RELAXED);
+        }
+    }
+    slot->level = level;
+    slot->time = time(NULL);
+    vsnprintf(slot->text, sizeof(slot->text), format, args);
+    /* L'écrivain passe de lui-même toutes les LOG_IDLE_WAIT_NS : on ne le réveille (appel système) que pour
+       une erreur ou un anneau à moitié plein. Publication et lecture de "sleeping" en ordre séquentiel,
+       symétriques de log_writer_main, pour qu'un réveil ne soit jamais perdu. */
+    __atomic_store_n(&slot->sequence, pos + 1, __ATOMIC_SEQ_CST);
+    bool urgent = level >= LOG_LEVEL_ERROR || pos - __atomic_load_n(&ring->dequeue_pos, __ATOMIC_RELAXED) >= LOG_RING_SLOTS / 2;
+    if (urgent && __atomic_load_n(&ring->sleeping, __ATOMIC_SEQ_CST)) ring_wake(ring);
+}
+
+void log_write(Logger* logger, LogLevel level, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    log_generic(logger, level, format, args);
+    va_end(args);
+}
+
+void log_message(Logger* logger, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    log_generic(logger, LOG_LEVEL_INFO, format, args);
+    va_end(args);
+}
+
+void log_error(Logger* logger, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    log_generic(logger, LOG_LEVEL_ERROR, format, args);
+    va_end(args);
+}
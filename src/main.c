@@ -1,54 +1,399 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <unistd.h> 
-#include <limits.h> 
-#include <errno.h>
-
-#include "../headers/png.h" 
-#include "../headers/png_to_bmp.h"
-#include "../headers/logger.h"
-
-int main(int argc, char *argv[]) 
-{
-    Logger logger;
-
-    char *input;
-    char *output;
-
-    PngImage* img;
-
-    if (log_init(&logger, "conversion.log") != 0) {
-        fprintf(stderr, "err\n");
-        return EXIT_FAILURE;
-    }
-
-    if (argc != 3) {
-        log_error(&logger, "Usage: %s <source.png> <destination.bmp>", argv[0]);
-        log_close(&logger);
-        return EXIT_FAILURE;
-    }
-    input = argv[1];
-    output = argv[2];
-
-    log_message(&logger, "\n--- Traitement du fichier PNG : %s ---", input);
-    img = png_load_from_file(input);
-    if (!img) {
-        log_error(&logger, "Echec du chargement ou du traitement du fichier PNG. Arrêt.");
-        png_destroy(img);
-        log_close(&logger);
-        return EXIT_FAILURE;
-    }
-    log_message(&logger, "Données d'image préparées avec succès.");
-
-    log_message(&logger, "\n--- Conversion en BMP ---");
-    if (png_save_to_bmp(&logger, output, img, img->final_pixel_data) != 0) {
-        log_error(&logger, "La sauvegarde en BMP a échoué.");
-    }
-
-    log_message(&logger, "\n--- Nettoyage de la mémoire ---");
-    png_destroy(img);
-    log_message(&logger, "Mémoire libérée.");
-    log_close(&logger);
-    return EXIT_SUCCESS;
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h> 
+#include <limits.h> 
+#include <errno.h>
+#include <time.h>
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+#include "../headers/png.h" 
+#include "../headers/png_to_bmp.h"
+#include "../headers/png_unfilter.h"
+#include "../headers/logger.h"
+#include "../headers/batch.h"
+#include "../headers/server.h"
+#include "../headers/cache.h"
+#include "../headers/png_apng.h"
+
+static const char* usage =
+    "Usage: %s [--stream] [--background RRGGBB] [--threads N] [--log fichier|-] [--log-level debug|info|error|none] [--stats fichier|-] [--thumbnail 4|8] [--crop x,y,l,h] [--resize LxH|--scale f] [--resample box|bilinear] [--inflate zlib|builtin] [--format auto|24|32|index] [--cache dossier] [--cache-size Mo] <source.png|-> <destination.bmp|->\n"
+    "       %s [options] --apng <source.png|-> <destination.bmp>\n"
+    "       %s --probe <source.png>\n"
+    "       %s [options] --batch <manifeste|-> [--threads N]\n"
+    "       %s [options] --batch-dir <dossier_png> <dossier_bmp> [--threads N]\n"
+    "       %s [options] --serve <socket> [--threads N] [--queue N]";
+
+static double monotonic_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void write_stats(Logger* logger, const char* destination, const PngStats* stats)
+{
+    FILE* out = strcmp(destination, "-") == 0 ? stdout : fopen(destination, "w");
+    if (!out) {
+        log_error(logger, "Impossible d'écrire les statistiques dans '%s': %s", destination, strerror(errno));
+        return;
+    }
+    png_stats_write_json(out, stats);
+    if (out != stdout) fclose(out);
+}
+
+static void log_cache_summary(Logger* logger, PngCache* cache)
+{
+    PngCacheCounters counters;
+    png_cache_counters(cache, &counters);
+    log_message(logger, "Cache : %llu trouvés, %llu absents, %llu ajoutés, %llu évincés.", (unsigned long long)counters.hits,
+                (unsigned long long)counters.misses, (unsigned long long)counters.stores, (unsigned long long)counters.evictions);
+}
+
+static int run_batch(Logger* logger, const char* manifest, const char* input_dir, const char* output_dir, const BatchConfig* config)
+{
+    BatchList list = { NULL, 0, 0 };
+    int status;
+    if (manifest) {
+        FILE* file = strcmp(manifest, "-") == 0 ? stdin : fopen(manifest, "r");
+        if (!file) {
+            log_error(logger, "Impossible d'ouvrir le manifeste '%s': %s", manifest, strerror(errno));
+            return EXIT_FAILURE;
+        }
+        status = batch_read_manifest(&list, file);
+        if (file != stdin) fclose(file);
+    } else {
+        status = batch_scan_directory(&list, input_dir, output_dir);
+    }
+    if (status != 0) {
+        log_error(logger, "Liste de fichiers invalide.");
+        batch_free(&list);
+        return EXIT_FAILURE;
+    }
+    status = batch_run(logger, &list, config);
+    batch_print_summary(stdout, &list);
+    batch_free(&list);
+    return status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int main(int argc, char *argv[]) 
+{
+    Logger logger;
+
+    char *input;
+    char *output;
+
+    PngImage img;
+    PngDecoder* decoder;
+    PngFileMap map;
+
+    const char* log_file = "conversion.log";
+    LogLevel log_level = LOG_LEVEL_INFO;
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], "--log") == 0) {
+            log_file = argv[++i];
+        } else if (strcmp(argv[i], "--log-level") == 0 && log_parse_level(argv[++i], &log_level) != 0) {
+            fprintf(stderr, "Niveau de log invalide : %s (attendu debug, info, error ou none)\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (log_init(&logger, log_file) != 0) {
+        fprintf(stderr, "err\n");
+        return EXIT_FAILURE;
+    }
+    log_set_level(&logger, log_level);
+    log_message(&logger, "Noyaux de défiltrage : %s", png_unfilter_level_name(png_unfilter_init(PNG_CPU_BEST)));
+
+    int stream = 0;
+    int probe = 0;
+    int apng = 0;
+    PngDecodeOptions options;
+    png_options_init(&options);
+    options.format = PNG_FORMAT_BMP_AUTO;
+    int threads = 0;
+    const char* manifest = NULL;
+    const char* batch_input_dir = NULL;
+    const char* batch_output_dir = NULL;
+    const char* stats_file = NULL;
+    const char* serve_socket = NULL;
+    int queue_length = 0;
+    const char* cache_dir = NULL;
+    long cache_megabytes = 1024;
+    PngCache* cache = NULL;
+    PngStats stats;
+    memset(&stats, 0, sizeof(stats));
+    input = NULL;
+    output = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--stream") == 0) {
+            stream = 1;
+        } else if (strcmp(argv[i], "--probe") == 0) {
+            probe = 1;
+        } else if (strcmp(argv[i], "--apng") == 0) {
+            apng = 1;
+        } else if (strcmp(argv[i], "--crop") == 0 && i + 1 < argc) {
+            PngRect* crop = &options.crop;
+            if (sscanf(argv[++i], "%u,%u,%u,%u", &crop->x, &crop->y, &crop->width, &crop->height) != 4 || crop->width == 0 || crop->height == 0) {
+                log_error(&logger, "Découpe invalide : %s (attendu x,y,largeur,hauteur)", argv[i]);
+                log_close(&logger);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--resize") == 0 && i + 1 < argc) {
+            PngResize* resize = &options.resize;
+            if (sscanf(argv[++i], "%ux%u", &resize->width, &resize->height) != 2 || (resize->width == 0 && resize->height == 0)) {
+                log_error(&logger, "Taille invalide : %s (attendu LxH, 0 pour garder les proportions)", argv[i]);
+                log_close(&logger);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--scale") == 0 && i + 1 < argc) {
+            options.resize.scale = atof(argv[++i]);
+            if (!(options.resize.scale > 0.0)) {
+                log_error(&logger, "Facteur d'échelle invalide : %s", argv[i]);
+                log_close(&logger);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--resample") == 0 && i + 1 < argc) {
+            if (png_parse_resize_filter(argv[++i], &options.resize.filter) != 0) {
+                log_error(&logger, "Filtre de redimensionnement invalide : %s (attendu box ou bilinear)", argv[i]);
+                log_close(&logger);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--inflate") == 0 && i + 1 < argc) {
+            if (png_inflate_parse_engine(argv[++i], &options.inflate_engine) != 0) {
+                log_error(&logger, "Moteur de décompression invalide : %s (attendu zlib ou builtin)", argv[i]);
+                log_close(&logger);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            if (png_parse_format(argv[++i], &options.format) != 0) {
+                log_error(&logger, "Format BMP invalide : %s (attendu auto, 24, 32 ou index)", argv[i]);
+                log_close(&logger);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--thumbnail") == 0 && i + 1 < argc) {
+            options.thumbnail_scale = (uint32_t)atoi(argv[++i]);
+            if (options.thumbnail_scale != 4 && options.thumbnail_scale != 8) {
+                log_error(&logger, "Réduction de vignette invalide : %s (attendu 4 ou 8)", argv[i]);
+                log_close(&logger);
+                return EXIT_FAILURE;
+            }
+        } else if ((strcmp(argv[i], "--log") == 0 || strcmp(argv[i], "--log-level") == 0) && i + 1 < argc) {
+            i++;
+        } else if (strcmp(argv[i], "--background") == 0 && i + 1 < argc) {
+            unsigned int rgb;
+            if (sscanf(argv[++i], "%6x", &rgb) != 1) {
+                log_error(&logger, "Couleur de fond invalide : %s (attendu RRGGBB)", argv[i]);
+                log_close(&logger);
+                return EXIT_FAILURE;
+            }
+            options.background.r = (rgb >> 16) & 0xFF;
+            options.background.g = (rgb >> 8) & 0xFF;
+            options.background.b = rgb & 0xFF;
+        } else if (strcmp(argv[i], "--stats") == 0 && i + 1 < argc) {
+            stats_file = argv[++i];
+            options.stats = &stats;
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+            serve_socket = argv[++i];
+        } else if (strcmp(argv[i], "--queue") == 0 && i + 1 < argc) {
+            queue_length = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc) {
+            cache_dir = argv[++i];
+        } else if (strcmp(argv[i], "--cache-size") == 0 && i + 1 < argc) {
+            cache_megabytes = atol(argv[++i]);
+            if (cache_megabytes <= 0) {
+                log_error(&logger, "Taille de cache invalide : %s (attendu un nombre de Mo)", argv[i]);
+                log_close(&logger);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            manifest = argv[++i];
+        } else if (strcmp(argv[i], "--batch-dir") == 0 && i + 2 < argc) {
+            batch_input_dir = argv[++i];
+            batch_output_dir = argv[++i];
+        } else if (!input) {
+            input = argv[i];
+        } else if (!output) {
+            output = argv[i];
+        } else {
+            input = NULL;
+            break;
+        }
+    }
+    const int resizing = options.resize.scale > 0.0 || options.resize.width || options.resize.height;
+    if ((stream && (options.thumbnail_scale || options.crop.width || resizing)) || (options.thumbnail_scale && options.crop.width)
+        || (resizing && (options.thumbnail_scale || options.crop.width || (options.resize.scale > 0.0 && (options.resize.width || options.resize.height))))) {
+        log_error(&logger, "--thumbnail, --crop, --resize/--scale et --stream ne se combinent pas.");
+        log_close(&logger);
+        return EXIT_FAILURE;
+    }
+    if (apng && (stream || options.thumbnail_scale || options.crop.width || resizing || manifest || batch_input_dir || serve_socket || (output && strcmp(output, "-") == 0))) {
+        log_error(&logger, "--apng ne se combine ni avec --stream, --thumbnail, --crop, --resize/--scale, les lots, --serve ni une sortie '-'.");
+        log_close(&logger);
+        return EXIT_FAILURE;
+    }
+    if (probe && input && !output) {
+        PngInfo info;
+        int status = png_probe(input, &info);
+        if (status == 0) {
+            printf("%s : %ux%u, profondeur %u, type de couleur %u, entrelacement %u, gamma %.2f, palette %u couleurs%s\n", input, info.width, info.height,
+                   info.bit_depth, info.color_type, info.interlace_method, info.file_gamma, info.palette_size, info.has_transparency_key ? ", transparence" : "");
+        } else {
+            log_error(&logger, "En-tête PNG illisible : %s", input);
+        }
+        log_close(&logger);
+        return status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (serve_socket) {
+        ServerConfig config;
+        config.socket_path = serve_socket;
+        config.threads = threads > 0 ? threads : batch_default_threads();
+        config.queue_length = queue_length;
+        config.max_input = (size_t)1 << 28;
+        options.threads = 1;
+        config.options = options;
+        config.stats = options.stats;
+        int status = server_run(&logger, &config);
+        if (stats_file) write_stats(&logger, stats_file, &stats);
+        log_close(&logger);
+        return status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (cache_dir && !stream && !apng && (manifest || batch_input_dir || (output && strcmp(output, "-") != 0))) {
+        cache = png_cache_open(&logger, cache_dir, (uint64_t)cache_megabytes << 20);
+        if (!cache) {
+            log_close(&logger);
+            return EXIT_FAILURE;
+        }
+    }
+    if (manifest || batch_input_dir) {
+        BatchConfig config;
+        config.threads = threads;
+        options.threads = 1;
+        config.stream = stream;
+        config.options = options;
+        config.stats = options.stats;
+        config.cache = cache;
+        int status = run_batch(&logger, manifest, batch_input_dir, batch_output_dir, &config);
+        if (cache) log_cache_summary(&logger, cache);
+        png_cache_close(cache);
+        if (stats_file) write_stats(&logger, stats_file, &stats);
+        log_close(&logger);
+        return status;
+    }
+    if (!input || !output) {
+        log_error(&logger, usage, argv[0], argv[0], argv[0], argv[0], argv[0], argv[0]);
+        png_cache_close(cache);
+        log_close(&logger);
+        return EXIT_FAILURE;
+    }
+
+    options.threads = threads > 0 ? threads : batch_default_threads();
+    int from_stdin = strcmp(input, "-") == 0;
+    int to_stdout = strcmp(output, "-") == 0;
+    if ((stream && (from_stdin || to_stdout)) || (to_stdout && stats_file && strcmp(stats_file, "-") == 0)) {
+        log_error(&logger, "'-' ne se combine ni avec --stream ni avec --stats -.");
+        log_close(&logger);
+        return EXIT_FAILURE;
+    }
+#ifdef _WIN32
+    if (from_stdin) _setmode(_fileno(stdin), _O_BINARY);
+    if (to_stdout) _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    if (stream) {
+        log_message(&logger, "\n--- Conversion en flux : %s -> %s ---", input, output);
+        int status = png_stream_to_bmp(&logger, input, output, &options);
+        if (stats_file && status == 0) write_stats(&logger, stats_file, &stats);
+        log_close(&logger);
+        return status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    log_message(&logger, "\n--- Traitement du fichier PNG : %s ---", input);
+    log_debug(&logger, "Décompression : %s", png_inflate_engine_name(options.inflate_engine));
+    double read_start = monotonic_seconds();
+    decoder = png_decoder_create();
+    if (!decoder || (from_stdin ? png_read_stream(stdin, &map) : png_map_file(input, &map)) != 0) {
+        log_error(&logger, "Lecture impossible : %s", input);
+        png_decoder_destroy(decoder);
+        png_cache_close(cache);
+        log_close(&logger);
+        return EXIT_FAILURE;
+    }
+    if (options.stats) {
+        stats.read_seconds += monotonic_seconds() - read_start;
+        stats.total_seconds += monotonic_seconds() - read_start;
+    }
+    if (apng) {
+        log_message(&logger, "\n--- Extraction des images APNG : %s -> %s ---", input, output);
+        int status = png_apng_to_bmp(&logger, map.data, map.size, output, &options);
+        png_unmap_file(&map);
+        png_decoder_destroy(decoder);
+        if (status == 0 && stats_file) write_stats(&logger, stats_file, &stats);
+        log_close(&logger);
+        return status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (to_stdout) {
+        /* Pas de fichier intermédiaire : le BMP complet est construit en mémoire puis écrit d'un bloc. */
+        PngBuffer bmp = { NULL, 0, 0 };
+        int status = png_to_bmp_memory_ex(decoder, map.data, map.size, &bmp, &options);
+        png_unmap_file(&map);
+        if (status != 0) {
+            log_error(&logger, "Echec du chargement ou du traitement du fichier PNG (%s). Arrêt.", png_decoder_error(decoder));
+        } else if (fwrite(bmp.data, 1, bmp.size, stdout) != bmp.size || fflush(stdout) != 0) {
+            log_error(&logger, "Ecriture du BMP sur la sortie standard impossible : %s", strerror(errno));
+            status = -1;
+        } else if (stats_file) {
+            write_stats(&logger, stats_file, &stats);
+        }
+        free(bmp.data);
+        png_decoder_destroy(decoder);
+        log_close(&logger);
+        return status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    PngCacheKey key;
+    if (cache) {
+        png_cache_key(map.data, map.size, &options, &key);
+        if (png_cache_fetch(cache, &key, output) == 0) {
+            log_message(&logger, "BMP repris du cache : %s", output);
+            stats.cache_hits++;
+            png_unmap_file(&map);
+            png_decoder_destroy(decoder);
+            png_cache_close(cache);
+            if (stats_file) write_stats(&logger, stats_file, &stats);
+            log_close(&logger);
+            return EXIT_SUCCESS;
+        }
+        stats.cache_misses++;
+    }
+    if (png_decode_into(decoder, map.data, map.size, &options, &img) != 0) {
+        log_error(&logger, "Echec du chargement ou du traitement du fichier PNG (%s). Arrêt.", png_decoder_error(decoder));
+        png_unmap_file(&map);
+        png_decoder_destroy(decoder);
+        png_cache_close(cache);
+        log_close(&logger);
+        return EXIT_FAILURE;
+    }
+    png_unmap_file(&map);
+    log_debug(&logger, "Données d'image préparées avec succès.");
+
+    log_message(&logger, "\n--- Conversion en BMP ---");
+    int status = png_save_to_bmp_ex(&logger, output, &img, img.final_pixel_data, options.stats);
+    if (status != 0) {
+        log_error(&logger, "La sauvegarde en BMP a échoué.");
+    } else {
+        if (cache) png_cache_store(cache, &key, output);
+        if (stats_file) write_stats(&logger, stats_file, &stats);
+    }
+    png_cache_close(cache);
+
+    log_debug(&logger, "\n--- Nettoyage de la mémoire ---");
+    png_decoder_destroy(decoder);
+    log_debug(&logger, "Mémoire libérée.");
+    log_close(&logger);
+    return status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
\ No newline at end of file
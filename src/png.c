@@ -1,288 +1,1803 @@
-#include <stdbool.h>
-#include <stdlib.h>
-#include <stdio.h>
-#include <stdint.h>
-#include <string.h>
-#include <zlib.h>
-#include <math.h> 
-
-#include "../headers/png.h" 
-#include "../headers/logger.h"
-
-const int adam7_start_x[] = {0, 4, 0, 2, 0, 1, 0}; const int adam7_start_y[] = {0, 0, 4, 0, 2, 0, 1};
-const int adam7_step_x[]  = {8, 8, 4, 4, 2, 2, 1}; const int adam7_step_y[]  = {8, 8, 8, 4, 4, 2, 2};
-static int unfilter_pass(const PngImage* png, const unsigned char* src, unsigned char* dst, uint32_t pass_width, uint32_t pass_height);
-static void place_pixels(PngImage* png, const unsigned char* pass_pixels, int pass_index, uint32_t pass_width, uint32_t pass_height);
-static uint16_t get_pixel_value_at(const unsigned char* data, uint32_t x, uint32_t y, uint32_t pass_width, uint8_t bit_depth);
-static uint32_t ntohl_manual(uint32_t n); static uint16_t ntohs_manual(uint16_t n);
-
-void png_destroy(PngImage* png) {
-    if (png != NULL) { free(png->final_pixel_data); free(png->palette); free(png); }
-}
-
-PngImage* 
-png_load_from_data(const unsigned char* data, size_t size)
-{
-    const uint8_t png_sig_bytes[8] = {137, 80, 78, 71, 13, 10, 26, 10};
-    if (size < 8 || memcmp(data, png_sig_bytes, 8) != 0) return NULL;
-    PngImage* png = calloc(1, sizeof(PngImage));
-    if (!png) return NULL;
-    png->file_gamma = 1.0f / 2.2f;
-    png->has_transparency_key = false;
-    unsigned char* compressed_data = NULL;
-    size_t compressed_size = 0;
-    const unsigned char* current_ptr = data + 8;
-    while (current_ptr < data + size) {
-        uint32_t chunk_length = ntohl_manual(*(uint32_t*)current_ptr);
-        const unsigned char* chunk_type = current_ptr + 4;
-        const unsigned char* chunk_data = current_ptr + 8;
-        if (chunk_data + chunk_length + 4 > data + size) { png_destroy(png); return NULL; }
-        uint32_t stored_crc = ntohl_manual(*(uint32_t*)(chunk_data + chunk_length));
-        uLong calculated_crc = crc32(crc32(0L, chunk_type, 4), chunk_data, chunk_length);
-        if (calculated_crc != stored_crc) { png_destroy(png); return NULL; }
-
-        if (strncmp((const char*)chunk_type, "IHDR", 4) == 0) {
-            png->width = ntohl_manual(*(uint32_t*)(chunk_data)); png->height = ntohl_manual(*(uint32_t*)(chunk_data + 4));
-            png->bit_depth = chunk_data[8]; png->color_type = chunk_data[9]; png->interlace_method = chunk_data[12];
-            png->bytes_per_pixel = 3;
-        } else if (strncmp((const char*)chunk_type, "PLTE", 4) == 0) {
-            png->palette_size = chunk_length / 3;
-            png->palette = malloc(png->palette_size * sizeof(RGBA));
-            for(unsigned int i=0; i<png->palette_size; ++i) { png->palette[i].r = chunk_data[i*3]; png->palette[i].g = chunk_data[i*3+1]; png->palette[i].b = chunk_data[i*3+2]; png->palette[i].a = 255; }
-        } else if (strncmp((const char*)chunk_type, "gAMA", 4) == 0) {
-            uint32_t gamma_int = ntohl_manual(*(uint32_t*)chunk_data);
-            if (gamma_int != 0) { png->file_gamma = 1.0f / (gamma_int / 100000.0f); }
-        } else if (strncmp((const char*)chunk_type, "tRNS", 4) == 0) {
-            png->has_transparency_key = true;
-            if (png->color_type == 0) {
-                png->transparency_key.r = png->transparency_key.g = png->transparency_key.b = ntohs_manual(*(uint16_t*)chunk_data);
-            } else if (png->color_type == 2) {
-                png->transparency_key.r = ntohs_manual(*(uint16_t*)(chunk_data));
-                png->transparency_key.g = ntohs_manual(*(uint16_t*)(chunk_data + 2));
-                png->transparency_key.b = ntohs_manual(*(uint16_t*)(chunk_data + 4));
-            } else if (png->color_type == 3 && png->palette) {
-                png->has_transparency_key = false;
-                for (unsigned int i=0; i < chunk_length && i < png->palette_size; ++i) png->palette[i].a = chunk_data[i];
-            }
-        } else if (strncmp((const char*)chunk_type, "IDAT", 4) == 0) {
-            compressed_data = realloc(compressed_data, compressed_size + chunk_length);
-            memcpy(compressed_data + compressed_size, chunk_data, chunk_length);
-            compressed_size += chunk_length;
-        } else if (strncmp((const char*)chunk_type, "IEND", 4) == 0) { break; }
-        current_ptr += 12 + chunk_length;
-    }
-    size_t source_bpp_calc = (png->color_type==2)?3:(png->color_type==6)?4:(png->color_type==4)?2:1;
-    size_t uncompressed_size = png->height * (1 + (png->width * png->bit_depth * source_bpp_calc + 7) / 8);
-    unsigned char* uncompressed_data = malloc(uncompressed_size * 2);
-    uLongf dest_len = uncompressed_size * 2;
-    uncompress(uncompressed_data, &dest_len, compressed_data, compressed_size);
-    free(compressed_data);
-    png->final_pixel_size = png->width * png->height * png->bytes_per_pixel;
-    png->final_pixel_data = calloc(1, png->final_pixel_size);
-    if (!png->final_pixel_data) {
-        return NULL;
-    }
-    if (png->interlace_method == 0) {
-        size_t stride = (png->width * png->bit_depth * source_bpp_calc + 7) / 8;
-        unsigned char* unfiltered_data = malloc(png->height * stride);
-        unfilter_pass(png, uncompressed_data, unfiltered_data, png->width, png->height);
-        place_pixels(png, unfiltered_data, -1, png->width, png->height);
-        free(unfiltered_data);
-    } else {
-        const unsigned char* data_ptr = uncompressed_data;
-        for (int i=0; i<7; i++) {
-            uint32_t pass_w = (png->width - adam7_start_x[i] + adam7_step_x[i] - 1) / adam7_step_x[i];
-            uint32_t pass_h = (png->height - adam7_start_y[i] + adam7_step_y[i] - 1) / adam7_step_y[i];
-            if (pass_w==0||pass_h==0) continue;
-            size_t pass_stride = (pass_w * png->bit_depth * source_bpp_calc + 7) / 8;
-            unsigned char* unfiltered_pass = malloc(pass_h * pass_stride);
-            unfilter_pass(png, data_ptr, unfiltered_pass, pass_w, pass_h);
-            place_pixels(png, unfiltered_pass, i, pass_w, pass_h);
-            data_ptr += pass_h * (1 + pass_stride);
-            free(unfiltered_pass);
-        }
-    }
-    free(uncompressed_data);
-    return png;
-}
-
-size_t
-fweight(FILE *fptr)
-{
-    long fsize;
-    fseek(fptr, 0, SEEK_END);
-    fsize = ftell(fptr);
-    rewind(fptr);
-    if (fsize < 0) {
-        return 0;
-    }
-    return (size_t)fsize;
-}
-
-unsigned char *
-_fread(FILE *fptr, size_t fsize)
-{
-    unsigned char *buffer;
-    size_t buffer_size;
-    buffer = malloc(fsize);
-    if (!buffer) {
-        return NULL;
-    }
-    buffer_size = fread(buffer, 1, fsize, fptr);
-    if (buffer_size != fsize) {
-        free(buffer);
-        return NULL;
-    }
-    fclose(fptr);
-    return buffer;
-}
-
-PngImage*
-png_load_from_file(const char *fname)
-{
-    FILE *fptr;
-    size_t fsize;
-    unsigned char *buffer;
-
-    PngImage* img;
-
-    fptr = fopen(fname, "rb");
-    if (!fptr) {
-        return NULL;
-    }
-    fsize = fweight(fptr);
-    if (!fsize) {
-        fclose(fptr);
-        return NULL;
-    }
-    buffer = _fread(fptr, fsize);
-    if (!buffer) {
-        fclose(fptr);
-        return NULL;
-    }
-
-    img = png_load_from_data(buffer, fsize);
-    return img;
-}
-
-static void place_pixels(PngImage* png, const unsigned char* pass_pixels, int pass_index, uint32_t pass_width, uint32_t pass_height) 
-{
-    size_t source_bpp = (png->bit_depth < 8) ? 1 : (png->bit_depth / 8) * ((png->color_type==2)?3:(png->color_type==6)?4:(png->color_type==4)?2:1);
-    const float gamma = 2.2f;
-    const float inverse_gamma = 1.0f / gamma;
-    const float bg_r_gamma = 1.0f;
-    const float bg_g_gamma = 1.0f;
-    const float bg_b_gamma = 1.0f;
-    const float bg_r_linear = powf(bg_r_gamma, gamma);
-    const float bg_g_linear = powf(bg_g_gamma, gamma);
-    const float bg_b_linear = powf(bg_b_gamma, gamma);
-    for (uint32_t py = 0; py < pass_height; py++) {
-        for (uint32_t px = 0; px < pass_width; px++) {
-            uint32_t final_x, final_y;
-            if (pass_index == -1) { final_x = px; final_y = py; }
-            else { final_x = px * adam7_step_x[pass_index] + adam7_start_x[pass_index]; final_y = py * adam7_step_y[pass_index] + adam7_start_y[pass_index]; }
-            if (final_x >= png->width || final_y >= png->height) continue;
-            unsigned char* out_pixel = png->final_pixel_data + (final_y * png->width + final_x) * png->bytes_per_pixel;
-            uint8_t r = 0, g = 0, b = 0, a = 255;
-            switch (png->color_type) {
-                case 3: {
-                    uint16_t index = get_pixel_value_at(pass_pixels, px, py, pass_width, png->bit_depth);
-                    if (index < png->palette_size) {
-                        r = png->palette[index].r; g = png->palette[index].g; b = png->palette[index].b; a = png->palette[index].a;
-                    }
-                    break;
-                }
-                case 0: {
-                    uint16_t gray_val = get_pixel_value_at(pass_pixels, px, py, pass_width * source_bpp, png->bit_depth);
-                    if (png->has_transparency_key && gray_val == png->transparency_key.r) { a = 0; }
-                    r = g = b = (png->bit_depth == 16) ? (gray_val >> 8) : (gray_val * (255.0f / ((1 << png->bit_depth) - 1)));
-                    break;
-                }
-                case 4: {
-                    if (png->bit_depth == 16) {
-                        const uint16_t* in16 = (const uint16_t*)(pass_pixels + (py * pass_width + px) * source_bpp);
-                        r = g = b = ntohs_manual(in16[0]) >> 8; a = ntohs_manual(in16[1]) >> 8;
-                    } else {
-                        const uint8_t* in8 = pass_pixels + (py * pass_width + px) * source_bpp;
-                        r = g = b = in8[0]; a = in8[1];
-                    }
-                    break;
-                }
-                case 2: {
-                    if (png->bit_depth == 16) {
-                        const uint16_t* in16 = (const uint16_t*)(pass_pixels + (py * pass_width + px) * source_bpp);
-                        uint16_t r16 = ntohs_manual(in16[0]), g16 = ntohs_manual(in16[1]), b16 = ntohs_manual(in16[2]);
-                        if (png->has_transparency_key && r16 == png->transparency_key.r && g16 == png->transparency_key.g && b16 == png->transparency_key.b) { a = 0; }
-                        r = r16 >> 8; g = g16 >> 8; b = b16 >> 8;
-                    } else {
-                        const uint8_t* in8 = pass_pixels + (py * pass_width + px) * source_bpp;
-                        r = in8[0]; g = in8[1]; b = in8[2];
-                    }
-                    break;
-                }
-                case 6: {
-                    if (png->bit_depth == 16) {
-                        const uint16_t* in16 = (const uint16_t*)(pass_pixels + (py * pass_width + px) * source_bpp);
-                        r = ntohs_manual(in16[0]) >> 8; g = ntohs_manual(in16[1]) >> 8; b = ntohs_manual(in16[2]) >> 8; a = ntohs_manual(in16[3]) >> 8;
-                    } else {
-                        const uint8_t* in8 = pass_pixels + (py * pass_width + px) * source_bpp;
-                        r = in8[0]; g = in8[1]; b = in8[2]; a = in8[3];
-                    }
-                    break;
-                }
-            }
-            const float fg_r_gamma = r / 255.0f;
-            const float fg_g_gamma = g / 255.0f;
-            const float fg_b_gamma = b / 255.0f;
-            const float alpha_f = a / 255.0f;
-            const float fg_r_linear = powf(fg_r_gamma, gamma);
-            const float fg_g_linear = powf(fg_g_gamma, gamma);
-            const float fg_b_linear = powf(fg_b_gamma, gamma);
-            const float out_r_linear = fg_r_linear * alpha_f + bg_r_linear * (1.0f - alpha_f);
-            const float out_g_linear = fg_g_linear * alpha_f + bg_g_linear * (1.0f - alpha_f);
-            const float out_b_linear = fg_b_linear * alpha_f + bg_b_linear * (1.0f - alpha_f);
-            out_pixel[0] = (uint8_t)(powf(out_r_linear, inverse_gamma) * 255.0f);
-            out_pixel[1] = (uint8_t)(powf(out_g_linear, inverse_gamma) * 255.0f);
-            out_pixel[2] = (uint8_t)(powf(out_b_linear, inverse_gamma) * 255.0f);
-        }
-    }
-}
-
-static uint16_t get_pixel_value_at(const unsigned char* data, uint32_t x, uint32_t y, uint32_t pass_width, uint8_t bit_depth) {
-    if (bit_depth >= 8) {
-        size_t bpp = (bit_depth == 8) ? 1 : 2;
-        if (bpp == 1) return data[y * pass_width + x];
-        else { const uint16_t* data16 = (const uint16_t*)data; return ntohs_manual(data16[y * pass_width + x]); }
-    }
-    size_t bit_pos = (y * pass_width + x) * bit_depth;
-    size_t byte_pos = bit_pos / 8;
-    int bit_in_byte = 7 - (bit_pos % 8);
-    int shift_amount = bit_in_byte - bit_depth + 1;
-    return (data[byte_pos] >> shift_amount) & ((1 << bit_depth) - 1);
-}
-static size_t get_source_bytes_per_pixel(uint8_t color_type, uint8_t bit_depth) { if (bit_depth < 8) return 1; size_t bytes = bit_depth / 8; switch(color_type){ case 2: return bytes * 3; case 4: return bytes * 2; case 6: return bytes * 4; default: return bytes; }}
-static int unfilter_pass(const PngImage* png, const unsigned char* src, unsigned char* dst, uint32_t pass_width, uint32_t pass_height) {
-    size_t stride = (pass_width * png->bit_depth * get_source_bytes_per_pixel(png->color_type, 8) + 7) / 8;
-    if (stride == 0) return 0;
-    size_t filter_bpp = get_source_bytes_per_pixel(png->color_type, png->bit_depth);
-    for (uint32_t y = 0; y < pass_height; y++) {
-        uint8_t filter_type = *src++;
-        const unsigned char* prev_line = (y == 0) ? NULL : (dst - stride);
-        for (uint32_t x = 0; x < stride; x++) {
-            uint8_t raw = src[x];
-            uint8_t left = (x >= filter_bpp) ? dst[x - filter_bpp] : 0;
-            uint8_t up = (prev_line != NULL) ? prev_line[x] : 0;
-            uint8_t up_left = (prev_line != NULL && x >= filter_bpp) ? prev_line[x - filter_bpp] : 0;
-            switch (filter_type) {
-                case 0: dst[x] = raw; break; case 1: dst[x] = raw + left; break; case 2: dst[x] = raw + up; break;
-                case 3: dst[x] = raw + ((left + up) / 2); break;
-                case 4: { int p = left + up - up_left; int pa = abs(p - left), pb = abs(p - up), pc = abs(p - up_left); dst[x] = raw + ((pa <= pb && pa <= pc) ? left : (pb <= pc ? up : up_left)); break; }
-                default: return -1;
-            }
-        }
-        src += stride; dst += stride;
-    }
-    return 0;
-}
-static uint32_t ntohl_manual(uint32_t n) { unsigned char *p = (unsigned char *)&n; return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3]; }
-static uint16_t ntohs_manual(uint16_t n) { unsigned char *p = (unsigned char *)&n; return ((uint16_t)p[0] << 8) | p[1]; }
\ No newline at end of file
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <zlib.h>
+#include <pthread.h>
+#include <time.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "../headers/png.h" 
+#include "../headers/png_convert.h"
+#include "../headers/png_unfilter.h"
+#include "../headers/png_inflate.h"
+#include "../headers/logger.h"
+
+const int adam7_start_x[] = {0, 4, 0, 2, 0, 1, 0}; const int adam7_start_y[] = {0, 0, 4, 0, 2, 0, 1};
+const int adam7_step_x[]  = {8, 8, 4, 4, 2, 2, 1}; const int adam7_step_y[]  = {8, 8, 8, 4, 4, 2, 2};
+#define PNG_STREAM_BLOCK_SIZE (64 * 1024)
+#define PNG_MAX_DECODE_THREADS 256
+#define PNG_PARALLEL_MIN_PIXELS (256 * 1024)
+#define PNG_PROBE_READ_SIZE 4096
+#define PNG_PIPELINE_SLOTS 8
+#define PNG_PIPELINE_SLOT_BYTES (256 * 1024)
+#define PNG_PIPELINE_ABORTED (-2)
+#define PNG_RESIZE_MAX_SIDE (1u << 20)
+#define PNG_RESAMPLE_BITS 14
+static int unfilter_pass(const PngImage* png, const unsigned char* src, unsigned char* dst, uint32_t pass_width, uint32_t pass_height, uint64_t* filter_rows);
+static void place_pixels(PngImage* png, const PngConverter* conv, const unsigned char* pass_pixels, int pass_index, uint32_t pass_width, uint32_t pass_height, uint32_t y_begin, uint32_t y_end);
+static int parse_header_chunk(PngImage* png, RGBA* palette_storage, const unsigned char* chunk_type, const unsigned char* chunk_data, uint32_t chunk_length);
+static size_t get_source_bytes_per_pixel(uint8_t color_type, uint8_t bit_depth);
+static size_t row_stride(const PngImage* png, uint32_t width);
+static unsigned char* row_pointer(const PngImage* png, uint32_t y);
+static uint32_t read_be32(const unsigned char* p); static uint16_t read_be16(const unsigned char* p);
+
+static double monotonic_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void stats_record_peak(PngStats* stats, uint64_t bytes) {
+    if (bytes > stats->peak_buffer_bytes) stats->peak_buffer_bytes = bytes;
+}
+
+static void stats_record_passes(PngStats* stats, const PngImage* png) {
+    stats->pass_count = png->interlace_method == 0 ? 0 : 7;
+    for (int i = 0; i < 7; i++) {
+        stats->pass_width[i] = png->interlace_method == 0 || png->width <= (uint32_t)adam7_start_x[i] ? 0 : (png->width - adam7_start_x[i] + adam7_step_x[i] - 1) / adam7_step_x[i];
+        stats->pass_height[i] = png->interlace_method == 0 || png->height <= (uint32_t)adam7_start_y[i] ? 0 : (png->height - adam7_start_y[i] + adam7_step_y[i] - 1) / adam7_step_y[i];
+    }
+}
+
+typedef struct PngChunk {
+    uint32_t length;
+    const unsigned char* type;
+    const unsigned char* data;
+} PngChunk;
+
+typedef struct PngChunkIterator {
+    const unsigned char* cursor;
+    const unsigned char* end;
+    PngStats* stats;
+} PngChunkIterator;
+
+typedef struct PngInflater {
+    z_stream* zs;
+    unsigned char* out;
+    size_t out_size, produced;
+    bool finished;
+} PngInflater;
+
+/* Parcourt les chunks directement dans le tampon d'entrée, sans copie. Retourne 1, 0 en fin de données, -1 si corrompu. */
+static int chunk_next(PngChunkIterator* it, PngChunk* chunk) {
+    size_t left = (size_t)(it->end - it->cursor);
+    if (left == 0) return 0;
+    if (left < 12) return -1;
+    chunk->length = read_be32(it->cursor);
+    chunk->type = it->cursor + 4;
+    chunk->data = it->cursor + 8;
+    if (chunk->length > left - 12) return -1;
+    uint32_t stored_crc = read_be32(chunk->data + chunk->length);
+    double crc_start = it->stats ? monotonic_seconds() : 0.0;
+    bool crc_ok = crc32(crc32(0L, chunk->type, 4), chunk->data, chunk->length) == stored_crc;
+    if (it->stats) { it->stats->crc_seconds += monotonic_seconds() - crc_start; it->stats->chunks++; }
+    if (!crc_ok) return -1;
+    it->cursor += 12 + (size_t)chunk->length;
+    return 1;
+}
+
+/* Taille exacte des données filtrées des passes Adam7 0 à passes - 1 (octet de filtre inclus). */
+static size_t raw_image_size(const PngImage* png, int passes) {
+    if (png->width == 0 || png->height == 0 || png->bit_depth == 0) return 0;
+    if (png->interlace_method == 0) return (size_t)png->height * (1 + row_stride(png, png->width));
+    size_t total = 0;
+    for (int i = 0; i < passes; i++) {
+        uint32_t pass_w = (png->width - adam7_start_x[i] + adam7_step_x[i] - 1) / adam7_step_x[i];
+        uint32_t pass_h = (png->height - adam7_start_y[i] + adam7_step_y[i] - 1) / adam7_step_y[i];
+        if (pass_w == 0 || pass_h == 0) continue;
+        total += (size_t)pass_h * (1 + row_stride(png, pass_w));
+    }
+    return total;
+}
+
+static void inflater_init(PngInflater* inf, z_stream* zs, unsigned char* out, size_t out_size) {
+    memset(inf, 0, sizeof(*inf));
+    inf->zs = zs;
+    inf->out = out;
+    inf->out_size = out_size;
+}
+
+/* Décompresse un IDAT en place, le flux zlib pouvant être coupé n'importe où entre deux chunks. */
+static int inflater_feed(PngInflater* inf, const unsigned char* in, uint32_t in_len) {
+    inf->zs->next_in = (Bytef*)in;
+    inf->zs->avail_in = in_len;
+    while (!inf->finished && inf->zs->avail_in > 0 && inf->produced < inf->out_size) {
+        size_t room = inf->out_size - inf->produced;
+        inf->zs->next_out = inf->out + inf->produced;
+        inf->zs->avail_out = room > UINT32_MAX ? UINT32_MAX : (uInt)room;
+        uInt before = inf->zs->avail_out;
+        int ret = inflate(inf->zs, Z_NO_FLUSH);
+        inf->produced += before - inf->zs->avail_out;
+        if (ret == Z_STREAM_END) inf->finished = true;
+        else if (ret != Z_OK) return -1;
+    }
+    return 0;
+}
+
+#define PNG_ARENA_ALIGN 64
+
+typedef struct PngArenaBlock {
+    struct PngArenaBlock* next;
+} PngArenaBlock;
+
+/* Allocateur par blocs : tout est rendu d'un coup par arena_reset. Quand un décodage a débordé du bloc
+   principal, celui-ci est réalloué à la taille totale demandée, si bien que les décodages suivants de même
+   taille ne font plus aucune allocation (ni défaut de page sur une zone fraîchement projetée). */
+typedef struct PngArena {
+    unsigned char* base;
+    size_t capacity, used, overflow_size;
+    PngArenaBlock* overflow;
+} PngArena;
+
+struct PngDecoder {
+    PngArena arena;
+    z_stream zs;
+    bool zs_ready;
+    RGBA palette[256];
+    RGBA index_colors[256];
+    PngCompositorCache compositor_cache;
+    char error[128];
+};
+
+/* Flux zlib complet pour le moteur intégré : le premier IDAT est utilisé en place, les suivants sont recopiés
+   derrière lui dans un tampon dimensionné sur le reste du fichier. */
+typedef struct PngIdatData {
+    const unsigned char* data;
+    size_t size;
+    unsigned char* buffer;
+} PngIdatData;
+
+static void* arena_alloc(PngArena* arena, size_t size) {
+    size = (size + PNG_ARENA_ALIGN - 1) & ~(size_t)(PNG_ARENA_ALIGN - 1);
+    if (arena->base && size <= arena->capacity - arena->used) {
+        void* p = arena->base + arena->used;
+        arena->used += size;
+        return p;
+    }
+    PngArenaBlock* block = malloc(PNG_ARENA_ALIGN + size);
+    if (!block) return NULL;
+    block->next = arena->overflow;
+    arena->overflow = block;
+    arena->overflow_size += size;
+    return (unsigned char*)block + PNG_ARENA_ALIGN;
+}
+
+static void arena_free_overflow(PngArena* arena) {
+    while (arena->overflow) {
+        PngArenaBlock* next = arena->overflow->next;
+        free(arena->overflow);
+        arena->overflow = next;
+    }
+    arena->overflow_size = 0;
+}
+
+static void arena_reset(PngArena* arena) {
+    if (arena->overflow) {
+        size_t capacity = arena->used + arena->overflow_size;
+        arena_free_overflow(arena);
+        free(arena->base);
+        arena->base = malloc(capacity);
+        arena->capacity = arena->base ? capacity : 0;
+    }
+    arena->used = 0;
+}
+
+static void arena_release(PngArena* arena) {
+    arena_free_overflow(arena);
+    free(arena->base);
+    memset(arena, 0, sizeof(*arena));
+}
+
+/* Garde le premier motif d'échec d'un décodage ; message NULL : motif générique s'il n'y en a pas encore. */
+static int decoder_fail(PngDecoder* dec, const char* format, ...) {
+    if (dec->error[0] != '\0') return -1;
+    if (!format) format = "données PNG invalides";
+    va_list args;
+    va_start(args, format);
+    vsnprintf(dec->error, sizeof(dec->error), format, args);
+    va_end(args);
+    return -1;
+}
+
+static int idat_append(PngIdatData* idat, PngArena* arena, const PngChunk* chunk, size_t bytes_left) {
+    if (!idat->data) {
+        idat->data = chunk->data;
+        idat->size = chunk->length;
+        return 0;
+    }
+    if (!idat->buffer) {
+        idat->buffer = arena_alloc(arena, idat->size + bytes_left);
+        if (!idat->buffer) return -1;
+        memcpy(idat->buffer, idat->data, idat->size);
+        idat->data = idat->buffer;
+    }
+    memcpy(idat->buffer + idat->size, chunk->data, chunk->length);
+    idat->size += chunk->length;
+    return 0;
+}
+
+/* Le z_stream est initialisé une fois puis simplement réarmé : son état et sa fenêtre sont réutilisés. */
+static z_stream* decoder_inflate_stream(PngDecoder* dec) {
+    if (dec->zs_ready) return inflateReset(&dec->zs) == Z_OK ? &dec->zs : NULL;
+    memset(&dec->zs, 0, sizeof(dec->zs));
+    if (inflateInit(&dec->zs) != Z_OK) return NULL;
+    dec->zs_ready = true;
+    return &dec->zs;
+}
+
+typedef struct PngParallel {
+    pthread_mutex_t lock;
+    int next, count;
+    void (*task)(void* ctx, int index);
+    void* ctx;
+} PngParallel;
+
+typedef struct PngPassPlan {
+    int adam7_index;
+    uint32_t width, height;
+    const unsigned char* raw;
+    unsigned char* pixels;
+    uint64_t filter_rows[PNG_FILTER_TYPES];
+    int status;
+} PngPassPlan;
+
+typedef struct PngPixelJob {
+    PngImage* png;
+    const PngConverter* conv;
+    PngPassPlan passes[7];
+    int pass_count;
+    uint32_t band_rows;
+} PngPixelJob;
+
+static void* parallel_worker(void* arg) {
+    PngParallel* par = arg;
+    for (;;) {
+        pthread_mutex_lock(&par->lock);
+        int index = par->next < par->count ? par->next++ : -1;
+        pthread_mutex_unlock(&par->lock);
+        if (index < 0) break;
+        par->task(par->ctx, index);
+    }
+    return NULL;
+}
+
+/* Exécute count tâches sur au plus threads threads, le thread appelant compris. */
+static void parallel_run(int threads, int count, void (*task)(void* ctx, int index), void* ctx) {
+    if (threads > count) threads = count;
+    if (threads <= 1) {
+        for (int i = 0; i < count; i++) task(ctx, i);
+        return;
+    }
+    PngParallel par;
+    pthread_t helpers[PNG_MAX_DECODE_THREADS];
+    int started = 0;
+    pthread_mutex_init(&par.lock, NULL);
+    par.next = 0; par.count = count; par.task = task; par.ctx = ctx;
+    while (started < threads - 1 && pthread_create(&helpers[started], NULL, parallel_worker, &par) == 0) started++;
+    parallel_worker(&par);
+    for (int i = 0; i < started; i++) pthread_join(helpers[i], NULL);
+    pthread_mutex_destroy(&par.lock);
+}
+
+/* Les passes Adam7 sont indépendantes : la plus grande (la dernière) est prise en premier. */
+static void unfilter_task(void* ctx, int index) {
+    PngPixelJob* job = ctx;
+    PngPassPlan* pass = &job->passes[job->pass_count - 1 - index];
+    pass->status = unfilter_pass(job->png, pass->raw, pass->pixels, pass->width, pass->height, pass->filter_rows);
+}
+
+/* Chaque bande de lignes de sortie reçoit les pixels de toutes les passes : les écritures sont disjointes. */
+static void place_task(void* ctx, int band) {
+    PngPixelJob* job = ctx;
+    uint32_t y_begin = (uint32_t)band * job->band_rows;
+    uint32_t y_end = y_begin + job->band_rows < job->png->height ? y_begin + job->band_rows : job->png->height;
+    for (int i = 0; i < job->pass_count; i++) {
+        const PngPassPlan* pass = &job->passes[i];
+        place_pixels(job->png, job->conv, pass->pixels, pass->adam7_index, pass->width, pass->height, y_begin, y_end);
+    }
+    size_t used = ((size_t)job->png->width * job->png->bits_per_pixel + 7) / 8;
+    if (job->png->row_size > used) {
+        for (uint32_t y = y_begin; y < y_end; y++) memset(row_pointer(job->png, y) + used, 0, job->png->row_size - used);
+    }
+}
+
+static int decode_pixels(PngImage* png, const PngConverter* conv, const unsigned char* raw, int threads, PngArena* arena, PngStats* stats) {
+    PngPixelJob job;
+    size_t unfiltered_size = 0, raw_size = 0;
+    memset(&job, 0, sizeof(job));
+    job.png = png;
+    job.conv = conv;
+    for (int i = 0; i < 7; i++) {
+        PngPassPlan* pass = &job.passes[job.pass_count];
+        pass->adam7_index = png->interlace_method == 0 ? -1 : i;
+        pass->width = png->interlace_method == 0 ? png->width : (png->width - adam7_start_x[i] + adam7_step_x[i] - 1) / adam7_step_x[i];
+        pass->height = png->interlace_method == 0 ? png->height : (png->height - adam7_start_y[i] + adam7_step_y[i] - 1) / adam7_step_y[i];
+        if (pass->width != 0 && pass->height != 0) {
+            pass->raw = raw;
+            raw += (size_t)pass->height * (1 + row_stride(png, pass->width));
+            raw_size += (size_t)pass->height * (1 + row_stride(png, pass->width));
+            unfiltered_size += (size_t)pass->height * row_stride(png, pass->width);
+            job.pass_count++;
+        }
+        if (png->interlace_method == 0) break;
+    }
+    unsigned char* unfiltered = arena_alloc(arena, unfiltered_size);
+    if (!unfiltered) return -1;
+    size_t offset = 0;
+    for (int i = 0; i < job.pass_count; i++) {
+        job.passes[i].pixels = unfiltered + offset;
+        offset += (size_t)job.passes[i].height * row_stride(png, job.passes[i].width);
+    }
+    if (threads > PNG_MAX_DECODE_THREADS) threads = PNG_MAX_DECODE_THREADS;
+    if ((uint64_t)png->width * png->height < PNG_PARALLEL_MIN_PIXELS) threads = 1;
+    double start = stats ? monotonic_seconds() : 0.0;
+    parallel_run(threads, job.pass_count, unfilter_task, &job);
+    if (stats) { double now = monotonic_seconds(); stats->unfilter_seconds += now - start; start = now; }
+    int status = 0;
+    for (int i = 0; i < job.pass_count; i++) if (job.passes[i].status != 0) status = -1;
+    if (stats) {
+        for (int i = 0; i < job.pass_count; i++) {
+            for (int f = 0; f < PNG_FILTER_TYPES; f++) stats->filter_rows[f] += job.passes[i].filter_rows[f];
+        }
+        stats_record_passes(stats, png);
+        stats_record_peak(stats, raw_size + unfiltered_size + png->final_pixel_size);
+    }
+    if (status == 0) {
+        int bands = threads > 1 ? threads : 1;
+        job.band_rows = (png->height + bands - 1) / bands;
+        bands = (int)((png->height + job.band_rows - 1) / job.band_rows);
+        parallel_run(threads, bands, place_task, &job);
+        if (stats) stats->place_seconds += monotonic_seconds() - start;
+    }
+    return status;
+}
+
+/* Lots de lignes entre deux étages du décodage en pipeline. Les lots sont produits et pris dans l'ordre ; avec
+   plusieurs threads de conversion ils sont rendus dans le désordre et released n'avance que sur des lots rendus
+   contigus. Un emplacement n'est réécrit qu'une fois son lot rendu. */
+typedef struct PngRing {
+    unsigned char* slots;
+    size_t slot_size;
+    uint32_t produced, taken, released;
+    bool done[PNG_PIPELINE_SLOTS];
+} PngRing;
+
+/* Image non entrelacée décodée par trois étages simultanés : le thread appelant décompresse les IDAT au fil du
+   parcours des chunks dans l'anneau raw, un thread défiltre les lots dans l'anneau rows, les autres convertissent
+   les lots défiltrés vers les pixels de sortie. Mémoire de travail bornée par les deux anneaux. */
+typedef struct PngPipeline {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    PngImage* png;
+    const PngConverter* conv;
+    PngRing raw, rows;
+    size_t stride;
+    uint32_t batch_rows, batch_count;
+    bool failed;
+    z_stream* zs;
+    unsigned char* slot;
+    size_t slot_fill, slot_bytes, inflated;
+    bool inflate_finished;
+    pthread_t threads[PNG_MAX_DECODE_THREADS];
+    int thread_count;
+    uint64_t filter_rows[PNG_FILTER_TYPES];
+    double unfilter_seconds, place_seconds;
+    bool timed;
+} PngPipeline;
+
+static uint32_t pipeline_batch_height(const PngPipeline* pl, uint32_t batch) {
+    uint32_t first = batch * pl->batch_rows;
+    return pl->png->height - first < pl->batch_rows ? pl->png->height - first : pl->batch_rows;
+}
+
+static void pipeline_abort(PngPipeline* pl) {
+    pthread_mutex_lock(&pl->lock);
+    pl->failed = true;
+    pthread_cond_broadcast(&pl->changed);
+    pthread_mutex_unlock(&pl->lock);
+}
+
+/* Emplacement du prochain lot produit, une fois rendu ; NULL si le décodage a échoué. */
+static unsigned char* ring_acquire(PngPipeline* pl, PngRing* ring) {
+    pthread_mutex_lock(&pl->lock);
+    while (!pl->failed && ring->produced - ring->released >= PNG_PIPELINE_SLOTS) pthread_cond_wait(&pl->changed, &pl->lock);
+    unsigned char* slot = pl->failed ? NULL : ring->slots + (size_t)(ring->produced % PNG_PIPELINE_SLOTS) * ring->slot_size;
+    pthread_mutex_unlock(&pl->lock);
+    return slot;
+}
+
+static void ring_publish(PngPipeline* pl, PngRing* ring) {
+    pthread_mutex_lock(&pl->lock);
+    ring->produced++;
+    pthread_cond_broadcast(&pl->changed);
+    pthread_mutex_unlock(&pl->lock);
+}
+
+/* Prochain lot à consommer ; NULL après le dernier ou en cas d'échec. */
+static unsigned char* ring_take(PngPipeline* pl, PngRing* ring, uint32_t* batch) {
+    pthread_mutex_lock(&pl->lock);
+    while (!pl->failed && ring->taken < pl->batch_count && ring->taken == ring->produced) pthread_cond_wait(&pl->changed, &pl->lock);
+    unsigned char* slot = NULL;
+    if (!pl->failed && ring->taken < pl->batch_count) {
+        *batch = ring->taken++;
+        slot = ring->slots + (size_t)(*batch % PNG_PIPELINE_SLOTS) * ring->slot_size;
+    }
+    pthread_mutex_unlock(&pl->lock);
+    return slot;
+}
+
+static void ring_release(PngPipeline* pl, PngRing* ring, uint32_t batch) {
+    pthread_mutex_lock(&pl->lock);
+    ring->done[batch % PNG_PIPELINE_SLOTS] = true;
+    while (ring->released < ring->produced && ring->done[ring->released % PNG_PIPELINE_SLOTS]) {
+        ring->done[ring->released % PNG_PIPELINE_SLOTS] = false;
+        ring->released++;
+    }
+    pthread_cond_broadcast(&pl->changed);
+    pthread_mutex_unlock(&pl->lock);
+}
+
+static void* pipeline_unfilter(void* arg) {
+    PngPipeline* pl = arg;
+    const size_t stride = pl->stride;
+    const size_t filter_bpp = get_source_bytes_per_pixel(pl->png->color_type, pl->png->bit_depth);
+    /* Dernière ligne du lot précédent : son emplacement peut déjà être réécrit. */
+    unsigned char* prev = malloc(stride);
+    uint32_t batch;
+    unsigned char* raw;
+    if (!prev) { pipeline_abort(pl); return NULL; }
+    while ((raw = ring_take(pl, &pl->raw, &batch)) != NULL) {
+        unsigned char* out = ring_acquire(pl, &pl->rows);
+        if (!out) break;
+        double start = pl->timed ? monotonic_seconds() : 0.0;
+        const uint32_t rows = pipeline_batch_height(pl, batch);
+        int status = 0;
+        for (uint32_t r = 0; status == 0 && r < rows; r++) {
+            const unsigned char* line = raw + (size_t)r * (1 + stride);
+            const unsigned char* prev_line = r ? out + (size_t)(r - 1) * stride : batch ? prev : NULL;
+            if (line[0] < PNG_FILTER_TYPES) pl->filter_rows[line[0]]++;
+            status = png_unfilter_row(line[0], line + 1, out + (size_t)r * stride, prev_line, stride, filter_bpp);
+        }
+        memcpy(prev, out + (size_t)(rows - 1) * stride, stride);
+        if (pl->timed) pl->unfilter_seconds += monotonic_seconds() - start;
+        ring_release(pl, &pl->raw, batch);
+        if (status != 0) { pipeline_abort(pl); break; }
+        ring_publish(pl, &pl->rows);
+    }
+    free(prev);
+    return NULL;
+}
+
+static void* pipeline_convert(void* arg) {
+    PngPipeline* pl = arg;
+    PngImage* png = pl->png;
+    const size_t used = ((size_t)png->width * png->bits_per_pixel + 7) / 8;
+    double seconds = 0.0;
+    uint32_t batch;
+    unsigned char* rows;
+    while ((rows = ring_take(pl, &pl->rows, &batch)) != NULL) {
+        double start = pl->timed ? monotonic_seconds() : 0.0;
+        const uint32_t first = batch * pl->batch_rows, count = pipeline_batch_height(pl, batch);
+        for (uint32_t r = 0; r < count; r++) {
+            unsigned char* out = row_pointer(png, first + r);
+            pl->conv->convert(pl->conv, rows + (size_t)r * pl->stride, png->width, out, png->bytes_per_pixel);
+            if (png->row_size > used) memset(out + used, 0, png->row_size - used);
+        }
+        if (pl->timed) seconds += monotonic_seconds() - start;
+        ring_release(pl, &pl->rows, batch);
+    }
+    pthread_mutex_lock(&pl->lock);
+    pl->place_seconds += seconds;
+    pthread_mutex_unlock(&pl->lock);
+    return NULL;
+}
+
+static int pipeline_start(PngPipeline* pl, PngImage* png, const PngConverter* conv, z_stream* zs, int threads, PngArena* arena, bool timed) {
+    memset(pl, 0, sizeof(*pl));
+    pl->png = png;
+    pl->conv = conv;
+    pl->zs = zs;
+    pl->timed = timed;
+    pl->stride = row_stride(png, png->width);
+    pl->batch_rows = (uint32_t)(PNG_PIPELINE_SLOT_BYTES / (1 + pl->stride));
+    if (pl->batch_rows == 0) pl->batch_rows = 1;
+    if (pl->batch_rows > png->height) pl->batch_rows = png->height;
+    pl->batch_count = (png->height + pl->batch_rows - 1) / pl->batch_rows;
+    pl->raw.slot_size = (size_t)pl->batch_rows * (1 + pl->stride);
+    pl->rows.slot_size = (size_t)pl->batch_rows * pl->stride;
+    pl->raw.slots = arena_alloc(arena, pl->raw.slot_size * PNG_PIPELINE_SLOTS);
+    pl->rows.slots = arena_alloc(arena, pl->rows.slot_size * PNG_PIPELINE_SLOTS);
+    if (!pl->raw.slots || !pl->rows.slots) return -1;
+    pthread_mutex_init(&pl->lock, NULL);
+    pthread_cond_init(&pl->changed, NULL);
+    if (threads > PNG_MAX_DECODE_THREADS) threads = PNG_MAX_DECODE_THREADS;
+    if (pthread_create(&pl->threads[pl->thread_count], NULL, pipeline_unfilter, pl) == 0) pl->thread_count++;
+    while (pl->thread_count > 0 && pl->thread_count < threads - 1 && pthread_create(&pl->threads[pl->thread_count], NULL, pipeline_convert, pl) == 0) pl->thread_count++;
+    if (pl->thread_count < 2) {
+        pipeline_abort(pl);
+        for (int i = 0; i < pl->thread_count; i++) pthread_join(pl->threads[i], NULL);
+        pthread_cond_destroy(&pl->changed);
+        pthread_mutex_destroy(&pl->lock);
+        return -1;
+    }
+    return 0;
+}
+
+/* Décompresse un IDAT lot par lot dans l'anneau raw ; les données au-delà de l'image sont ignorées.
+   PNG_PIPELINE_ABORTED : le défiltrage a échoué. */
+static int pipeline_inflate(PngPipeline* pl, const unsigned char* in, uint32_t in_len) {
+    z_stream* zs = pl->zs;
+    zs->next_in = (Bytef*)in;
+    zs->avail_in = in_len;
+    while (!pl->inflate_finished && zs->avail_in > 0) {
+        if (!pl->slot) {
+            if (pl->raw.produced == pl->batch_count) break;
+            pl->slot = ring_acquire(pl, &pl->raw);
+            if (!pl->slot) return PNG_PIPELINE_ABORTED;
+            pl->slot_fill = 0;
+            pl->slot_bytes = (size_t)pipeline_batch_height(pl, pl->raw.produced) * (1 + pl->stride);
+        }
+        zs->next_out = pl->slot + pl->slot_fill;
+        zs->avail_out = (uInt)(pl->slot_bytes - pl->slot_fill);
+        uInt before = zs->avail_out;
+        int ret = inflate(zs, Z_NO_FLUSH);
+        pl->slot_fill += before - zs->avail_out;
+        pl->inflated += before - zs->avail_out;
+        if (pl->slot_fill == pl->slot_bytes) {
+            pl->slot = NULL;
+            ring_publish(pl, &pl->raw);
+        }
+        if (ret == Z_STREAM_END) pl->inflate_finished = true;
+        else if (ret != Z_OK) return -1;
+    }
+    return 0;
+}
+
+/* Attend les étages (ou les arrête si la décompression a échoué) ; -1 si un lot n'a pas pu être défiltré. */
+static int pipeline_finish(PngPipeline* pl, bool inflated, PngStats* stats) {
+    if (!inflated) pipeline_abort(pl);
+    for (int i = 0; i < pl->thread_count; i++) pthread_join(pl->threads[i], NULL);
+    pthread_cond_destroy(&pl->changed);
+    pthread_mutex_destroy(&pl->lock);
+    if (stats) {
+        stats->unfilter_seconds += pl->unfilter_seconds;
+        stats->place_seconds += pl->place_seconds;
+        for (int f = 0; f < PNG_FILTER_TYPES; f++) stats->filter_rows[f] += pl->filter_rows[f];
+        stats_record_passes(stats, pl->png);
+        stats_record_peak(stats, (pl->raw.slot_size + pl->rows.slot_size) * PNG_PIPELINE_SLOTS + pl->png->final_pixel_size);
+    }
+    return inflated && !pl->failed ? 0 : -1;
+}
+
+/* Vignette 1/scale (png porte déjà ses dimensions réduites). Entrelacée : seules les passes Adam7 dont les
+   pixels tombent sur la grille de la vignette ont été décompressées et sont placées telles quelles. Sinon,
+   chaque ligne est défiltrée, convertie puis moyennée par blocs scale x scale, sans image complète. */
+static int decode_thumbnail(PngImage* png, const PngConverter* conv, const unsigned char* raw, uint32_t scale, uint32_t source_width, uint32_t source_height, PngArena* arena, PngStats* stats) {
+    uint64_t filter_rows[PNG_FILTER_TYPES] = {0};
+    const unsigned char* raw_start = raw;
+    const size_t used = (size_t)png->width * png->bytes_per_pixel;
+    size_t work_size = 0;
+    double start = stats ? monotonic_seconds() : 0.0;
+    int status = 0;
+    if (png->interlace_method != 0) {
+        for (int i = 0; status == 0 && i < (scale == 8 ? 1 : 3); i++) {
+            uint32_t pass_w = source_width > (uint32_t)adam7_start_x[i] ? (source_width - adam7_start_x[i] + adam7_step_x[i] - 1) / adam7_step_x[i] : 0;
+            uint32_t pass_h = source_height > (uint32_t)adam7_start_y[i] ? (source_height - adam7_start_y[i] + adam7_step_y[i] - 1) / adam7_step_y[i] : 0;
+            if (pass_w == 0 || pass_h == 0) continue;
+            size_t stride = row_stride(png, pass_w);
+            unsigned char* pixels = arena_alloc(arena, (size_t)pass_h * stride);
+            if (!pixels) return -1;
+            work_size += (size_t)pass_h * stride;
+            status = unfilter_pass(png, raw, pixels, pass_w, pass_h, filter_rows);
+            raw += (size_t)pass_h * (1 + stride);
+            if (stats) { double now = monotonic_seconds(); stats->unfilter_seconds += now - start; start = now; }
+            for (uint32_t py = 0; status == 0 && py < pass_h; py++) {
+                unsigned char* out_row = row_pointer(png, (adam7_start_y[i] + py * adam7_step_y[i]) / scale) + (size_t)(adam7_start_x[i] / scale) * png->bytes_per_pixel;
+                conv->convert(conv, pixels + py * stride, pass_w, out_row, (size_t)(adam7_step_x[i] / scale) * png->bytes_per_pixel);
+            }
+            if (stats) { double now = monotonic_seconds(); stats->place_seconds += now - start; start = now; }
+        }
+    } else {
+        const size_t stride = row_stride(png, source_width);
+        const size_t filter_bpp = get_source_bytes_per_pixel(png->color_type, png->bit_depth);
+        unsigned char* cur = arena_alloc(arena, stride);
+        unsigned char* prev = arena_alloc(arena, stride);
+        unsigned char* rgb = arena_alloc(arena, (size_t)source_width * png->bytes_per_pixel);
+        uint32_t* sums = arena_alloc(arena, used * sizeof(uint32_t));
+        if (!cur || !prev || !rgb || !sums) return -1;
+        work_size = stride * 2 + (size_t)source_width * png->bytes_per_pixel + used * sizeof(uint32_t);
+        for (uint32_t y = 0; status == 0 && y < source_height; y++) {
+            uint8_t filter_type = *raw++;
+            if (filter_type < PNG_FILTER_TYPES) filter_rows[filter_type]++;
+            status = png_unfilter_row(filter_type, raw, cur, y ? prev : NULL, stride, filter_bpp);
+            raw += stride;
+            conv->convert(conv, cur, source_width, rgb, png->bytes_per_pixel);
+            if (y % scale == 0) memset(sums, 0, used * sizeof(uint32_t));
+            for (uint32_t tx = 0; tx < png->width; tx++) {
+                uint32_t cols = source_width - tx * scale < scale ? source_width - tx * scale : scale;
+                const unsigned char* p = rgb + (size_t)tx * scale * 3;
+                uint32_t* sum = sums + (size_t)tx * 3;
+                for (uint32_t k = 0; k < cols; k++, p += 3) { sum[0] += p[0]; sum[1] += p[1]; sum[2] += p[2]; }
+            }
+            if (y % scale == scale - 1 || y == source_height - 1) {
+                unsigned char* out = row_pointer(png, y / scale);
+                for (uint32_t tx = 0; tx < png->width; tx++) {
+                    uint32_t cols = source_width - tx * scale < scale ? source_width - tx * scale : scale;
+                    uint32_t n = cols * (y % scale + 1);
+                    for (int c = 0; c < 3; c++) out[tx * 3 + c] = (unsigned char)((sums[tx * 3 + c] + n / 2) / n);
+                }
+            }
+            unsigned char* t = prev; prev = cur; cur = t;
+        }
+        if (stats) stats->place_seconds += monotonic_seconds() - start;
+    }
+    if (png->row_size > used) {
+        for (uint32_t y = 0; y < png->height; y++) memset(row_pointer(png, y) + used, 0, png->row_size - used);
+    }
+    if (stats) {
+        for (int f = 0; f < PNG_FILTER_TYPES; f++) stats->filter_rows[f] += filter_rows[f];
+        stats_record_peak(stats, (size_t)(raw - raw_start) + work_size + png->final_pixel_size);
+    }
+    return status;
+}
+
+/* Poids d'un axe : la sortie o lit count[o] pixels source à partir de first[o], poids en virgule fixe
+   (somme 1 << PNG_RESAMPLE_BITS) rangés par blocs de max_count. */
+typedef struct PngResampleAxis {
+    uint32_t* first;
+    uint32_t* count;
+    int32_t* weights;
+    uint32_t max_count;
+} PngResampleAxis;
+
+static double resample_kernel(PngResizeFilter filter, double x) {
+    if (filter == PNG_RESIZE_BOX) return x >= -0.5 && x < 0.5 ? 1.0 : 0.0;
+    x = fabs(x);
+    return x < 1.0 ? 1.0 - x : 0.0;
+}
+
+static int resample_axis(PngResampleAxis* axis, uint32_t source, uint32_t target, PngResizeFilter filter, PngArena* arena) {
+    const double ratio = (double)source / target;
+    const double filter_scale = ratio > 1.0 ? ratio : 1.0;
+    const double support = (filter == PNG_RESIZE_BOX ? 0.5 : 1.0) * filter_scale;
+    axis->max_count = (uint32_t)ceil(2.0 * support) + 1;
+    axis->first = arena_alloc(arena, (size_t)target * sizeof(uint32_t));
+    axis->count = arena_alloc(arena, (size_t)target * sizeof(uint32_t));
+    axis->weights = arena_alloc(arena, (size_t)target * axis->max_count * sizeof(int32_t));
+    double* taps = arena_alloc(arena, (size_t)axis->max_count * sizeof(double));
+    if (!axis->first || !axis->count || !axis->weights || !taps) return -1;
+    for (uint32_t o = 0; o < target; o++) {
+        const double center = (o + 0.5) * ratio;
+        double lo = floor(center - support + 0.5), hi = floor(center + support + 0.5);
+        uint32_t first = lo < 0.0 ? 0 : (uint32_t)lo;
+        uint32_t end = hi > source ? source : (uint32_t)hi;
+        double total = 0.0;
+        for (uint32_t x = first; x < end; x++) total += taps[x - first] = resample_kernel(filter, (x - center + 0.5) / filter_scale);
+        if (total <= 0.0) {
+            /* Fenêtre vide (agrandissement, centre sur un bord de pixel) : pixel le plus proche. */
+            first = center >= source ? source - 1 : (uint32_t)center;
+            end = first + 1;
+            taps[0] = total = 1.0;
+        }
+        int32_t* w = axis->weights + (size_t)o * axis->max_count;
+        int32_t sum = 0;
+        uint32_t largest = 0;
+        for (uint32_t k = 0; k < end - first; k++) {
+            w[k] = (int32_t)lround(taps[k] / total * (1 << PNG_RESAMPLE_BITS));
+            sum += w[k];
+            if (w[k] > w[largest]) largest = k;
+        }
+        /* Somme exacte : une couleur unie reste identique. */
+        w[largest] += (1 << PNG_RESAMPLE_BITS) - sum;
+        axis->first[o] = first;
+        axis->count[o] = end - first;
+    }
+    return 0;
+}
+
+/* Redimensionnement (png porte déjà les dimensions de sortie). Chaque ligne source convertie est rééchantillonnée
+   en largeur (8 bits de fraction) dans un anneau de lignes de la largeur de sortie ; une ligne de sortie est
+   calculée dès que sa dernière ligne source est arrivée. Image non entrelacée : les lignes filtrées arrivent
+   directement de zlib, ni les données brutes ni l'image pleine taille ne sont en mémoire. Entrelacée : les passes
+   sont défiltrées d'abord et chaque ligne source est recomposée à partir d'elles. */
+typedef struct PngResampler {
+    PngImage* png;
+    const PngConverter* conv;
+    PngResampleAxis ax, ay;
+    uint32_t source_width, source_height, y, next;
+    size_t stride, filter_bpp, used, line_fill, inflated, work_size;
+    unsigned char* line;
+    unsigned char* cur;
+    unsigned char* prev;
+    unsigned char* rgb;
+    uint16_t* ring;
+    z_stream* zs;
+    bool inflate_finished, timed;
+    double place_seconds;
+    uint64_t filter_rows[PNG_FILTER_TYPES];
+} PngResampler;
+
+static int resampler_init(PngResampler* rs, PngImage* png, const PngConverter* conv, PngResizeFilter filter, uint32_t source_width, uint32_t source_height, PngArena* arena, bool timed) {
+    memset(rs, 0, sizeof(*rs));
+    rs->png = png; rs->conv = conv; rs->timed = timed;
+    rs->source_width = source_width; rs->source_height = source_height;
+    rs->used = (size_t)png->width * 3;
+    rs->stride = row_stride(png, source_width);
+    rs->filter_bpp = get_source_bytes_per_pixel(png->color_type, png->bit_depth);
+    if (resample_axis(&rs->ax, source_width, png->width, filter, arena) != 0 || resample_axis(&rs->ay, source_height, png->height, filter, arena) != 0) return -1;
+    rs->line = arena_alloc(arena, rs->stride + 1);
+    rs->cur = arena_alloc(arena, rs->stride);
+    rs->prev = arena_alloc(arena, rs->stride);
+    rs->rgb = arena_alloc(arena, (size_t)source_width * 3);
+    rs->ring = arena_alloc(arena, (size_t)rs->ay.max_count * rs->used * sizeof(uint16_t));
+    rs->work_size = rs->stride * 3 + 1 + (size_t)source_width * 3 + (size_t)rs->ay.max_count * rs->used * sizeof(uint16_t);
+    return rs->line && rs->cur && rs->prev && rs->rgb && rs->ring ? 0 : -1;
+}
+
+/* Ligne source courante (rgb, si elle sert encore) : rééchantillonnage horizontal puis lignes de sortie complètes. */
+static void resampler_row(PngResampler* rs, bool converted) {
+    PngImage* png = rs->png;
+    const uint32_t y = rs->y++;
+    if (!converted) return;
+    uint16_t* h = rs->ring + (size_t)(y % rs->ay.max_count) * rs->used;
+    for (uint32_t ox = 0; ox < png->width; ox++) {
+        const unsigned char* p = rs->rgb + (size_t)rs->ax.first[ox] * 3;
+        const int32_t* w = rs->ax.weights + (size_t)ox * rs->ax.max_count;
+        int32_t r = 0, g = 0, b = 0;
+        for (uint32_t k = 0; k < rs->ax.count[ox]; k++, p += 3) { r += p[0] * w[k]; g += p[1] * w[k]; b += p[2] * w[k]; }
+        h[ox * 3] = (uint16_t)((r + (1 << 5)) >> 6);
+        h[ox * 3 + 1] = (uint16_t)((g + (1 << 5)) >> 6);
+        h[ox * 3 + 2] = (uint16_t)((b + (1 << 5)) >> 6);
+    }
+    for (; rs->next < png->height && rs->ay.first[rs->next] + rs->ay.count[rs->next] <= y + 1; rs->next++) {
+        unsigned char* out = row_pointer(png, rs->next);
+        const int32_t* w = rs->ay.weights + (size_t)rs->next * rs->ay.max_count;
+        for (size_t i = 0; i < rs->used; i++) {
+            int32_t v = 0;
+            for (uint32_t k = 0; k < rs->ay.count[rs->next]; k++) v += rs->ring[(size_t)((rs->ay.first[rs->next] + k) % rs->ay.max_count) * rs->used + i] * w[k];
+            v = (v + (1 << (PNG_RESAMPLE_BITS + 7))) >> (PNG_RESAMPLE_BITS + 8);
+            out[i] = (unsigned char)(v > 255 ? 255 : v);
+        }
+    }
+}
+
+/* Les lignes antérieures à toutes les fenêtres restantes ne sont pas converties. */
+static bool resampler_needs_row(const PngResampler* rs) {
+    return rs->next < rs->png->height && rs->y >= rs->ay.first[rs->next];
+}
+
+/* Ligne filtrée complète d'une image non entrelacée. */
+static int resampler_line(PngResampler* rs) {
+    double start = rs->timed ? monotonic_seconds() : 0.0;
+    uint8_t filter_type = rs->line[0];
+    if (filter_type < PNG_FILTER_TYPES) rs->filter_rows[filter_type]++;
+    if (png_unfilter_row(filter_type, rs->line + 1, rs->cur, rs->y ? rs->prev : NULL, rs->stride, rs->filter_bpp) != 0) return -1;
+    unsigned char* t = rs->prev; rs->prev = rs->cur; rs->cur = t;
+    bool needed = resampler_needs_row(rs);
+    if (needed) rs->conv->convert(rs->conv, rs->prev, rs->source_width, rs->rgb, 3);
+    resampler_row(rs, needed);
+    if (rs->timed) rs->place_seconds += monotonic_seconds() - start;
+    return 0;
+}
+
+/* Décompresse un IDAT ligne par ligne ; les données au-delà de l'image sont ignorées. 1 : ligne mal filtrée. */
+static int resampler_inflate(PngResampler* rs, const unsigned char* in, uint32_t in_len) {
+    z_stream* zs = rs->zs;
+    zs->next_in = (Bytef*)in;
+    zs->avail_in = in_len;
+    while (!rs->inflate_finished && zs->avail_in > 0 && rs->y < rs->source_height) {
+        zs->next_out = rs->line + rs->line_fill;
+        zs->avail_out = (uInt)(rs->stride + 1 - rs->line_fill);
+        uInt before = zs->avail_out;
+        int ret = inflate(zs, Z_NO_FLUSH);
+        rs->line_fill += before - zs->avail_out;
+        rs->inflated += before - zs->avail_out;
+        if (rs->line_fill == rs->stride + 1) {
+            rs->line_fill = 0;
+            if (resampler_line(rs) != 0) return 1;
+        }
+        if (ret == Z_STREAM_END) rs->inflate_finished = true;
+        else if (ret != Z_OK) return -1;
+    }
+    return 0;
+}
+
+static int resampler_finish(PngResampler* rs, size_t raw_size, PngStats* stats) {
+    PngImage* png = rs->png;
+    if (png->row_size > rs->used) {
+        for (uint32_t y = 0; y < png->height; y++) memset(row_pointer(png, y) + rs->used, 0, png->row_size - rs->used);
+    }
+    if (stats) {
+        stats->place_seconds += rs->place_seconds;
+        for (int f = 0; f < PNG_FILTER_TYPES; f++) stats->filter_rows[f] += rs->filter_rows[f];
+        stats_record_peak(stats, raw_size + rs->work_size + png->final_pixel_size);
+    }
+    return 0;
+}
+
+static int decode_resize_interlaced(PngImage* png, const PngConverter* conv, const unsigned char* raw, PngResizeFilter filter, uint32_t source_width, uint32_t source_height, PngArena* arena, PngStats* stats) {
+    PngResampler rs;
+    if (resampler_init(&rs, png, conv, filter, source_width, source_height, arena, false) != 0) return -1;
+    const unsigned char* raw_start = raw;
+    const unsigned char* passes[7] = { NULL };
+    uint32_t pass_w[7] = {0}, pass_h[7] = {0};
+    size_t pass_stride[7] = {0};
+    double start = stats ? monotonic_seconds() : 0.0;
+    for (int i = 0; i < 7; i++) {
+        pass_w[i] = source_width > (uint32_t)adam7_start_x[i] ? (source_width - adam7_start_x[i] + adam7_step_x[i] - 1) / adam7_step_x[i] : 0;
+        pass_h[i] = source_height > (uint32_t)adam7_start_y[i] ? (source_height - adam7_start_y[i] + adam7_step_y[i] - 1) / adam7_step_y[i] : 0;
+        if (pass_w[i] == 0 || pass_h[i] == 0) continue;
+        pass_stride[i] = row_stride(png, pass_w[i]);
+        unsigned char* pixels = arena_alloc(arena, (size_t)pass_h[i] * pass_stride[i]);
+        if (!pixels) return -1;
+        rs.work_size += (size_t)pass_h[i] * pass_stride[i];
+        if (unfilter_pass(png, raw, pixels, pass_w[i], pass_h[i], rs.filter_rows) != 0) return -1;
+        raw += (size_t)pass_h[i] * (1 + pass_stride[i]);
+        passes[i] = pixels;
+    }
+    if (stats) { double now = monotonic_seconds(); stats->unfilter_seconds += now - start; start = now; }
+    while (rs.y < source_height && rs.next < png->height) {
+        const uint32_t y = rs.y;
+        bool needed = resampler_needs_row(&rs);
+        for (int i = 0; needed && i < 7; i++) {
+            if (!passes[i] || y < (uint32_t)adam7_start_y[i] || (y - adam7_start_y[i]) % adam7_step_y[i] != 0) continue;
+            uint32_t py = (y - adam7_start_y[i]) / adam7_step_y[i];
+            conv->convert(conv, passes[i] + py * pass_stride[i], pass_w[i], rs.rgb + (size_t)adam7_start_x[i] * 3, (size_t)adam7_step_x[i] * 3);
+        }
+        resampler_row(&rs, needed);
+    }
+    if (stats) rs.place_seconds = monotonic_seconds() - start;
+    return resampler_finish(&rs, (size_t)(raw - raw_start), stats);
+}
+
+/* Géométrie d'une passe dans l'image source (passe unique -1 pour une image non entrelacée) et nombre de ses
+   lignes nécessaires pour atteindre le bas de la découpe. */
+typedef struct PngCropPass {
+    uint32_t start_x, start_y, step_x, step_y, width, height, needed;
+} PngCropPass;
+
+static int crop_pass(uint32_t source_width, uint32_t source_height, const PngRect* crop, int index, PngCropPass* pass) {
+    pass->start_x = index < 0 ? 0 : (uint32_t)adam7_start_x[index];
+    pass->start_y = index < 0 ? 0 : (uint32_t)adam7_start_y[index];
+    pass->step_x = index < 0 ? 1 : (uint32_t)adam7_step_x[index];
+    pass->step_y = index < 0 ? 1 : (uint32_t)adam7_step_y[index];
+    pass->width = source_width > pass->start_x ? (source_width - pass->start_x + pass->step_x - 1) / pass->step_x : 0;
+    pass->height = source_height > pass->start_y ? (source_height - pass->start_y + pass->step_y - 1) / pass->step_y : 0;
+    uint32_t bottom = crop->y + crop->height;
+    pass->needed = bottom > pass->start_y ? (bottom - pass->start_y + pass->step_y - 1) / pass->step_y : 0;
+    if (pass->needed > pass->height) pass->needed = pass->height;
+    return pass->width != 0 && pass->height != 0;
+}
+
+/* Données filtrées à décompresser : jusqu'à la dernière ligne utile de la dernière passe qui en a une. */
+static size_t crop_raw_size(const PngImage* png, const PngRect* crop) {
+    size_t offset = 0, end = 0;
+    for (int i = png->interlace_method == 0 ? -1 : 0; i < (png->interlace_method == 0 ? 0 : 7); i++) {
+        PngCropPass pass;
+        if (!crop_pass(png->width, png->height, crop, i, &pass)) continue;
+        size_t line = 1 + row_stride(png, pass.width);
+        if (pass.needed) end = offset + (size_t)pass.needed * line;
+        offset += (size_t)pass.height * line;
+    }
+    return end;
+}
+
+/* Convertit count pixels d'une ligne défiltrée à partir du pixel first. Aux profondeurs 1/2/4 bits, un début
+   au milieu d'un octet passe par tmp, les convertisseurs lisant des octets entiers. */
+static void convert_span(const PngImage* png, const PngConverter* conv, const unsigned char* row, uint32_t first, uint32_t count, unsigned char* dst, size_t dst_step, unsigned char* tmp) {
+    size_t bits = (size_t)png->bit_depth * get_source_bytes_per_pixel(png->color_type, 8);
+    uint32_t lead = png->bit_depth < 8 ? first % (8 / png->bit_depth) : 0;
+    const unsigned char* src = row + (size_t)(first - lead) * bits / 8;
+    if (lead == 0) {
+        conv->convert(conv, src, count, dst, dst_step);
+        return;
+    }
+    conv->convert(conv, src, count + lead, tmp, png->bytes_per_pixel);
+    for (uint32_t i = 0; i < count; i++) memcpy(dst + i * dst_step, tmp + (size_t)(lead + i) * png->bytes_per_pixel, png->bytes_per_pixel);
+}
+
+/* Découpe (png porte déjà ses dimensions). Chaque passe est défiltrée ligne par ligne dans une fenêtre de deux
+   lignes jusqu'à la dernière ligne utile ; seules les lignes et colonnes de la découpe sont converties. */
+static int decode_crop(PngImage* png, const PngConverter* conv, const unsigned char* raw, const PngRect* crop, uint32_t source_width, uint32_t source_height, PngArena* arena, PngStats* stats) {
+    uint64_t filter_rows[PNG_FILTER_TYPES] = {0};
+    const size_t used = (size_t)png->width * png->bytes_per_pixel;
+    const size_t full_stride = row_stride(png, source_width);
+    const size_t filter_bpp = get_source_bytes_per_pixel(png->color_type, png->bit_depth);
+    unsigned char* cur = arena_alloc(arena, full_stride);
+    unsigned char* prev = arena_alloc(arena, full_stride);
+    unsigned char* tmp = arena_alloc(arena, ((size_t)crop->width + 8) * png->bytes_per_pixel);
+    if (!cur || !prev || !tmp) return -1;
+    double start = stats ? monotonic_seconds() : 0.0;
+    size_t offset = 0, raw_used = 0;
+    int status = 0;
+    for (int i = png->interlace_method == 0 ? -1 : 0; status == 0 && i < (png->interlace_method == 0 ? 0 : 7); i++) {
+        PngCropPass pass;
+        if (!crop_pass(source_width, source_height, crop, i, &pass)) continue;
+        const size_t stride = row_stride(png, pass.width);
+        /* Colonnes de la passe qui tombent dans la découpe. */
+        uint32_t left = crop->x, right = crop->x + crop->width;
+        uint32_t px_begin = left <= pass.start_x ? 0 : (left - pass.start_x + pass.step_x - 1) / pass.step_x;
+        uint32_t px_end = right <= pass.start_x ? 0 : (right - pass.start_x + pass.step_x - 1) / pass.step_x;
+        if (px_end > pass.width) px_end = pass.width;
+        for (uint32_t py = 0; status == 0 && py < pass.needed; py++) {
+            const unsigned char* line = raw + offset + (size_t)py * (1 + stride);
+            if (line[0] < PNG_FILTER_TYPES) filter_rows[line[0]]++;
+            status = png_unfilter_row(line[0], line + 1, cur, py ? prev : NULL, stride, filter_bpp);
+            uint32_t y = pass.start_y + py * pass.step_y;
+            if (status == 0 && y >= crop->y && px_begin < px_end) {
+                uint32_t x = pass.start_x + px_begin * pass.step_x - crop->x;
+                unsigned char* out = row_pointer(png, y - crop->y) + (size_t)x * png->bytes_per_pixel;
+                convert_span(png, conv, cur, px_begin, px_end - px_begin, out, (size_t)pass.step_x * png->bytes_per_pixel, tmp);
+            }
+            unsigned char* t = prev; prev = cur; cur = t;
+        }
+        if (pass.needed) raw_used = offset + (size_t)pass.needed * (1 + stride);
+        offset += (size_t)pass.height * (1 + stride);
+    }
+    if (png->row_size > used) {
+        for (uint32_t y = 0; y < png->height; y++) memset(row_pointer(png, y) + used, 0, png->row_size - used);
+    }
+    if (stats) {
+        stats->place_seconds += monotonic_seconds() - start;
+        for (int f = 0; f < PNG_FILTER_TYPES; f++) stats->filter_rows[f] += filter_rows[f];
+        stats_record_peak(stats, raw_used + full_stride * 2 + ((size_t)crop->width + 8) * png->bytes_per_pixel + png->final_pixel_size);
+    }
+    return status;
+}
+
+void png_destroy(PngImage* png) {
+    if (png != NULL) { if (png->owns_pixels) free(png->final_pixel_data); free(png->palette); free(png->index_colors); free(png); }
+}
+
+/* Profondeurs admises par la norme pour chaque type de couleur ; tout le décodage suppose l'une d'elles. */
+static bool valid_bit_depth(uint8_t color_type, uint8_t bit_depth) {
+    switch (color_type) {
+        case 0: return bit_depth == 1 || bit_depth == 2 || bit_depth == 4 || bit_depth == 8 || bit_depth == 16;
+        case 3: return bit_depth == 1 || bit_depth == 2 || bit_depth == 4 || bit_depth == 8;
+        case 2: case 4: case 6: return bit_depth == 8 || bit_depth == 16;
+        default: return false;
+    }
+}
+
+/* IHDR, PLTE et tRNS dimensionnent les tampons et le convertisseur : ils ne sont plus admis après le premier IDAT. */
+static bool sizing_chunk(const unsigned char* chunk_type) {
+    return strncmp((const char*)chunk_type, "IHDR", 4) == 0 || strncmp((const char*)chunk_type, "PLTE", 4) == 0 ||
+           strncmp((const char*)chunk_type, "tRNS", 4) == 0;
+}
+
+/* palette_storage (256 entrées) évite l'allocation de la palette ; NULL pour l'allouer avec l'image. */
+static int parse_header_chunk(PngImage* png, RGBA* palette_storage, const unsigned char* chunk_type, const unsigned char* chunk_data, uint32_t chunk_length) {
+    if (strncmp((const char*)chunk_type, "IHDR", 4) == 0) {
+        if (chunk_length < 13 || png->width != 0) return -1;
+        png->width = read_be32(chunk_data); png->height = read_be32(chunk_data + 4);
+        png->bit_depth = chunk_data[8]; png->color_type = chunk_data[9]; png->interlace_method = chunk_data[12];
+        png->bytes_per_pixel = 3;
+        if (png->width == 0 || png->height == 0) return -1;
+        if (!valid_bit_depth(png->color_type, png->bit_depth) || png->interlace_method > 1) return -1;
+    } else if (strncmp((const char*)chunk_type, "PLTE", 4) == 0) {
+        png->palette_size = chunk_length / 3 < 256 ? chunk_length / 3 : 256;
+        if (!palette_storage) free(png->palette);
+        png->palette = palette_storage ? palette_storage : malloc(png->palette_size * sizeof(RGBA));
+        if (!png->palette) return -1;
+        for(unsigned int i=0; i<png->palette_size; ++i) { png->palette[i].r = chunk_data[i*3]; png->palette[i].g = chunk_data[i*3+1]; png->palette[i].b = chunk_data[i*3+2]; png->palette[i].a = 255; }
+    } else if (strncmp((const char*)chunk_type, "gAMA", 4) == 0) {
+        if (chunk_length < 4) return -1;
+        uint32_t gamma_int = read_be32(chunk_data);
+        if (gamma_int != 0) { png->file_gamma = 1.0f / (gamma_int / 100000.0f); }
+    } else if (strncmp((const char*)chunk_type, "tRNS", 4) == 0) {
+        png->has_transparency_key = true;
+        if (png->color_type == 0 && chunk_length >= 2) {
+            png->transparency_key.r = png->transparency_key.g = png->transparency_key.b = read_be16(chunk_data);
+        } else if (png->color_type == 2 && chunk_length >= 6) {
+            png->transparency_key.r = read_be16(chunk_data);
+            png->transparency_key.g = read_be16(chunk_data + 2);
+            png->transparency_key.b = read_be16(chunk_data + 4);
+        } else {
+            png->has_transparency_key = false;
+            if (png->color_type == 3 && png->palette) {
+                for (unsigned int i=0; i < chunk_length && i < png->palette_size; ++i) png->palette[i].a = chunk_data[i];
+            }
+        }
+    }
+    return 0;
+}
+
+void png_options_init(PngDecodeOptions* options) {
+    memset(options, 0, sizeof(*options));
+    options->background.r = options->background.g = options->background.b = options->background.a = 255;
+    options->threads = 1;
+    options->inflate_engine = PNG_INFLATE_DEFAULT;
+}
+
+int png_parse_resize_filter(const char* name, PngResizeFilter* filter) {
+    if (strcmp(name, "box") == 0) { *filter = PNG_RESIZE_BOX; return 0; }
+    if (strcmp(name, "bilinear") == 0) { *filter = PNG_RESIZE_BILINEAR; return 0; }
+    return -1;
+}
+
+int png_parse_format(const char* name, PngPixelFormat* format) {
+    static const char* names[] = { "auto", "24", "32", "index" };
+    static const PngPixelFormat formats[] = { PNG_FORMAT_BMP_AUTO, PNG_FORMAT_BMP, PNG_FORMAT_BMP32, PNG_FORMAT_BMP_INDEXED };
+    for (int k = 0; k < 4; k++) {
+        if (strcmp(name, names[k]) == 0) { *format = formats[k]; return 0; }
+    }
+    return -1;
+}
+
+/* Lit les octets [offset, offset + n) : depuis la première lecture si possible, sinon directement dans le fichier. */
+static int probe_read(FILE* fptr, const unsigned char* head, size_t head_size, size_t offset, unsigned char* dst, size_t n) {
+    if (offset + n <= head_size) { memcpy(dst, head + offset, n); return 0; }
+    if (fseek(fptr, (long)offset, SEEK_SET) != 0) return -1;
+    return fread(dst, 1, n, fptr) == n ? 0 : -1;
+}
+
+/* Une seule lecture de PNG_PROBE_READ_SIZE octets suffit d'ordinaire ; les chunks inutiles qui la dépassent
+   (profils ICC, textes) sont sautés sans être lus. */
+int png_probe(const char* fname, PngInfo* info) {
+    const uint8_t png_sig_bytes[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+    unsigned char head[PNG_PROBE_READ_SIZE];
+    unsigned char chunk[8 + 256 * 3 + 4];
+    PngImage png;
+    memset(info, 0, sizeof(*info));
+    memset(&png, 0, sizeof(png));
+    png.file_gamma = 2.2f;
+    FILE* fptr = fopen(fname, "rb");
+    if (!fptr) return -1;
+    size_t head_size = fread(head, 1, sizeof(head), fptr);
+    int status = head_size >= 8 && memcmp(head, png_sig_bytes, 8) == 0 ? 0 : -1;
+    for (size_t offset = 8; status == 0; ) {
+        if (probe_read(fptr, head, head_size, offset, chunk, 8) != 0) { status = -1; break; }
+        uint32_t length = read_be32(chunk);
+        const unsigned char* type = chunk + 4;
+        if (strncmp((const char*)type, "IDAT", 4) == 0 || strncmp((const char*)type, "IEND", 4) == 0) break;
+        bool wanted = strncmp((const char*)type, "IHDR", 4) == 0 || strncmp((const char*)type, "PLTE", 4) == 0 ||
+                      strncmp((const char*)type, "gAMA", 4) == 0 || strncmp((const char*)type, "tRNS", 4) == 0;
+        if (wanted) {
+            if (length > sizeof(chunk) - 12 || probe_read(fptr, head, head_size, offset + 8, chunk + 8, (size_t)length + 4) != 0 ||
+                crc32(0L, chunk + 4, length + 4) != read_be32(chunk + 8 + length) ||
+                parse_header_chunk(&png, info->palette, type, chunk + 8, length) != 0) {
+                status = -1;
+                break;
+            }
+        }
+        offset += 12 + (size_t)length;
+    }
+    fclose(fptr);
+    if (status != 0 || png.width == 0) return -1;
+    info->width = png.width;
+    info->height = png.height;
+    info->bit_depth = png.bit_depth;
+    info->color_type = png.color_type;
+    info->interlace_method = png.interlace_method;
+    info->file_gamma = png.file_gamma;
+    info->palette_size = png.palette ? png.palette_size : 0;
+    info->has_transparency_key = png.has_transparency_key;
+    info->transparency_key = png.transparency_key;
+    return 0;
+}
+
+size_t png_row_size(uint32_t width, uint32_t bits_per_pixel, PngPixelFormat format) {
+    size_t row = ((size_t)width * bits_per_pixel + 7) / 8;
+    return format != PNG_FORMAT_RGB ? (row + 3) & ~(size_t)3 : row;
+}
+
+/* Fixe pixel_format, bytes_per_pixel (pas d'écriture des convertisseurs) et bits_per_pixel d'après le format
+   demandé. Une vignette ou une image redimensionnée moyenne des couleurs composées : 24 bits. Les index ne descendent sous 8 bits que si
+   chaque ligne est convertie d'un bloc (image non entrelacée, ni découpe). */
+static void resolve_output(PngImage* png, PngPixelFormat format, bool averaged, bool crop) {
+    bool alpha = png->color_type == 4 || png->color_type == 6 || png->has_transparency_key;
+    for (unsigned int i = 0; png->color_type == 3 && png->palette && i < png->palette_size; i++) alpha = alpha || png->palette[i].a != 255;
+    const bool indexable = png->color_type == 3 || (png->color_type == 0 && png->bit_depth <= 8);
+    if (format == PNG_FORMAT_BMP_AUTO) format = alpha ? PNG_FORMAT_BMP32 : indexable ? PNG_FORMAT_BMP_INDEXED : PNG_FORMAT_BMP;
+    if ((averaged && format != PNG_FORMAT_RGB) || (format == PNG_FORMAT_BMP_INDEXED && !indexable)) format = PNG_FORMAT_BMP;
+    png->pixel_format = format;
+    png->bytes_per_pixel = format == PNG_FORMAT_BMP32 ? 4 : format == PNG_FORMAT_BMP_INDEXED ? 1 : 3;
+    png->bits_per_pixel = (uint8_t)(png->bytes_per_pixel * 8);
+    if (format == PNG_FORMAT_BMP_INDEXED && png->interlace_method == 0 && !crop && png->bit_depth < 8) png->bits_per_pixel = png->bit_depth == 1 ? 1 : 4;
+}
+
+/* Table des couleurs d'une sortie indexée : la lut du convertisseur (BGR, composée sur le fond). */
+static void store_index_colors(PngImage* png, const PngConverter* conv, RGBA* colors) {
+    png->index_colors = colors;
+    /* Niveaux de gris sous 8 bits : la lut n'est définie que pour les 1 << bit_depth niveaux. */
+    png->index_color_count = 1u << (png->color_type == 0 && png->bit_depth < png->bits_per_pixel ? png->bit_depth : png->bits_per_pixel);
+    for (unsigned int i = 0; i < png->index_color_count; i++) {
+        colors[i].b = conv->lut[i][0]; colors[i].g = conv->lut[i][1]; colors[i].r = conv->lut[i][2]; colors[i].a = 255;
+    }
+}
+
+PngImage* 
+png_load_from_data(const unsigned char* data, size_t size)
+{
+    return png_load_from_data_ex(data, size, NULL);
+}
+
+static bool resize_requested(const PngResize* resize) {
+    return resize->scale > 0.0 || resize->width != 0 || resize->height != 0;
+}
+
+/* Dimensions de sortie d'un redimensionnement (arrondies, au moins 1 pixel). */
+static void resize_dimensions(const PngResize* resize, uint32_t width, uint32_t height, double* out_width, double* out_height) {
+    if (resize->scale > 0.0) {
+        *out_width = width * resize->scale;
+        *out_height = height * resize->scale;
+    } else {
+        *out_width = resize->width ? resize->width : (double)width * resize->height / height;
+        *out_height = resize->height ? resize->height : (double)height * resize->width / width;
+    }
+    *out_width = *out_width < 1.0 ? 1.0 : floor(*out_width + 0.5);
+    *out_height = *out_height < 1.0 ? 1.0 : floor(*out_height + 0.5);
+}
+
+/* Format de sortie, convertisseur et tampon des pixels ; png prend les dimensions de la vignette, de la
+   découpe ou du redimensionnement éventuel. */
+static int prepare_output(PngDecoder* dec, PngImage* png, const PngDecodeOptions* options, const PngRect* crop, PngConverter* converter, bool reuse)
+{
+    const uint32_t scale = options->thumbnail_scale;
+    const bool resizing = resize_requested(&options->resize);
+    double resized_width = 0.0, resized_height = 0.0;
+    if (resizing) {
+        resize_dimensions(&options->resize, png->width, png->height, &resized_width, &resized_height);
+        if (resized_width > PNG_RESIZE_MAX_SIDE || resized_height > PNG_RESIZE_MAX_SIDE) return decoder_fail(dec, "dimensions de redimensionnement trop grandes");
+    }
+    resolve_output(png, options->format, scale != 0 || resizing, crop->width != 0);
+    if (png_converter_init(converter, png, options->background, reuse ? &dec->compositor_cache : NULL) != 0) return decoder_fail(dec, "type de couleur ou profondeur non pris en charge");
+    if (png->pixel_format == PNG_FORMAT_BMP_INDEXED) {
+        RGBA* colors = reuse ? dec->index_colors : malloc(256 * sizeof(RGBA));
+        if (!colors) return decoder_fail(dec, "mémoire insuffisante");
+        store_index_colors(png, converter, colors);
+    }
+    if (scale || crop->width || resizing) {
+        if (options->stats) stats_record_passes(options->stats, png);
+        png->width = resizing ? (uint32_t)resized_width : scale ? (png->width + scale - 1) / scale : crop->width;
+        png->height = resizing ? (uint32_t)resized_height : scale ? (png->height + scale - 1) / scale : crop->height;
+    }
+    png->row_size = png_row_size(png->width, png->bits_per_pixel, png->pixel_format);
+    png->final_pixel_size = png->row_size * png->height;
+    if (options->allocate) {
+        png->final_pixel_data = options->allocate(options->allocate_user, png, png->final_pixel_size);
+    } else if (reuse) {
+        png->final_pixel_data = arena_alloc(&dec->arena, png->final_pixel_size);
+    } else {
+        png->final_pixel_data = calloc(1, png->final_pixel_size);
+        png->owns_pixels = true;
+    }
+    if (!png->final_pixel_data) return decoder_fail(dec, "mémoire insuffisante");
+    return 0;
+}
+
+/* Cœur du décodage en mémoire. reuse : palette, données brutes, défiltrées et pixels viennent du décodeur
+   (png_decode_into) ; sinon palette et pixels sont alloués pour l'image et rendus par png_destroy. */
+static int decode_stages(PngDecoder* dec, const unsigned char* data, size_t size, const PngDecodeOptions* options, PngImage* png, bool reuse)
+{
+    const uint8_t png_sig_bytes[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+    PngStats* stats = options->stats;
+    const uint32_t scale = options->thumbnail_scale;
+    const bool builtin = png_inflate_resolve(options->inflate_engine) == PNG_INFLATE_BUILTIN;
+    if (stats) stats->bytes_in += size;
+    if (size < 8 || memcmp(data, png_sig_bytes, 8) != 0) return decoder_fail(dec, "signature PNG absente");
+    if (scale != 0 && scale != 4 && scale != 8) return decoder_fail(dec, "réduction de vignette invalide");
+    PngRect crop = options->crop;
+    if (crop.width != 0 && (scale != 0 || crop.height == 0)) return decoder_fail(dec, "découpe invalide");
+    const bool resizing = resize_requested(&options->resize);
+    if (options->resize.scale < 0.0 || options->resize.scale != options->resize.scale || (unsigned)options->resize.filter > PNG_RESIZE_BILINEAR || (resizing && (scale != 0 || crop.width != 0))) {
+        return decoder_fail(dec, "redimensionnement invalide");
+    }
+    png->file_gamma = 2.2f;
+    png->has_transparency_key = false;
+    PngChunkIterator it = { data + 8, data + size, stats };
+    PngChunk chunk;
+    PngInflater inflater;
+    PngIdatData idat = { NULL, 0, NULL };
+    PngPipeline pipeline;
+    PngResampler resampler;
+    PngConverter converter;
+    bool inflating = false, ok = false, partial = false, whole = false, pipelined = false, resampled = false;
+    unsigned char* uncompressed_data = NULL;
+    size_t uncompressed_size = 0;
+    int next;
+    double parse_start = stats ? monotonic_seconds() : 0.0, inflate_seconds = 0.0, crc_before = stats ? stats->crc_seconds : 0.0;
+    while ((next = chunk_next(&it, &chunk)) > 0) {
+        if (strncmp((const char*)chunk.type, "IDAT", 4) == 0) {
+            if (!inflating) {
+                if (crop.width != 0) {
+                    if (crop.x >= png->width || crop.y >= png->height) { decoder_fail(dec, "découpe hors de l'image"); break; }
+                    if (crop.width > png->width - crop.x) crop.width = png->width - crop.x;
+                    if (crop.height > png->height - crop.y) crop.height = png->height - crop.y;
+                    partial = true;
+                    uncompressed_size = crop_raw_size(png, &crop);
+                } else {
+                    partial = scale != 0 && png->interlace_method != 0;
+                    uncompressed_size = raw_image_size(png, partial ? (scale == 8 ? 1 : 3) : 7);
+                }
+                if (uncompressed_size == 0) { decoder_fail(dec, "en-tête IHDR absent ou invalide"); break; }
+                /* Grande image non entrelacée avec au moins trois threads : décompression, défiltrage et conversion
+                   se recouvrent. Sinon le moteur intégré décompresse d'un bloc ; vignettes et découpes gardent
+                   l'arrêt anticipé de zlib. */
+                pipelined = !partial && scale == 0 && !resizing && png->interlace_method == 0 && options->threads >= 3 && (uint64_t)png->width * png->height >= PNG_PARALLEL_MIN_PIXELS;
+                /* Redimensionnement d'une image non entrelacée : les lignes passent de zlib au rééchantillonnage. */
+                resampled = resizing && png->interlace_method == 0;
+                whole = builtin && !partial && !pipelined && !resampled;
+                z_stream* zs = whole ? NULL : decoder_inflate_stream(dec);
+                if (!whole && !zs) { decoder_fail(dec, "mémoire insuffisante"); break; }
+                if (pipelined) {
+                    if (prepare_output(dec, png, options, &crop, &converter, reuse) != 0) { pipelined = false; break; }
+                    if (pipeline_start(&pipeline, png, &converter, zs, options->threads, &dec->arena, stats != NULL) != 0) { decoder_fail(dec, "démarrage des threads impossible"); pipelined = false; break; }
+                } else if (resampled) {
+                    const uint32_t source_width = png->width, source_height = png->height;
+                    if (prepare_output(dec, png, options, &crop, &converter, reuse) != 0) { resampled = false; break; }
+                    if (resampler_init(&resampler, png, &converter, options->resize.filter, source_width, source_height, &dec->arena, stats != NULL) != 0) { decoder_fail(dec, "mémoire insuffisante"); resampled = false; break; }
+                    resampler.zs = zs;
+                } else {
+                    if ((uncompressed_data = arena_alloc(&dec->arena, uncompressed_size)) == NULL) { decoder_fail(dec, "mémoire insuffisante"); break; }
+                    inflater_init(&inflater, zs, uncompressed_data, uncompressed_size);
+                }
+                inflating = true;
+            }
+            if (pipelined) {
+                double inflate_start = stats ? monotonic_seconds() : 0.0;
+                int fed = pipeline_inflate(&pipeline, chunk.data, chunk.length);
+                if (stats) { inflate_seconds += monotonic_seconds() - inflate_start; stats->idat_chunks++; }
+                if (fed == PNG_PIPELINE_ABORTED) { decoder_fail(dec, "type de filtre de ligne invalide"); break; }
+                if (fed != 0) { decoder_fail(dec, dec->zs.msg ? dec->zs.msg : "flux zlib invalide"); break; }
+                continue;
+            }
+            if (resampled) {
+                double inflate_start = stats ? monotonic_seconds() : 0.0;
+                int fed = resampler_inflate(&resampler, chunk.data, chunk.length);
+                if (stats) { inflate_seconds += monotonic_seconds() - inflate_start; stats->idat_chunks++; }
+                if (fed > 0) { decoder_fail(dec, "type de filtre de ligne invalide"); break; }
+                if (fed != 0) { decoder_fail(dec, dec->zs.msg ? dec->zs.msg : "flux zlib invalide"); break; }
+                continue;
+            }
+            if (whole) {
+                if (stats) stats->idat_chunks++;
+                if (idat_append(&idat, &dec->arena, &chunk, (size_t)(it.end - chunk.data)) != 0) { decoder_fail(dec, "mémoire insuffisante"); break; }
+                continue;
+            }
+            double inflate_start = stats ? monotonic_seconds() : 0.0;
+            int fed = inflater_feed(&inflater, chunk.data, chunk.length);
+            if (stats) { inflate_seconds += monotonic_seconds() - inflate_start; stats->idat_chunks++; }
+            if (fed != 0) { decoder_fail(dec, inflater.zs->msg ? inflater.zs->msg : "flux zlib invalide"); break; }
+            /* Vignette entrelacée ou découpe : le reste du flux n'est pas lu. */
+            if (partial && inflater.produced == uncompressed_size) { ok = true; break; }
+        } else if (strncmp((const char*)chunk.type, "IEND", 4) == 0) {
+            ok = inflating;
+            break;
+        } else if (inflating && sizing_chunk(chunk.type)) {
+            decoder_fail(dec, "chunk %.4s après les données d'image", (const char*)chunk.type);
+            break;
+        } else if (parse_header_chunk(png, reuse ? dec->palette : NULL, chunk.type, chunk.data, chunk.length) != 0) {
+            decoder_fail(dec, "chunk %.4s invalide", (const char*)chunk.type);
+            break;
+        }
+    }
+    if (next < 0) decoder_fail(dec, "chunk tronqué ou CRC incorrect");
+    /* Les images tronquées sans IEND restent acceptées tant que le flux zlib couvre toute l'image. */
+    if (next == 0) ok = inflating;
+    if (ok && whole) {
+        double inflate_start = stats ? monotonic_seconds() : 0.0;
+        PngInflateStatus inflated = png_inflate(idat.data, idat.size, uncompressed_data, uncompressed_size, &inflater.produced);
+        if (stats) inflate_seconds += monotonic_seconds() - inflate_start;
+        if (inflated != PNG_INFLATE_OK) { decoder_fail(dec, "%s", png_inflate_status_string(inflated)); ok = false; }
+    }
+    if (pipelined) inflater.produced = pipeline.inflated;
+    /* Le rééchantillonnage a été chronométré pendant la décompression. */
+    const double resample_seconds = resampled ? resampler.place_seconds : 0.0;
+    if (resampled) inflater.produced = resampler.inflated;
+    if (stats) {
+        stats->inflate_seconds += inflate_seconds - resample_seconds;
+        stats->parse_seconds += monotonic_seconds() - parse_start - inflate_seconds - (stats->crc_seconds - crc_before);
+        if (inflating) stats->bytes_inflated += inflater.produced;
+    }
+    if (!inflating) return decoder_fail(dec, "aucun chunk IDAT");
+    if (ok && inflater.produced != uncompressed_size) {
+        decoder_fail(dec, "données compressées incomplètes : %zu octets sur %zu", inflater.produced, uncompressed_size);
+        ok = false;
+    }
+    if (pipelined) {
+        if (pipeline_finish(&pipeline, ok, stats) != 0) return decoder_fail(dec, ok ? "type de filtre de ligne invalide" : NULL);
+        return 0;
+    }
+    if (!ok) return decoder_fail(dec, NULL);
+    if (resampled) return resampler_finish(&resampler, 0, stats);
+    const uint32_t source_width = png->width, source_height = png->height;
+    if (prepare_output(dec, png, options, &crop, &converter, reuse) != 0) return -1;
+    if (crop.width) return decode_crop(png, &converter, uncompressed_data, &crop, source_width, source_height, &dec->arena, stats);
+    if (scale) return decode_thumbnail(png, &converter, uncompressed_data, scale, source_width, source_height, &dec->arena, stats);
+    if (resizing) return decode_resize_interlaced(png, &converter, uncompressed_data, options->resize.filter, source_width, source_height, &dec->arena, stats);
+    return decode_pixels(png, &converter, uncompressed_data, options->threads, &dec->arena, stats);
+}
+
+static int decode_image(PngDecoder* dec, const unsigned char* data, size_t size, const PngDecodeOptions* options, PngImage* png, bool reuse)
+{
+    PngDecodeOptions defaults;
+    if (!options) { png_options_init(&defaults); options = &defaults; }
+    png_unfilter_ensure_init();
+    dec->error[0] = '\0';
+    double start = options->stats ? monotonic_seconds() : 0.0;
+    int status = decode_stages(dec, data, size, options, png, reuse);
+    if (options->stats) {
+        options->stats->total_seconds += monotonic_seconds() - start;
+        if (status == 0) options->stats->images++;
+    }
+    return status;
+}
+
+static void decoder_release(PngDecoder* dec)
+{
+    if (dec->zs_ready) inflateEnd(&dec->zs);
+    arena_release(&dec->arena);
+}
+
+PngImage* 
+png_load_from_data_ex(const unsigned char* data, size_t size, const PngDecodeOptions* options)
+{
+    PngDecoder dec;
+    memset(&dec, 0, sizeof(dec));
+    PngImage* png = calloc(1, sizeof(PngImage));
+    if (png && decode_image(&dec, data, size, options, png, false) != 0) {
+        png_destroy(png);
+        png = NULL;
+    }
+    decoder_release(&dec);
+    return png;
+}
+
+PngDecoder*
+png_decoder_create(void)
+{
+    return calloc(1, sizeof(PngDecoder));
+}
+
+void
+png_decoder_destroy(PngDecoder* dec)
+{
+    if (dec) {
+        decoder_release(dec);
+        free(dec);
+    }
+}
+
+int
+png_decode_into(PngDecoder* dec, const unsigned char* data, size_t size, const PngDecodeOptions* options, PngImage* out)
+{
+    arena_reset(&dec->arena);
+    memset(out, 0, sizeof(*out));
+    return decode_image(dec, data, size, options, out, true);
+}
+
+const char*
+png_decoder_error(const PngDecoder* dec)
+{
+    return dec->error;
+}
+
+void
+png_stats_add(PngStats* total, const PngStats* stats)
+{
+    total->read_seconds += stats->read_seconds;
+    total->parse_seconds += stats->parse_seconds;
+    total->crc_seconds += stats->crc_seconds;
+    total->inflate_seconds += stats->inflate_seconds;
+    total->unfilter_seconds += stats->unfilter_seconds;
+    total->place_seconds += stats->place_seconds;
+    total->write_seconds += stats->write_seconds;
+    total->total_seconds += stats->total_seconds;
+    total->images += stats->images;
+    total->bytes_in += stats->bytes_in;
+    total->bytes_inflated += stats->bytes_inflated;
+    total->bytes_out += stats->bytes_out;
+    total->chunks += stats->chunks;
+    total->idat_chunks += stats->idat_chunks;
+    if (stats->peak_buffer_bytes > total->peak_buffer_bytes) total->peak_buffer_bytes = stats->peak_buffer_bytes;
+    for (int f = 0; f < PNG_FILTER_TYPES; f++) total->filter_rows[f] += stats->filter_rows[f];
+    total->cache_hits += stats->cache_hits;
+    total->cache_misses += stats->cache_misses;
+}
+
+/* Un objet JSON sur une ligne, pour les outils de suivi. */
+void
+png_stats_write_json(FILE* out, const PngStats* stats)
+{
+    static const char* filter_names[PNG_FILTER_TYPES] = { "none", "sub", "up", "average", "paeth" };
+    fprintf(out, "{\"images\":%llu,\"seconds\":{\"read\":%.6f,\"parse\":%.6f,\"crc\":%.6f,\"inflate\":%.6f,\"unfilter\":%.6f,"
+                 "\"place\":%.6f,\"write\":%.6f,\"total\":%.6f},",
+            (unsigned long long)stats->images, stats->read_seconds, stats->parse_seconds, stats->crc_seconds, stats->inflate_seconds,
+            stats->unfilter_seconds, stats->place_seconds, stats->write_seconds, stats->total_seconds);
+    fprintf(out, "\"bytes\":{\"in\":%llu,\"inflated\":%llu,\"out\":%llu,\"peak_buffers\":%llu},\"chunks\":{\"total\":%llu,\"idat\":%llu},\"filters\":{",
+            (unsigned long long)stats->bytes_in, (unsigned long long)stats->bytes_inflated, (unsigned long long)stats->bytes_out,
+            (unsigned long long)stats->peak_buffer_bytes, (unsigned long long)stats->chunks, (unsigned long long)stats->idat_chunks);
+    for (int f = 0; f < PNG_FILTER_TYPES; f++) fprintf(out, "%s\"%s\":%llu", f ? "," : "", filter_names[f], (unsigned long long)stats->filter_rows[f]);
+    fprintf(out, "},\"cache\":{\"hits\":%llu,\"misses\":%llu},\"adam7_passes\":[",
+            (unsigned long long)stats->cache_hits, (unsigned long long)stats->cache_misses);
+    for (uint32_t i = 0; i < stats->pass_count && i < 7; i++) fprintf(out, "%s{\"width\":%u,\"height\":%u}", i ? "," : "", stats->pass_width[i], stats->pass_height[i]);
+    fprintf(out, "]}\n");
+}
+
+size_t
+fweight(FILE *fptr)
+{
+    long fsize;
+    fseek(fptr, 0, SEEK_END);
+    fsize = ftell(fptr);
+    rewind(fptr);
+    if (fsize < 0) {
+        return 0;
+    }
+    return (size_t)fsize;
+}
+
+/* Ne ferme jamais fptr : l'appelant reste propriétaire du FILE*. */
+unsigned char *
+_fread(FILE *fptr, size_t fsize)
+{
+    unsigned char *buffer;
+    size_t buffer_size;
+    buffer = malloc(fsize);
+    if (!buffer) {
+        return NULL;
+    }
+    buffer_size = fread(buffer, 1, fsize, fptr);
+    if (buffer_size != fsize) {
+        free(buffer);
+        return NULL;
+    }
+    return buffer;
+}
+
+int
+png_read_stream(FILE *fptr, PngFileMap* map)
+{
+    memset(map, 0, sizeof(*map));
+    unsigned char *buffer = NULL;
+    size_t size = 0, capacity = 0;
+    for (;;) {
+        if (size == capacity) {
+            capacity = capacity ? capacity * 2 : 65536;
+            unsigned char *grown = realloc(buffer, capacity);
+            if (!grown) {
+                free(buffer);
+                return -1;
+            }
+            buffer = grown;
+        }
+        size_t got = fread(buffer + size, 1, capacity - size, fptr);
+        if (got == 0) break;
+        size += got;
+    }
+    if (ferror(fptr) || size == 0) {
+        free(buffer);
+        return -1;
+    }
+    map->data = buffer;
+    map->size = size;
+    return 0;
+}
+
+int
+png_map_file(const char *fname, PngFileMap* map)
+{
+    memset(map, 0, sizeof(*map));
+#ifndef _WIN32
+    int fd = open(fname, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void* view = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (view != MAP_FAILED) {
+            /* Lecture strictement séquentielle : lecture anticipée agressive, pages libérées derrière nous. */
+            posix_madvise(view, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+            map->data = view;
+            map->size = (size_t)st.st_size;
+            map->mapped = true;
+            close(fd);
+            return 0;
+        }
+    }
+    close(fd);
+#endif
+    /* Repli (Windows, tubes, fichiers spéciaux) : lecture complète en mémoire. */
+    FILE *fptr = fopen(fname, "rb");
+    if (!fptr) {
+        return -1;
+    }
+    size_t fsize = fweight(fptr);
+    if (fsize == 0) {
+        /* Taille inconnue (tube nommé) : lecture jusqu'à la fin du flux. */
+        int status = png_read_stream(fptr, map);
+        fclose(fptr);
+        return status;
+    }
+    unsigned char *buffer = _fread(fptr, fsize);
+    fclose(fptr);
+    if (!buffer) {
+        return -1;
+    }
+    map->data = buffer;
+    map->size = fsize;
+    return 0;
+}
+
+void
+png_unmap_file(PngFileMap* map)
+{
+#ifndef _WIN32
+    if (map->mapped) munmap((void*)map->data, map->size);
+    else
+#endif
+    free((void*)map->data);
+    memset(map, 0, sizeof(*map));
+}
+
+PngImage*
+png_load_from_file(const char *fname)
+{
+    return png_load_from_file_ex(fname, NULL);
+}
+
+PngImage*
+png_load_from_file_ex(const char *fname, const PngDecodeOptions* options)
+{
+    PngFileMap map;
+    PngImage* img;
+    PngStats* stats = options ? options->stats : NULL;
+    double start = stats ? monotonic_seconds() : 0.0;
+
+    if (png_map_file(fname, &map) != 0) {
+        return NULL;
+    }
+    if (stats) {
+        double elapsed = monotonic_seconds() - start;
+        stats->read_seconds += elapsed;
+        stats->total_seconds += elapsed;
+    }
+    img = png_load_from_data_ex(map.data, map.size, options);
+    png_unmap_file(&map);
+    return img;
+}
+
+typedef struct PngRowStream {
+    PngImage* png;
+    const PngRowSink* sink;
+    z_stream zs;
+    int pass;
+    uint32_t pass_width, pass_height, row;
+    size_t stride, filter_bpp, raw_fill;
+    unsigned char* raw_row;
+    unsigned char* cur_row;
+    unsigned char* prev_row;
+    unsigned char* rgb_row;
+    unsigned char* canvas;
+    size_t buffer_bytes;
+    bool done;
+    PngConverter converter;
+    RGBA index_colors[256];
+    PngStats* stats;
+} PngRowStream;
+
+static void row_stream_next_pass(PngRowStream* rs) {
+    PngImage* png = rs->png;
+    rs->row = 0; rs->raw_fill = 0;
+    while (png->interlace_method != 0 && ++rs->pass < 7) {
+        rs->pass_width = (png->width - adam7_start_x[rs->pass] + adam7_step_x[rs->pass] - 1) / adam7_step_x[rs->pass];
+        rs->pass_height = (png->height - adam7_start_y[rs->pass] + adam7_step_y[rs->pass] - 1) / adam7_step_y[rs->pass];
+        if (rs->pass_width != 0 && rs->pass_height != 0) { rs->stride = row_stride(png, rs->pass_width); return; }
+    }
+    rs->done = true;
+}
+
+static int row_stream_begin(PngRowStream* rs, PngImage* png, const PngDecodeOptions* options, const PngRowSink* sink) {
+    memset(rs, 0, sizeof(*rs));
+    rs->png = png; rs->sink = sink; rs->pass = -1; rs->stats = options->stats;
+    if (png->width == 0 || png->height == 0) return -1;
+    resolve_output(png, options->format, false, false);
+    if (png_converter_init(&rs->converter, png, options->background, NULL) != 0) return -1;
+    if (png->pixel_format == PNG_FORMAT_BMP_INDEXED) store_index_colors(png, &rs->converter, rs->index_colors);
+    size_t full_stride = row_stride(png, png->width);
+    rs->filter_bpp = get_source_bytes_per_pixel(png->color_type, png->bit_depth);
+    rs->raw_row = malloc(full_stride + 1);
+    rs->cur_row = malloc(full_stride);
+    rs->prev_row = malloc(full_stride);
+    rs->rgb_row = malloc((size_t)png->width * png->bytes_per_pixel + 8);
+    if (png->interlace_method != 0) {
+        rs->canvas = calloc((size_t)png->width * png->height, png->bytes_per_pixel);
+        if (!rs->canvas) return -1;
+    }
+    if (!rs->raw_row || !rs->cur_row || !rs->prev_row || !rs->rgb_row) return -1;
+    rs->buffer_bytes = full_stride * 3 + 1 + (size_t)png->width * png->bytes_per_pixel * (png->interlace_method != 0 ? (size_t)png->height + 1 : 1);
+    if (rs->stats) stats_record_passes(rs->stats, png);
+    if (inflateInit(&rs->zs) != Z_OK) return -1;
+    if (png->interlace_method == 0) { rs->pass_width = png->width; rs->pass_height = png->height; rs->stride = full_stride; }
+    else row_stream_next_pass(rs);
+    if (sink->begin && sink->begin(sink->user, png) != 0) return -1;
+    return 0;
+}
+
+static int row_stream_emit(PngRowStream* rs) {
+    PngImage* png = rs->png;
+    const unsigned char* prev = (rs->row == 0) ? NULL : rs->prev_row;
+    if (rs->stats) {
+        if (rs->raw_row[0] < PNG_FILTER_TYPES) rs->stats->filter_rows[rs->raw_row[0]]++;
+        rs->stats->bytes_inflated += rs->stride + 1;
+    }
+    if (png_unfilter_row(rs->raw_row[0], rs->raw_row + 1, rs->cur_row, prev, rs->stride, rs->filter_bpp) != 0) return -1;
+    if (rs->pass == -1) {
+        rs->converter.convert(&rs->converter, rs->cur_row, rs->pass_width, rs->rgb_row, png->bytes_per_pixel);
+        if (rs->sink->row(rs->sink->user, rs->row, rs->rgb_row) != 0) return -1;
+    } else {
+        uint32_t final_y = rs->row * adam7_step_y[rs->pass] + adam7_start_y[rs->pass];
+        unsigned char* out_row = rs->canvas + ((size_t)final_y * png->width + adam7_start_x[rs->pass]) * png->bytes_per_pixel;
+        rs->converter.convert(&rs->converter, rs->cur_row, rs->pass_width, out_row, (size_t)adam7_step_x[rs->pass] * png->bytes_per_pixel);
+    }
+    unsigned char* tmp = rs->prev_row; rs->prev_row = rs->cur_row; rs->cur_row = tmp;
+    rs->raw_fill = 0;
+    if (++rs->row == rs->pass_height) row_stream_next_pass(rs);
+    return 0;
+}
+
+static int row_stream_feed(PngRowStream* rs, const unsigned char* data, size_t length) {
+    rs->zs.next_in = (Bytef*)data;
+    rs->zs.avail_in = (uInt)length;
+    while (rs->zs.avail_in > 0 && !rs->done) {
+        rs->zs.next_out = rs->raw_row + rs->raw_fill;
+        rs->zs.avail_out = (uInt)(rs->stride + 1 - rs->raw_fill);
+        int ret = inflate(&rs->zs, Z_NO_FLUSH);
+        if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) return -1;
+        rs->raw_fill = rs->stride + 1 - rs->zs.avail_out;
+        if (rs->raw_fill == rs->stride + 1 && row_stream_emit(rs) != 0) return -1;
+        if (ret == Z_STREAM_END || ret == Z_BUF_ERROR) break;
+    }
+    return 0;
+}
+
+static int row_stream_finish(PngRowStream* rs) {
+    PngImage* png = rs->png;
+    if (!rs->done) return -1;
+    if (rs->canvas) {
+        for (uint32_t y = 0; y < png->height; y++) {
+            if (rs->sink->row(rs->sink->user, y, rs->canvas + (size_t)y * png->width * png->bytes_per_pixel) != 0) return -1;
+        }
+    }
+    return 0;
+}
+
+static void row_stream_release(PngRowStream* rs) {
+    inflateEnd(&rs->zs);
+    free(rs->raw_row); free(rs->cur_row); free(rs->prev_row); free(rs->rgb_row); free(rs->canvas);
+}
+
+int
+png_stream_from_file(const char *fname, const PngDecodeOptions* options, const PngRowSink* sink)
+{
+    PngDecodeOptions defaults;
+    if (!options) { png_options_init(&defaults); options = &defaults; }
+    const uint8_t png_sig_bytes[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+    unsigned char header[8];
+    unsigned char* chunk_buffer = NULL;
+    size_t chunk_capacity = 0;
+    PngImage png;
+    PngRowStream rs;
+    bool started = false;
+    int status = -1;
+    PngStats* stats = options->stats;
+    double start = stats ? monotonic_seconds() : 0.0;
+    if (options->thumbnail_scale != 0 || options->crop.width != 0 || resize_requested(&options->resize)) return -1;
+    png_unfilter_ensure_init();
+
+    FILE* fptr = fopen(fname, "rb");
+    if (!fptr) {
+        return -1;
+    }
+    memset(&png, 0, sizeof(png));
+    png.file_gamma = 2.2f;
+    if (fread(header, 1, 8, fptr) != 8 || memcmp(header, png_sig_bytes, 8) != 0) goto cleanup;
+    if (stats) stats->bytes_in += 8;
+    while (fread(header, 1, 8, fptr) == 8) {
+        uint32_t chunk_length = read_be32(header);
+        const unsigned char* chunk_type = header + 4;
+        bool is_idat = strncmp((const char*)chunk_type, "IDAT", 4) == 0;
+        if (stats) { stats->bytes_in += 12 + (uint64_t)chunk_length; stats->chunks++; stats->idat_chunks += is_idat; }
+        size_t block = is_idat ? PNG_STREAM_BLOCK_SIZE : chunk_length;
+        if (block > chunk_capacity || chunk_buffer == NULL) {
+            unsigned char* grown = realloc(chunk_buffer, block ? block : 1);
+            if (!grown) goto cleanup;
+            chunk_buffer = grown; chunk_capacity = block;
+        }
+        if (is_idat && !started) {
+            if (row_stream_begin(&rs, &png, options, sink) != 0) { started = true; goto cleanup; }
+            started = true;
+        }
+        uLong calculated_crc = crc32(0L, chunk_type, 4);
+        uint32_t remaining = chunk_length;
+        do {
+            size_t n = remaining < chunk_capacity ? remaining : chunk_capacity;
+            if (fread(chunk_buffer, 1, n, fptr) != n) goto cleanup;
+            calculated_crc = crc32(calculated_crc, chunk_buffer, (uInt)n);
+            if (is_idat && row_stream_feed(&rs, chunk_buffer, n) != 0) goto cleanup;
+            remaining -= (uint32_t)n;
+        } while (remaining > 0);
+        unsigned char crc_bytes[4];
+        if (fread(crc_bytes, 1, 4, fptr) != 4 || calculated_crc != read_be32(crc_bytes)) goto cleanup;
+        if (strncmp((const char*)chunk_type, "IEND", 4) == 0) break;
+        if (!is_idat && started && sizing_chunk(chunk_type)) goto cleanup;
+        if (!is_idat && parse_header_chunk(&png, NULL, chunk_type, chunk_buffer, chunk_length) != 0) goto cleanup;
+    }
+    if (started) status = row_stream_finish(&rs);
+cleanup:
+    if (started) row_stream_release(&rs);
+    free(chunk_buffer);
+    free(png.palette);
+    fclose(fptr);
+    if (stats) {
+        stats_record_peak(stats, (started ? rs.buffer_bytes : 0) + chunk_capacity);
+        stats->total_seconds += monotonic_seconds() - start;
+        if (status == 0) stats->images++;
+    }
+    return status;
+}
+
+static void place_pixels(PngImage* png, const PngConverter* conv, const unsigned char* pass_pixels, int pass_index, uint32_t pass_width, uint32_t pass_height, uint32_t y_begin, uint32_t y_end) 
+{
+    size_t stride = row_stride(png, pass_width);
+    uint32_t py_begin = y_begin, py_end = y_end;
+    if (pass_index != -1) {
+        uint32_t start = adam7_start_y[pass_index], step = adam7_step_y[pass_index];
+        py_begin = y_begin <= start ? 0 : (y_begin - start + step - 1) / step;
+        py_end = y_end <= start ? 0 : (y_end - start + step - 1) / step;
+    }
+    if (py_end > pass_height) py_end = pass_height;
+    for (uint32_t py = py_begin; py < py_end; py++) {
+        uint32_t final_y = (pass_index == -1) ? py : py * adam7_step_y[pass_index] + adam7_start_y[pass_index];
+        uint32_t start_x = (pass_index == -1) ? 0 : adam7_start_x[pass_index];
+        size_t step = (pass_index == -1) ? png->bytes_per_pixel : (size_t)adam7_step_x[pass_index] * png->bytes_per_pixel;
+        unsigned char* out_row = row_pointer(png, final_y) + (size_t)start_x * png->bytes_per_pixel;
+        conv->convert(conv, pass_pixels + py * stride, pass_width, out_row, step);
+    }
+}
+
+static unsigned char* row_pointer(const PngImage* png, uint32_t y) {
+    uint32_t row = png->pixel_format != PNG_FORMAT_RGB ? png->height - 1 - y : y;
+    return png->final_pixel_data + (size_t)row * png->row_size;
+}
+static size_t get_source_bytes_per_pixel(uint8_t color_type, uint8_t bit_depth) { if (bit_depth < 8) return 1; size_t bytes = bit_depth / 8; switch(color_type){ case 2: return bytes * 3; case 4: return bytes * 2; case 6: return bytes * 4; default: return bytes; }}
+static size_t row_stride(const PngImage* png, uint32_t width) { return ((size_t)width * png->bit_depth * get_source_bytes_per_pixel(png->color_type, 8) + 7) / 8; }
+static int unfilter_pass(const PngImage* png, const unsigned char* src, unsigned char* dst, uint32_t pass_width, uint32_t pass_height, uint64_t* filter_rows) {
+    size_t stride = row_stride(png, pass_width);
+    if (stride == 0) return 0;
+    size_t filter_bpp = get_source_bytes_per_pixel(png->color_type, png->bit_depth);
+    for (uint32_t y = 0; y < pass_height; y++) {
+        uint8_t filter_type = *src++;
+        if (filter_type < PNG_FILTER_TYPES) filter_rows[filter_type]++;
+        const unsigned char* prev_line = (y == 0) ? NULL : (dst - stride);
+        if (png_unfilter_row(filter_type, src, dst, prev_line, stride, filter_bpp) != 0) return -1;
+        src += stride; dst += stride;
+    }
+    return 0;
+}
+/* Lecture octet par octet : les champs des chunks ne sont pas alignés. */
+static uint32_t read_be32(const unsigned char* p) { return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3]; }
+static uint16_t read_be16(const unsigned char* p) { return (uint16_t)((p[0] << 8) | p[1]); }
\ No newline at end of file
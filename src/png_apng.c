@@ -0,0 +1,538 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <zlib.h>
+#include <pthread.h>
+
+#include "../headers/png_apng.h"
+#include "../headers/png.h"
+#include "../headers/png_composite.h"
+#include "../headers/png_to_bmp.h"
+#include "../headers/logger.h"
+
+/* Images décodées d'avance par thread, au-delà de celle qui attend d'être composée. */
+#define APNG_FRAMES_AHEAD_PER_THREAD 2
+#define APNG_MAX_THREADS 256
+
+typedef enum ApngFrameState {
+    APNG_FRAME_PENDING = 0,
+    APNG_FRAME_DECODING,
+    APNG_FRAME_READY,
+    APNG_FRAME_FAILED
+} ApngFrameState;
+
+/* Données compressées d'une image : IDAT entiers ou contenu des fdAT sans leur numéro de séquence. */
+typedef struct ApngSpan {
+    const unsigned char* data;
+    uint32_t length;
+} ApngSpan;
+
+typedef struct ApngFrameData {
+    PngApngFrame control;
+    size_t first_span, span_count;
+    size_t compressed_size;
+    ApngFrameState state;
+    char error[128];
+} ApngFrameData;
+
+/* Pixels BGRA d'une image décodée (de bas en haut), réutilisés toutes les window images. */
+typedef struct ApngSlot {
+    unsigned char* pixels;
+    size_t capacity;
+    float gamma;
+} ApngSlot;
+
+typedef struct ApngAnimation {
+    const unsigned char* ihdr;
+    uint32_t width, height, play_count;
+    bool animated;
+    /* PLTE, tRNS et gAMA recopiés tels quels (longueur, type, données, CRC) devant chaque image. */
+    ApngSpan header_chunks[3];
+    int header_chunk_count;
+    ApngFrameData* frames;
+    uint32_t frame_count, frame_capacity;
+    ApngSpan* spans;
+    size_t span_count, span_capacity;
+} ApngAnimation;
+
+typedef struct ApngRun {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    ApngAnimation* anim;
+    PngDecodeOptions options;
+    ApngSlot* slots;
+    uint32_t window;
+    uint32_t next_decode;
+    uint32_t composited;
+    bool aborted;
+    /* Sortie 24 bits composée sur le fond. */
+    bool flat;
+} ApngRun;
+
+typedef struct ApngWorker {
+    ApngRun* run;
+    pthread_t thread;
+    PngDecoder* decoder;
+    unsigned char* png;
+    size_t png_capacity;
+    PngStats stats;
+} ApngWorker;
+
+static uint32_t read_be32(const unsigned char* p) { return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3]; }
+static uint16_t read_be16(const unsigned char* p) { return (uint16_t)((p[0] << 8) | p[1]); }
+
+static void write_be32(unsigned char* p, uint32_t v) {
+    p[0] = (unsigned char)(v >> 24); p[1] = (unsigned char)(v >> 16); p[2] = (unsigned char)(v >> 8); p[3] = (unsigned char)v;
+}
+
+static int add_span(ApngAnimation* anim, const unsigned char* data, uint32_t length) {
+    if (anim->span_count == anim->span_capacity) {
+        size_t grown = anim->span_capacity ? anim->span_capacity * 2 : 64;
+        ApngSpan* spans = realloc(anim->spans, grown * sizeof(ApngSpan));
+        if (!spans) return -1;
+        anim->spans = spans;
+        anim->span_capacity = grown;
+    }
+    anim->spans[anim->span_count].data = data;
+    anim->spans[anim->span_count].length = length;
+    anim->span_count++;
+    ApngFrameData* frame = &anim->frames[anim->frame_count - 1];
+    frame->span_count++;
+    frame->compressed_size += length;
+    return 0;
+}
+
+static int add_frame(ApngAnimation* anim, const PngApngFrame* control) {
+    if (anim->frame_count == anim->frame_capacity) {
+        uint32_t grown = anim->frame_capacity ? anim->frame_capacity * 2 : 16;
+        ApngFrameData* frames = realloc(anim->frames, grown * sizeof(ApngFrameData));
+        if (!frames) return -1;
+        anim->frames = frames;
+        anim->frame_capacity = grown;
+    }
+    ApngFrameData* frame = &anim->frames[anim->frame_count++];
+    memset(frame, 0, sizeof(*frame));
+    frame->control = *control;
+    frame->first_span = anim->span_count;
+    return 0;
+}
+
+static void animation_free(ApngAnimation* anim) {
+    free(anim->frames);
+    free(anim->spans);
+}
+
+/* Relève les images et leurs données sans rien décompresser. Les numéros de séquence des fcTL et fdAT doivent se
+   suivre à partir de 0 ; une image fcTL placée avant le premier IDAT a l'image par défaut pour données. */
+static const char* parse_animation(ApngAnimation* anim, const unsigned char* data, size_t size) {
+    static const unsigned char signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+    memset(anim, 0, sizeof(*anim));
+    if (size < 8 || memcmp(data, signature, 8) != 0) return "signature PNG absente";
+    const unsigned char* cursor = data + 8;
+    const unsigned char* end = data + size;
+    uint32_t sequence = 0;
+    bool seen_idat = false, idat_frame = false, ended = false;
+    while (!ended && (size_t)(end - cursor) >= 12) {
+        uint32_t length = read_be32(cursor);
+        const unsigned char* type = cursor + 4;
+        const unsigned char* body = cursor + 8;
+        if (length > (size_t)(end - cursor) - 12) return "chunk tronqué";
+        if (crc32(crc32(0L, type, 4), body, length) != read_be32(body + length)) return "CRC incorrect";
+        const unsigned char* chunk = cursor;
+        cursor += 12 + (size_t)length;
+        if (memcmp(type, "IHDR", 4) == 0) {
+            /* Canevas et en-tête des images synthétisées : un seul IHDR, avant les données. */
+            if (length != 13 || anim->ihdr || seen_idat) return "en-tête IHDR invalide";
+            anim->ihdr = body;
+            anim->width = read_be32(body);
+            anim->height = read_be32(body + 4);
+            if (anim->width == 0 || anim->height == 0) return "en-tête IHDR invalide";
+        } else if (memcmp(type, "acTL", 4) == 0) {
+            if (length != 8 || seen_idat) return "chunk acTL invalide";
+            anim->animated = true;
+            anim->play_count = read_be32(body + 4);
+        } else if (memcmp(type, "fcTL", 4) == 0) {
+            if (!anim->animated) continue;
+            if (length != 26 || !anim->ihdr) return "chunk fcTL invalide";
+            if (read_be32(body) != sequence++) return "numéros de séquence APNG désordonnés";
+            PngApngFrame control;
+            control.width = read_be32(body + 4);
+            control.height = read_be32(body + 8);
+            control.x_offset = read_be32(body + 12);
+            control.y_offset = read_be32(body + 16);
+            control.delay_num = read_be16(body + 20);
+            control.delay_den = read_be16(body + 22);
+            control.dispose_op = body[24];
+            control.blend_op = body[25];
+            if (control.width == 0 || control.height == 0 || control.x_offset > anim->width - control.width || control.width > anim->width
+                || control.y_offset > anim->height - control.height || control.height > anim->height) return "image hors du canevas";
+            if (control.dispose_op > PNG_APNG_DISPOSE_PREVIOUS || control.blend_op > PNG_APNG_BLEND_OVER) return "dispose_op ou blend_op invalide";
+            /* L'image par défaut couvre tout le canevas. */
+            if (!seen_idat && (control.x_offset != 0 || control.y_offset != 0 || control.width != anim->width || control.height != anim->height)) return "première image différente du canevas";
+            if (anim->frame_count > 0 && anim->frames[anim->frame_count - 1].span_count == 0) return "image sans données";
+            if (add_frame(anim, &control) != 0) return "mémoire insuffisante";
+            idat_frame = !seen_idat;
+        } else if (memcmp(type, "IDAT", 4) == 0) {
+            if (!anim->ihdr) return "en-tête IHDR absent";
+            if (!seen_idat && !anim->animated) {
+                /* PNG fixe : une seule image, celle par défaut. */
+                PngApngFrame control = { anim->width, anim->height, 0, 0, 0, 1, PNG_APNG_DISPOSE_NONE, PNG_APNG_BLEND_SOURCE };
+                if (add_frame(anim, &control) != 0) return "mémoire insuffisante";
+                idat_frame = true;
+            }
+            seen_idat = true;
+            if (idat_frame && add_span(anim, body, length) != 0) return "mémoire insuffisante";
+        } else if (memcmp(type, "fdAT", 4) == 0) {
+            if (!anim->animated) continue;
+            if (length < 4 || anim->frame_count == 0 || idat_frame) return "chunk fdAT invalide";
+            if (read_be32(body) != sequence++) return "numéros de séquence APNG désordonnés";
+            if (add_span(anim, body + 4, length - 4) != 0) return "mémoire insuffisante";
+        } else if (memcmp(type, "IEND", 4) == 0) {
+            ended = true;
+        } else if (!seen_idat && (memcmp(type, "PLTE", 4) == 0 || memcmp(type, "tRNS", 4) == 0 || memcmp(type, "gAMA", 4) == 0)) {
+            if (anim->header_chunk_count < 3) {
+                anim->header_chunks[anim->header_chunk_count].data = chunk;
+                anim->header_chunks[anim->header_chunk_count].length = 12 + length;
+                anim->header_chunk_count++;
+            }
+        }
+        if (memcmp(type, "IDAT", 4) != 0 && seen_idat) idat_frame = false;
+    }
+    if (!seen_idat) return "aucun chunk IDAT";
+    if (anim->frame_count == 0) return "aucune image";
+    if (anim->frames[anim->frame_count - 1].span_count == 0) return "image sans données";
+    return NULL;
+}
+
+static unsigned char* put_chunk(unsigned char* p, const char* type, const unsigned char* body, uint32_t length) {
+    write_be32(p, length);
+    memcpy(p + 4, type, 4);
+    if (length) memcpy(p + 8, body, length);
+    write_be32(p + 8 + length, (uint32_t)crc32(crc32(0L, p + 4, 4), p + 8, length));
+    return p + 12 + length;
+}
+
+/* PNG autonome de l'image : IHDR aux dimensions de l'image, PLTE/tRNS/gAMA d'origine, un seul IDAT. */
+static int build_frame_png(ApngWorker* worker, const ApngAnimation* anim, const ApngFrameData* frame, size_t* size) {
+    static const unsigned char signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+    size_t needed = 8 + 25 + 12 + frame->compressed_size + 12;
+    for (int i = 0; i < anim->header_chunk_count; i++) needed += anim->header_chunks[i].length;
+    if (needed > worker->png_capacity) {
+        unsigned char* grown = realloc(worker->png, needed);
+        if (!grown) return -1;
+        worker->png = grown;
+        worker->png_capacity = needed;
+    }
+    unsigned char* p = worker->png;
+    unsigned char ihdr[13];
+    memcpy(ihdr, anim->ihdr, 13);
+    write_be32(ihdr, frame->control.width);
+    write_be32(ihdr + 4, frame->control.height);
+    memcpy(p, signature, 8);
+    p = put_chunk(p + 8, "IHDR", ihdr, 13);
+    for (int i = 0; i < anim->header_chunk_count; i++) {
+        memcpy(p, anim->header_chunks[i].data, anim->header_chunks[i].length);
+        p += anim->header_chunks[i].length;
+    }
+    unsigned char* idat = p;
+    p += 8;
+    for (size_t i = 0; i < frame->span_count; i++) {
+        const ApngSpan* span = &anim->spans[frame->first_span + i];
+        memcpy(p, span->data, span->length);
+        p += span->length;
+    }
+    write_be32(idat, (uint32_t)frame->compressed_size);
+    memcpy(idat + 4, "IDAT", 4);
+    write_be32(p, (uint32_t)crc32(crc32(0L, idat + 4, 4), idat + 8, (uInt)frame->compressed_size));
+    p = put_chunk(p + 4, "IEND", NULL, 0);
+    *size = (size_t)(p - worker->png);
+    return 0;
+}
+
+static unsigned char* slot_allocate(void* user, const PngImage* png, size_t size) {
+    ApngSlot* slot = user;
+    (void)png;
+    if (size > slot->capacity) {
+        unsigned char* grown = realloc(slot->pixels, size);
+        if (!grown) return NULL;
+        slot->pixels = grown;
+        slot->capacity = size;
+    }
+    return slot->pixels;
+}
+
+static void decode_frame(ApngWorker* worker, uint32_t index) {
+    ApngRun* run = worker->run;
+    ApngFrameData* frame = &run->anim->frames[index];
+    ApngSlot* slot = &run->slots[index % run->window];
+    PngDecodeOptions options = run->options;
+    options.allocate = slot_allocate;
+    options.allocate_user = slot;
+    options.stats = run->options.stats ? &worker->stats : NULL;
+    PngImage img;
+    size_t size = 0;
+    ApngFrameState state = APNG_FRAME_READY;
+    if (build_frame_png(worker, run->anim, frame, &size) != 0) {
+        snprintf(frame->error, sizeof(frame->error), "mémoire insuffisante");
+        state = APNG_FRAME_FAILED;
+    } else if (png_decode_into(worker->decoder, worker->png, size, &options, &img) != 0) {
+        snprintf(frame->error, sizeof(frame->error), "%s", png_decoder_error(worker->decoder));
+        state = APNG_FRAME_FAILED;
+    } else {
+        slot->gamma = img.file_gamma;
+    }
+    pthread_mutex_lock(&run->lock);
+    frame->state = state;
+    pthread_cond_broadcast(&run->changed);
+    pthread_mutex_unlock(&run->lock);
+}
+
+/* Prend la prochaine image à décoder dès que son emplacement est libre ; false quand il n'y en a plus. */
+static bool claim_frame(ApngRun* run, uint32_t* index) {
+    pthread_mutex_lock(&run->lock);
+    while (!run->aborted && run->next_decode < run->anim->frame_count && run->next_decode >= run->composited + run->window) {
+        pthread_cond_wait(&run->changed, &run->lock);
+    }
+    bool found = !run->aborted && run->next_decode < run->anim->frame_count;
+    if (found) {
+        *index = run->next_decode++;
+        run->anim->frames[*index].state = APNG_FRAME_DECODING;
+    }
+    pthread_mutex_unlock(&run->lock);
+    return found;
+}
+
+static void* frame_worker(void* arg) {
+    ApngWorker* worker = arg;
+    uint32_t index;
+    while (claim_frame(worker->run, &index)) decode_frame(worker, index);
+    return NULL;
+}
+
+/* Attend l'image index ; la décode soi-même si aucun thread ne l'a encore prise. */
+static ApngFrameState wait_frame(ApngWorker* self, uint32_t index) {
+    ApngRun* run = self->run;
+    ApngFrameData* frame = &run->anim->frames[index];
+    pthread_mutex_lock(&run->lock);
+    if (run->next_decode == index) {
+        run->next_decode++;
+        frame->state = APNG_FRAME_DECODING;
+        pthread_mutex_unlock(&run->lock);
+        decode_frame(self, index);
+        pthread_mutex_lock(&run->lock);
+    }
+    while (frame->state == APNG_FRAME_PENDING || frame->state == APNG_FRAME_DECODING) pthread_cond_wait(&run->changed, &run->lock);
+    ApngFrameState state = frame->state;
+    pthread_mutex_unlock(&run->lock);
+    return state;
+}
+
+/* Canevas et images en BGRA de bas en haut. Ligne y (depuis le haut) de la région de l'image dans le canevas. */
+static unsigned char* canvas_row(unsigned char* canvas, const ApngAnimation* anim, const PngApngFrame* control, uint32_t y) {
+    return canvas + ((size_t)(anim->height - 1 - control->y_offset - y) * anim->width + control->x_offset) * 4;
+}
+
+static void blend_frame(unsigned char* canvas, const ApngAnimation* anim, const PngApngFrame* control, const unsigned char* pixels) {
+    const size_t row_bytes = (size_t)control->width * 4;
+    for (uint32_t y = 0; y < control->height; y++) {
+        unsigned char* dst = canvas_row(canvas, anim, control, y);
+        const unsigned char* src = pixels + (size_t)(control->height - 1 - y) * row_bytes;
+        if (control->blend_op == PNG_APNG_BLEND_SOURCE) {
+            memcpy(dst, src, row_bytes);
+            continue;
+        }
+        for (uint32_t x = 0; x < control->width; x++, src += 4, dst += 4) {
+            const uint32_t sa = src[3];
+            if (sa == 255) { memcpy(dst, src, 4); continue; }
+            if (sa == 0) continue;
+            /* Opérateur "over" en alpha non prémultiplié. */
+            const uint32_t u = sa * 255, v = (255 - sa) * dst[3], total = u + v;
+            for (int c = 0; c < 3; c++) dst[c] = (unsigned char)((src[c] * u + dst[c] * v + total / 2) / total);
+            dst[3] = (unsigned char)((total + 127) / 255);
+        }
+    }
+}
+
+static void copy_region(unsigned char* canvas, const ApngAnimation* anim, const PngApngFrame* control, unsigned char* saved, bool save) {
+    const size_t row_bytes = (size_t)control->width * 4;
+    for (uint32_t y = 0; y < control->height; y++) {
+        unsigned char* row = canvas_row(canvas, anim, control, y);
+        if (save) memcpy(saved + y * row_bytes, row, row_bytes);
+        else memcpy(row, saved + y * row_bytes, row_bytes);
+    }
+}
+
+static void clear_region(unsigned char* canvas, const ApngAnimation* anim, const PngApngFrame* control) {
+    for (uint32_t y = 0; y < control->height; y++) memset(canvas_row(canvas, anim, control, y), 0, (size_t)control->width * 4);
+}
+
+/* Canevas BGRA composé sur le fond en BGR 24 bits, avec les tables du décodeur (gamma du fichier). */
+static void flatten_canvas(const PngCompositor* compositor, const unsigned char* canvas, const PngImage* out, uint32_t width) {
+    for (uint32_t y = 0; y < out->height; y++) {
+        const unsigned char* src = canvas + (size_t)y * width * 4;
+        unsigned char* dst = out->final_pixel_data + (size_t)y * out->row_size;
+        for (uint32_t x = 0; x < width; x++, src += 4, dst += 3) png_composite_pixel(compositor, src[0], src[1], src[2], src[3], dst);
+        memset(dst, 0, out->row_size - (size_t)width * 3);
+    }
+}
+
+static int compose_frames(Logger* logger, ApngRun* run, ApngWorker* self, PngApngSink sink, void* user) {
+    ApngAnimation* anim = run->anim;
+    const bool flat = run->flat;
+    const size_t canvas_size = (size_t)anim->width * anim->height * 4;
+    unsigned char* canvas = calloc(1, canvas_size);
+    unsigned char* saved = malloc(canvas_size);
+    PngImage out;
+    memset(&out, 0, sizeof(out));
+    out.width = anim->width;
+    out.height = anim->height;
+    out.pixel_format = flat ? PNG_FORMAT_BMP : PNG_FORMAT_BMP32;
+    out.bytes_per_pixel = flat ? 3 : 4;
+    out.bits_per_pixel = (uint8_t)(out.bytes_per_pixel * 8);
+    out.row_size = png_row_size(out.width, out.bits_per_pixel, out.pixel_format);
+    out.final_pixel_size = out.row_size * out.height;
+    out.final_pixel_data = flat ? malloc(out.final_pixel_size) : canvas;
+    if (!canvas || !saved || !out.final_pixel_data) {
+        log_error(logger, "Mémoire insuffisante pour le canevas APNG (%ux%u).", anim->width, anim->height);
+        if (flat) free(out.final_pixel_data);
+        free(canvas);
+        free(saved);
+        return -1;
+    }
+    PngCompositor compositor;
+    RGBA background = run->options.background;
+    uint8_t swap = background.r; background.r = background.b; background.b = swap;
+    int status = 0;
+    for (uint32_t i = 0; status == 0 && i < anim->frame_count; i++) {
+        ApngFrameData* frame = &anim->frames[i];
+        if (wait_frame(self, i) != APNG_FRAME_READY) {
+            log_error(logger, "Echec du décodage de l'image %u de l'animation (%s)", i, frame->error);
+            status = -1;
+            break;
+        }
+        const ApngSlot* slot = &run->slots[i % run->window];
+        PngApngFrame* control = &frame->control;
+        /* Première image : "précédente" vaut "fond" (canevas transparent). */
+        if (i == 0 && control->dispose_op == PNG_APNG_DISPOSE_PREVIOUS) control->dispose_op = PNG_APNG_DISPOSE_BACKGROUND;
+        if (control->dispose_op == PNG_APNG_DISPOSE_PREVIOUS) copy_region(canvas, anim, control, saved, true);
+        blend_frame(canvas, anim, control, slot->pixels);
+        if (flat) {
+            if (i == 0) png_compositor_init(&compositor, slot->gamma, background);
+            flatten_canvas(&compositor, canvas, &out, anim->width);
+        }
+        if (sink(user, i, &out, control) != 0) status = -1;
+        if (control->dispose_op == PNG_APNG_DISPOSE_BACKGROUND) clear_region(canvas, anim, control);
+        else if (control->dispose_op == PNG_APNG_DISPOSE_PREVIOUS) copy_region(canvas, anim, control, saved, false);
+        pthread_mutex_lock(&run->lock);
+        run->composited++;
+        pthread_cond_broadcast(&run->changed);
+        pthread_mutex_unlock(&run->lock);
+    }
+    if (flat) free(out.final_pixel_data);
+    free(canvas);
+    free(saved);
+    return status;
+}
+
+int png_apng_decode(Logger* logger, const unsigned char* data, size_t size, const PngDecodeOptions* options, PngApngSink sink, void* user) {
+    ApngAnimation anim;
+    const char* problem = parse_animation(&anim, data, size);
+    if (problem) {
+        log_error(logger, "APNG invalide : %s", problem);
+        animation_free(&anim);
+        return -1;
+    }
+    ApngRun run;
+    memset(&run, 0, sizeof(run));
+    run.anim = &anim;
+    if (options) run.options = *options;
+    else png_options_init(&run.options);
+    int threads = run.options.threads > 0 ? run.options.threads : 1;
+    if (threads > APNG_MAX_THREADS) threads = APNG_MAX_THREADS;
+    if ((uint32_t)threads > anim.frame_count) threads = (int)anim.frame_count;
+    run.flat = run.options.format == PNG_FORMAT_BMP || run.options.format == PNG_FORMAT_BMP_INDEXED;
+    /* Une image par thread : le parallélisme est entre les images. */
+    run.options.format = PNG_FORMAT_BMP32;
+    run.options.threads = 1;
+    run.options.thumbnail_scale = 0;
+    memset(&run.options.crop, 0, sizeof(run.options.crop));
+    memset(&run.options.resize, 0, sizeof(run.options.resize));
+    run.options.allocate = NULL;
+    run.window = (uint32_t)threads * APNG_FRAMES_AHEAD_PER_THREAD;
+    if (run.window > anim.frame_count) run.window = anim.frame_count;
+    log_message(logger, "APNG %ux%u : %u images, %s, %d threads.", anim.width, anim.height, anim.frame_count,
+                !anim.animated ? "sans animation" : anim.play_count ? "lecture limitée" : "lecture en boucle", threads);
+    run.slots = calloc(run.window, sizeof(ApngSlot));
+    ApngWorker* workers = calloc((size_t)threads, sizeof(ApngWorker));
+    int status = -1, started = 0;
+    for (int w = 0; workers && w < threads; w++) {
+        workers[w].run = &run;
+        workers[w].decoder = png_decoder_create();
+        if (!workers[w].decoder) break;
+    }
+    if (!run.slots || !workers || !workers[threads - 1].decoder) {
+        log_error(logger, "Mémoire insuffisante pour décoder l'APNG.");
+        goto cleanup;
+    }
+    pthread_mutex_init(&run.lock, NULL);
+    pthread_cond_init(&run.changed, NULL);
+    /* Le thread appelant compose et décode aussi l'image attendue si personne ne l'a prise. */
+    for (int w = 1; w < threads; w++) {
+        if (pthread_create(&workers[w].thread, NULL, frame_worker, &workers[w]) != 0) break;
+        started++;
+    }
+    status = compose_frames(logger, &run, &workers[0], sink, user);
+    pthread_mutex_lock(&run.lock);
+    run.aborted = true;
+    pthread_cond_broadcast(&run.changed);
+    pthread_mutex_unlock(&run.lock);
+    for (int w = 1; w <= started; w++) pthread_join(workers[w].thread, NULL);
+    pthread_cond_destroy(&run.changed);
+    pthread_mutex_destroy(&run.lock);
+    if (options && options->stats) {
+        for (int w = 0; w < threads; w++) png_stats_add(options->stats, &workers[w].stats);
+    }
+cleanup:
+    for (int w = 0; workers && w < threads; w++) {
+        png_decoder_destroy(workers[w].decoder);
+        free(workers[w].png);
+    }
+    for (uint32_t i = 0; run.slots && i < run.window; i++) free(run.slots[i].pixels);
+    free(run.slots);
+    free(workers);
+    animation_free(&anim);
+    return status;
+}
+
+typedef struct ApngBmpOutput {
+    Logger* logger;
+    char* filename;
+    size_t prefix_length;
+    PngStats* stats;
+} ApngBmpOutput;
+
+static int write_frame_bmp(void* user, uint32_t index, const PngImage* canvas, const PngApngFrame* frame) {
+    ApngBmpOutput* output = user;
+    sprintf(output->filename + output->prefix_length, "_%04u.bmp", index);
+    log_debug(output->logger, "Image %u : %ux%u en (%u, %u), délai %u/%u, dispose %u, blend %u -> %s", index, frame->width, frame->height,
+              frame->x_offset, frame->y_offset, frame->delay_num, frame->delay_den, frame->dispose_op, frame->blend_op, output->filename);
+    return png_save_to_bmp_ex(output->logger, output->filename, canvas, canvas->final_pixel_data, output->stats);
+}
+
+int png_apng_to_bmp(Logger* logger, const unsigned char* data, size_t size, const char* output, const PngDecodeOptions* options) {
+    ApngBmpOutput out;
+    size_t length = strlen(output);
+    out.logger = logger;
+    out.stats = options ? options->stats : NULL;
+    out.prefix_length = length > 4 && (strcmp(output + length - 4, ".bmp") == 0 || strcmp(output + length - 4, ".BMP") == 0) ? length - 4 : length;
+    out.filename = malloc(out.prefix_length + 16);
+    if (!out.filename) return -1;
+    memcpy(out.filename, output, out.prefix_length);
+    int status = png_apng_decode(logger, data, size, options, write_frame_bmp, &out);
+    free(out.filename);
+    return status;
+}
@@ -0,0 +1,47 @@
+#include <math.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "../headers/png_composite.h"
+
+static uint8_t encode_reference(float linear, float inverse_gamma) {
+    return (uint8_t)(powf(linear, inverse_gamma) * 255.0f);
+}
+
+static float float_from_bits(uint32_t bits) { float f; memcpy(&f, &bits, sizeof(f)); return f; }
+
+void png_compositor_init(PngCompositor* compositor, float gamma, RGBA background) {
+    const float inverse_gamma = 1.0f / gamma;
+    const uint8_t bg[3] = { background.r, background.g, background.b };
+    for (int v = 0; v < 256; v++) {
+        compositor->to_linear[v] = powf(v / 255.0f, gamma);
+        compositor->alpha[v] = v / 255.0f;
+        compositor->opaque[v] = encode_reference(compositor->to_linear[v], inverse_gamma);
+    }
+    for (int c = 0; c < 3; c++) {
+        compositor->background_linear[c] = powf(bg[c] / 255.0f, gamma);
+        compositor->background[c] = encode_reference(compositor->background_linear[c], inverse_gamma);
+    }
+    /* thresholds[k] : plus petite valeur linéaire encodée en k ou plus, trouvée par dichotomie sur les bits du float. */
+    compositor->thresholds[0] = 0.0f;
+    uint32_t lo = 0;
+    for (int k = 1; k < 256; k++) {
+        uint32_t hi = 0x3F800000u; /* 1.0f, encodé en 255 */
+        while (lo < hi) {
+            uint32_t mid = lo + (hi - lo) / 2;
+            if (encode_reference(float_from_bits(mid), inverse_gamma) >= k) hi = mid; else lo = mid + 1;
+        }
+        compositor->thresholds[k] = float_from_bits(lo);
+    }
+}
+
+const PngCompositor* png_compositor_cached(PngCompositorCache* cache, float gamma, RGBA background) {
+    const RGBA* last = &cache->background;
+    if (!cache->ready || cache->gamma != gamma || last->r != background.r || last->g != background.g || last->b != background.b) {
+        png_compositor_init(&cache->compositor, gamma, background);
+        cache->gamma = gamma;
+        cache->background = background;
+        cache->ready = true;
+    }
+    return &cache->compositor;
+}
@@ -0,0 +1,312 @@
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "../headers/png_convert.h"
+
+/* Chaque convertisseur existe en quatre versions : "packed" (image non entrelacée, pas constant de 3 octets)
+   ou "interlaced" (pas d'écriture variable pour les passes Adam7), en ordre RGB ou BGR (disposition BMP).
+   ri est l'indice du rouge dans le pixel de sortie, constant dans chaque version. */
+#define DEFINE_CONVERTER_VARIANT(NAME, STEP, RI, ...) \
+static void NAME(const PngConverter* conv, const unsigned char* src, uint32_t count, unsigned char* dst, size_t dst_step) { \
+    const size_t step = STEP; \
+    const size_t ri = RI; \
+    (void)conv; (void)dst_step; (void)ri; \
+    __VA_ARGS__ \
+}
+#define DEFINE_CONVERTER(NAME, ...) \
+    DEFINE_CONVERTER_VARIANT(NAME##_packed, 3, 0, __VA_ARGS__) \
+    DEFINE_CONVERTER_VARIANT(NAME##_interlaced, dst_step, 0, __VA_ARGS__) \
+    DEFINE_CONVERTER_VARIANT(NAME##_packed_bgr, 3, 2, __VA_ARGS__) \
+    DEFINE_CONVERTER_VARIANT(NAME##_interlaced_bgr, dst_step, 2, __VA_ARGS__)
+
+/* Les tables (lut, fond du compositeur) sont déjà dans l'ordre de sortie ; seuls les canaux lus dans la source sont permutés. */
+#define PUT_RGB(r, g, b) { dst[ri] = (r); dst[1] = (g); dst[2 - ri] = (b); }
+#define PUT_LUT(i) { const uint8_t* rgb = conv->lut[i]; dst[0] = rgb[0]; dst[1] = rgb[1]; dst[2] = rgb[2]; }
+#define PUT_LUT32(i) { memcpy(dst, conv->lut[i], 4); }
+#define PUT_INDEX(i) { dst[0] = (i); }
+#define PUT_BGRA(r, g, b, a) { dst[0] = (b); dst[1] = (g); dst[2] = (r); dst[3] = (a); }
+
+/* Sortie 32 bits BGRA sans composition ni gamma, et sortie d'index sur un octet (palette ou niveau de gris brut). */
+#define DEFINE_BGRA_CONVERTER(NAME, ...) \
+    DEFINE_CONVERTER_VARIANT(NAME##_bgra_packed, 4, 2, __VA_ARGS__) \
+    DEFINE_CONVERTER_VARIANT(NAME##_bgra_interlaced, dst_step, 2, __VA_ARGS__)
+#define DEFINE_INDEX_CONVERTER(NAME, ...) \
+    DEFINE_CONVERTER_VARIANT(NAME##_index_packed, 1, 0, __VA_ARGS__) \
+    DEFINE_CONVERTER_VARIANT(NAME##_index_interlaced, dst_step, 0, __VA_ARGS__)
+#define PUT_BACKGROUND() { dst[0] = conv->compositor.background[0]; dst[1] = conv->compositor.background[1]; dst[2] = conv->compositor.background[2]; }
+#define COMPOSITE(r, g, b, a) png_composite_pixel(&conv->compositor, ri == 0 ? (r) : (b), (g), ri == 0 ? (b) : (r), (a), dst)
+
+#define INDEXED_SUBBYTE_BODY(BITS, PUT) \
+    const uint32_t per_byte = 8 / BITS; \
+    uint32_t px = 0; \
+    for (; px + per_byte <= count; px += per_byte) { \
+        const uint8_t* index = conv->expand + (size_t)(*src++) * per_byte; \
+        for (uint32_t i = 0; i < per_byte; i++, dst += step) PUT(index[i]); \
+    } \
+    if (px < count) { \
+        const uint8_t* index = conv->expand + (size_t)(*src) * per_byte; \
+        for (uint32_t i = 0; px < count; i++, px++, dst += step) PUT(index[i]); \
+    }
+
+DEFINE_CONVERTER(indexed1, INDEXED_SUBBYTE_BODY(1, PUT_LUT))
+DEFINE_CONVERTER(indexed2, INDEXED_SUBBYTE_BODY(2, PUT_LUT))
+DEFINE_CONVERTER(indexed4, INDEXED_SUBBYTE_BODY(4, PUT_LUT))
+
+DEFINE_CONVERTER(indexed8,
+    for (uint32_t px = 0; px < count; px++, dst += step) PUT_LUT(src[px]);
+)
+
+DEFINE_CONVERTER(gray16,
+    const uint8_t* opaque = conv->compositor.opaque;
+    for (uint32_t px = 0; px < count; px++, src += 2, dst += step) {
+        if (conv->has_key && (uint16_t)((src[0] << 8) | src[1]) == conv->key.r) PUT_BACKGROUND()
+        else PUT_RGB(opaque[src[0]], opaque[src[0]], opaque[src[0]])
+    }
+)
+
+DEFINE_CONVERTER(rgb8,
+    const uint8_t* opaque = conv->compositor.opaque;
+    for (uint32_t px = 0; px < count; px++, src += 3, dst += step) {
+        if (conv->has_key && src[0] == conv->key.r && src[1] == conv->key.g && src[2] == conv->key.b) PUT_BACKGROUND()
+        else PUT_RGB(opaque[src[0]], opaque[src[1]], opaque[src[2]])
+    }
+)
+
+DEFINE_CONVERTER(rgb16,
+    const uint8_t* opaque = conv->compositor.opaque;
+    for (uint32_t px = 0; px < count; px++, src += 6, dst += step) {
+        if (conv->has_key && (uint16_t)((src[0] << 8) | src[1]) == conv->key.r && (uint16_t)((src[2] << 8) | src[3]) == conv->key.g && (uint16_t)((src[4] << 8) | src[5]) == conv->key.b) PUT_BACKGROUND()
+        else PUT_RGB(opaque[src[0]], opaque[src[2]], opaque[src[4]])
+    }
+)
+
+DEFINE_CONVERTER(gray_alpha8,
+    for (uint32_t px = 0; px < count; px++, src += 2, dst += step) COMPOSITE(src[0], src[0], src[0], src[1]);
+)
+
+DEFINE_CONVERTER(gray_alpha16,
+    for (uint32_t px = 0; px < count; px++, src += 4, dst += step) COMPOSITE(src[0], src[0], src[0], src[2]);
+)
+
+DEFINE_CONVERTER(rgba8,
+    for (uint32_t px = 0; px < count; px++, src += 4, dst += step) COMPOSITE(src[0], src[1], src[2], src[3]);
+)
+
+DEFINE_CONVERTER(rgba16,
+    for (uint32_t px = 0; px < count; px++, src += 8, dst += step) COMPOSITE(src[0], src[2], src[4], src[6]);
+)
+
+DEFINE_CONVERTER(rgb8_swizzle,
+    for (uint32_t px = 0; px < count; px++, src += 3, dst += step) PUT_RGB(src[0], src[1], src[2]);
+)
+
+DEFINE_BGRA_CONVERTER(indexed1, INDEXED_SUBBYTE_BODY(1, PUT_LUT32))
+DEFINE_BGRA_CONVERTER(indexed2, INDEXED_SUBBYTE_BODY(2, PUT_LUT32))
+DEFINE_BGRA_CONVERTER(indexed4, INDEXED_SUBBYTE_BODY(4, PUT_LUT32))
+
+DEFINE_BGRA_CONVERTER(indexed8,
+    for (uint32_t px = 0; px < count; px++, dst += step) PUT_LUT32(src[px]);
+)
+
+DEFINE_BGRA_CONVERTER(gray16,
+    for (uint32_t px = 0; px < count; px++, src += 2, dst += step) {
+        bool keyed = conv->has_key && (uint16_t)((src[0] << 8) | src[1]) == conv->key.r;
+        PUT_BGRA(src[0], src[0], src[0], keyed ? 0 : 255)
+    }
+)
+
+DEFINE_BGRA_CONVERTER(rgb8,
+    for (uint32_t px = 0; px < count; px++, src += 3, dst += step) {
+        bool keyed = conv->has_key && src[0] == conv->key.r && src[1] == conv->key.g && src[2] == conv->key.b;
+        PUT_BGRA(src[0], src[1], src[2], keyed ? 0 : 255)
+    }
+)
+
+DEFINE_BGRA_CONVERTER(rgb16,
+    for (uint32_t px = 0; px < count; px++, src += 6, dst += step) {
+        bool keyed = conv->has_key && (uint16_t)((src[0] << 8) | src[1]) == conv->key.r && (uint16_t)((src[2] << 8) | src[3]) == conv->key.g && (uint16_t)((src[4] << 8) | src[5]) == conv->key.b;
+        PUT_BGRA(src[0], src[2], src[4], keyed ? 0 : 255)
+    }
+)
+
+DEFINE_BGRA_CONVERTER(gray_alpha8,
+    for (uint32_t px = 0; px < count; px++, src += 2, dst += step) PUT_BGRA(src[0], src[0], src[0], src[1]);
+)
+
+DEFINE_BGRA_CONVERTER(gray_alpha16,
+    for (uint32_t px = 0; px < count; px++, src += 4, dst += step) PUT_BGRA(src[0], src[0], src[0], src[2]);
+)
+
+DEFINE_BGRA_CONVERTER(rgba8,
+    for (uint32_t px = 0; px < count; px++, src += 4, dst += step) PUT_BGRA(src[0], src[1], src[2], src[3]);
+)
+
+DEFINE_BGRA_CONVERTER(rgba16,
+    for (uint32_t px = 0; px < count; px++, src += 8, dst += step) PUT_BGRA(src[0], src[2], src[4], src[6]);
+)
+
+DEFINE_INDEX_CONVERTER(indexed1, INDEXED_SUBBYTE_BODY(1, PUT_INDEX))
+DEFINE_INDEX_CONVERTER(indexed2, INDEXED_SUBBYTE_BODY(2, PUT_INDEX))
+DEFINE_INDEX_CONVERTER(indexed4, INDEXED_SUBBYTE_BODY(4, PUT_INDEX))
+
+DEFINE_INDEX_CONVERTER(indexed8,
+    for (uint32_t px = 0; px < count; px++, dst += step) PUT_INDEX(src[px]);
+)
+
+/* Index à la profondeur du PNG (même ordre des bits que le BMP, bit de poids fort en premier) : simple copie. */
+static void index_copy_packed(const PngConverter* conv, const unsigned char* src, uint32_t count, unsigned char* dst, size_t dst_step) {
+    (void)dst_step;
+    memcpy(dst, src, ((size_t)count * conv->index_bits + 7) / 8);
+}
+
+/* Index 2 bits élargis à 4 bits (le BMP n'a pas de profondeur 2) ; l'octet de trop éventuel tombe dans le bourrage. */
+static void index2_to4_packed(const PngConverter* conv, const unsigned char* src, uint32_t count, unsigned char* dst, size_t dst_step) {
+    (void)conv; (void)dst_step;
+    for (uint32_t px = 0; px < count; px += 4, src++, dst += 2) {
+        dst[0] = (uint8_t)((((*src >> 6) & 3) << 4) | ((*src >> 4) & 3));
+        dst[1] = (uint8_t)((((*src >> 2) & 3) << 4) | (*src & 3));
+    }
+}
+
+/* RGB 8 bits sans clé de transparence et avec un gamma dont l'aller-retour est l'identité : simple copie. */
+static void rgb8_copy_packed(const PngConverter* conv, const unsigned char* src, uint32_t count, unsigned char* dst, size_t dst_step) {
+    (void)conv; (void)dst_step;
+    memcpy(dst, src, (size_t)count * 3);
+}
+
+static void build_expand(PngConverter* conv, int bits) {
+    const int per_byte = 8 / bits, mask = (1 << bits) - 1;
+    for (int byte = 0; byte < 256; byte++) {
+        for (int i = 0; i < per_byte; i++) conv->expand[byte * per_byte + i] = (uint8_t)((byte >> (8 - bits * (i + 1))) & mask);
+    }
+}
+
+static void build_palette_lut(PngConverter* conv, const PngImage* png, bool bgr) {
+    for (unsigned int i = 0; i < 256; i++) {
+        const RGBA* c = &png->palette[i];
+        if (i < png->palette_size) png_composite_pixel(&conv->compositor, bgr ? c->b : c->r, c->g, bgr ? c->r : c->b, c->a, conv->lut[i]);
+        else png_composite_pixel(&conv->compositor, 0, 0, 0, 255, conv->lut[i]);
+    }
+}
+
+static void build_gray_lut(PngConverter* conv, const PngImage* png) {
+    const unsigned int levels = 1u << png->bit_depth;
+    for (unsigned int v = 0; v < levels; v++) {
+        uint8_t gray = (png->bit_depth == 8) ? (uint8_t)v : (uint8_t)(v * (255.0f / ((1 << png->bit_depth) - 1)));
+        uint8_t alpha = (png->has_transparency_key && v == png->transparency_key.r) ? 0 : 255;
+        png_composite_pixel(&conv->compositor, gray, gray, gray, alpha, conv->lut[v]);
+    }
+}
+
+/* Palette ou niveaux de gris bruts, en BGRA, pour la sortie 32 bits. */
+static void build_lut32(PngConverter* conv, const PngImage* png) {
+    memset(conv->lut, 0, sizeof(conv->lut));
+    for (unsigned int i = 0; i < 256; i++) conv->lut[i][3] = 255;
+    if (png->color_type == 3) {
+        for (unsigned int i = 0; i < png->palette_size; i++) {
+            const RGBA* c = &png->palette[i];
+            conv->lut[i][0] = c->b; conv->lut[i][1] = c->g; conv->lut[i][2] = c->r; conv->lut[i][3] = c->a;
+        }
+        return;
+    }
+    const unsigned int levels = 1u << png->bit_depth;
+    for (unsigned int v = 0; v < levels; v++) {
+        uint8_t gray = (uint8_t)(v * 255 / (levels - 1));
+        conv->lut[v][0] = conv->lut[v][1] = conv->lut[v][2] = gray;
+        if (png->has_transparency_key && v == png->transparency_key.r) conv->lut[v][3] = 0;
+    }
+}
+
+static bool opaque_is_identity(const PngCompositor* compositor) {
+    for (int v = 0; v < 256; v++) if (compositor->opaque[v] != v) return false;
+    return true;
+}
+
+#define SELECT(NAME) conv->convert = interlaced ? (bgr ? NAME##_interlaced_bgr : NAME##_interlaced) : (bgr ? NAME##_packed_bgr : NAME##_packed)
+#define SELECT_BGRA(NAME) conv->convert = interlaced ? NAME##_bgra_interlaced : NAME##_bgra_packed
+#define SELECT_INDEX(NAME) conv->convert = interlaced ? NAME##_index_interlaced : NAME##_index_packed
+
+static int select_bgra(PngConverter* conv, const PngImage* png, bool interlaced) {
+    const bool wide = png->bit_depth == 16;
+    switch (png->color_type) {
+        case 0:
+        case 3:
+            if (wide && png->color_type == 0) { SELECT_BGRA(gray16); break; }
+            switch (png->bit_depth) {
+                case 1: build_expand(conv, 1); SELECT_BGRA(indexed1); break;
+                case 2: build_expand(conv, 2); SELECT_BGRA(indexed2); break;
+                case 4: build_expand(conv, 4); SELECT_BGRA(indexed4); break;
+                case 8: SELECT_BGRA(indexed8); break;
+                default: return -1;
+            }
+            build_lut32(conv, png);
+            break;
+        case 2: if (png->bit_depth == 8) SELECT_BGRA(rgb8); else if (wide) SELECT_BGRA(rgb16); break;
+        case 4: if (png->bit_depth == 8) SELECT_BGRA(gray_alpha8); else if (wide) SELECT_BGRA(gray_alpha16); break;
+        case 6: if (png->bit_depth == 8) SELECT_BGRA(rgba8); else if (wide) SELECT_BGRA(rgba16); break;
+    }
+    return conv->convert ? 0 : -1;
+}
+
+/* Les couleurs des index (lut, déjà composées) vont dans la table du BMP ; les pixels restent des index. */
+static int select_index(PngConverter* conv, const PngImage* png, bool interlaced) {
+    if (png->color_type == 3) build_palette_lut(conv, png, true);
+    else if (png->color_type == 0 && (png->bit_depth == 1 || png->bit_depth == 2 || png->bit_depth == 4 || png->bit_depth == 8)) build_gray_lut(conv, png);
+    else return -1;
+    conv->index_bits = png->bits_per_pixel;
+    if (!interlaced && png->bits_per_pixel == png->bit_depth) { conv->convert = index_copy_packed; return 0; }
+    if (!interlaced && png->bits_per_pixel == 4 && png->bit_depth == 2) { conv->convert = index2_to4_packed; return 0; }
+    if (png->bits_per_pixel != 8) return -1;
+    switch (png->bit_depth) {
+        case 1: build_expand(conv, 1); SELECT_INDEX(indexed1); break;
+        case 2: build_expand(conv, 2); SELECT_INDEX(indexed2); break;
+        case 4: build_expand(conv, 4); SELECT_INDEX(indexed4); break;
+        case 8: SELECT_INDEX(indexed8); break;
+    }
+    return conv->convert ? 0 : -1;
+}
+
+int png_converter_init(PngConverter* conv, const PngImage* png, RGBA background, PngCompositorCache* cache) {
+    const bool interlaced = png->interlace_method != 0;
+    const bool bgr = png->pixel_format != PNG_FORMAT_RGB;
+    if (bgr) { uint8_t r = background.r; background.r = background.b; background.b = r; }
+    if (cache) conv->compositor = *png_compositor_cached(cache, png->file_gamma, background);
+    else png_compositor_init(&conv->compositor, png->file_gamma, background);
+    conv->has_key = png->has_transparency_key;
+    conv->key = png->transparency_key;
+    conv->convert = NULL;
+    if (png->pixel_format == PNG_FORMAT_BMP32) return select_bgra(conv, png, interlaced);
+    if (png->pixel_format == PNG_FORMAT_BMP_INDEXED) return select_index(conv, png, interlaced);
+    switch (png->color_type) {
+        case 0:
+        case 3:
+            if (png->bit_depth == 16 && png->color_type == 0) { SELECT(gray16); break; }
+            if (png->color_type == 3) build_palette_lut(conv, png, bgr);
+            switch (png->bit_depth) {
+                case 1: build_expand(conv, 1); SELECT(indexed1); break;
+                case 2: build_expand(conv, 2); SELECT(indexed2); break;
+                case 4: build_expand(conv, 4); SELECT(indexed4); break;
+                case 8: SELECT(indexed8); break;
+                default: return -1;
+            }
+            if (png->color_type == 0) build_gray_lut(conv, png);
+            break;
+        case 2:
+            if (png->bit_depth == 8) {
+                if (conv->has_key || !opaque_is_identity(&conv->compositor)) SELECT(rgb8);
+                else if (interlaced || bgr) SELECT(rgb8_swizzle);
+                else conv->convert = rgb8_copy_packed;
+            } else if (png->bit_depth == 16) SELECT(rgb16);
+            break;
+        case 4:
+            if (png->bit_depth == 8) SELECT(gray_alpha8);
+            else if (png->bit_depth == 16) SELECT(gray_alpha16);
+            break;
+        case 6:
+            if (png->bit_depth == 8) SELECT(rgba8);
+            else if (png->bit_depth == 16) SELECT(rgba16);
+            break;
+    }
+    return conv->convert ? 0 : -1;
+}
@@ -0,0 +1,389 @@
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <zlib.h>
+
+#include "../headers/png_inflate.h"
+
+#define LITLEN_TABLEBITS 11
+#define DIST_TABLEBITS 8
+#define PRECODE_TABLEBITS 7
+/* Taille maximale d'une table principale et de ses sous-tables (calculée comme l'outil "enough" de zlib). */
+#define LITLEN_ENOUGH 2342
+#define DIST_ENOUGH 402
+#define MAX_CODE_LEN 15
+
+/* Entrée de table : bits 0-4 bits consommés, 5-7 nature, 8-11 bits supplémentaires, taille de la sous-table ou
+   longueur du premier code d'une paire, 16-31 valeur (un ou deux littéraux, base de longueur ou de distance, début de la sous-table). */
+enum { K_LITERAL = 0, K_LITERAL_PAIR, K_BASE, K_END, K_SUBTABLE, K_INVALID };
+#define ENTRY(bits, kind, extra, value) ((uint32_t)(bits) | ((uint32_t)(kind) << 5) | ((uint32_t)(extra) << 8) | ((uint32_t)(value) << 16))
+#define E_BITS(e) ((e) & 31)
+#define E_KIND(e) (((e) >> 5) & 7)
+#define E_EXTRA(e) (((e) >> 8) & 15)
+#define E_VALUE(e) ((e) >> 16)
+
+static const uint16_t length_base[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t length_extra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t dist_base[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const uint8_t dist_extra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+static const uint8_t precode_order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+typedef enum { TABLE_PRECODE, TABLE_LITLEN, TABLE_DIST } TableType;
+
+typedef struct InflateTables {
+    uint32_t litlen[LITLEN_ENOUGH];
+    uint32_t dist[DIST_ENOUGH];
+    uint32_t precode[1 << PRECODE_TABLEBITS];
+    bool fixed_ready;
+} InflateTables;
+
+static uint32_t symbol_entry(TableType type, unsigned sym) {
+    if (type == TABLE_PRECODE) return ENTRY(0, K_LITERAL, 0, sym);
+    if (type == TABLE_DIST) return sym < 30 ? ENTRY(0, K_BASE, dist_extra[sym], dist_base[sym]) : ENTRY(0, K_INVALID, 0, 0);
+    if (sym < 256) return ENTRY(0, K_LITERAL, 0, sym);
+    if (sym == 256) return ENTRY(0, K_END, 0, 0);
+    return sym < 286 ? ENTRY(0, K_BASE, length_extra[sym - 257], length_base[sym - 257]) : ENTRY(0, K_INVALID, 0, 0);
+}
+
+/* Table canonique indexée par les bits de poids faible (ordre de lecture deflate), sous-tables pour les codes
+   plus longs que table_bits. Comme zlib, un code incomplet n'est admis que s'il se réduit à un code de longueur 1
+   et un code vide ne l'est que pour les littéraux/longueurs et les distances. */
+static int build_table(uint32_t* table, const uint8_t* lens, unsigned count, TableType type, unsigned table_bits) {
+    unsigned len_counts[2 * MAX_CODE_LEN + 2] = {0};
+    unsigned offsets[MAX_CODE_LEN + 2];
+    uint16_t sorted[288];
+    const unsigned table_size = 1u << table_bits;
+    for (unsigned i = 0; i < count; i++) len_counts[lens[i]]++;
+    unsigned max_len = 0;
+    int left = 1;
+    for (unsigned len = 1; len <= MAX_CODE_LEN; len++) {
+        if (len_counts[len]) max_len = len;
+        left = (left << 1) - (int)len_counts[len];
+        if (left < 0) return -1;
+    }
+    if (max_len == 0 || left > 0) {
+        if (type == TABLE_PRECODE || max_len > 1) return -1;
+        for (unsigned i = 0; i < table_size; i++) table[i] = ENTRY(1, K_INVALID, 0, 0);
+        if (max_len == 0) return 0;
+    }
+    offsets[1] = 0;
+    for (unsigned len = 1; len <= MAX_CODE_LEN; len++) offsets[len + 1] = offsets[len] + len_counts[len];
+    for (unsigned i = 0; i < count; i++) if (lens[i]) sorted[offsets[lens[i]]++] = (uint16_t)i;
+    const unsigned n = offsets[MAX_CODE_LEN + 1];
+    unsigned codeword = 0, len = 1, subtable_prefix = ~0u, subtable_start = 0, subtable_bits = table_bits;
+    for (unsigned k = 0; k < n; k++) {
+        while (len_counts[len] == 0) len++;
+        uint32_t entry = symbol_entry(type, sorted[k]);
+        if (len <= table_bits) {
+            for (unsigned i = codeword; i < table_size; i += 1u << len) table[i] = entry | len;
+        } else {
+            unsigned prefix = codeword & (table_size - 1);
+            if (prefix != subtable_prefix) {
+                subtable_prefix = prefix;
+                subtable_start += 1u << subtable_bits;
+                subtable_bits = len - table_bits;
+                unsigned used = len_counts[len];
+                while (used < (1u << subtable_bits)) {
+                    subtable_bits++;
+                    used = (used << 1) + len_counts[table_bits + subtable_bits];
+                }
+                table[prefix] = ENTRY(table_bits, K_SUBTABLE, subtable_bits, subtable_start);
+            }
+            unsigned end = subtable_start + (1u << subtable_bits);
+            for (unsigned i = subtable_start + (codeword >> table_bits); i < end; i += 1u << (len - table_bits)) table[i] = entry | (len - table_bits);
+        }
+        len_counts[len]--;
+        if (k + 1 < n) {
+            /* Code canonique suivant, en représentation inversée : la retenue se propage depuis le bit de poids fort. */
+            unsigned bit = 1u << (31 - __builtin_clz(codeword ^ ((1u << len) - 1)));
+            codeword = (codeword & (bit - 1)) | bit;
+        }
+    }
+    return 0;
+}
+
+/* Deux littéraux dont les codes tiennent ensemble dans table_bits bits sont décodés par une seule entrée.
+   Parcours décroissant : table[i >> bits] (indice inférieur) n'est pas encore modifié. */
+static void pair_literals(uint32_t* table, unsigned table_bits) {
+    for (unsigned i = 1u << table_bits; i-- > 0; ) {
+        uint32_t first = table[i];
+        if (E_KIND(first) != K_LITERAL || E_BITS(first) >= table_bits) continue;
+        uint32_t second = table[i >> E_BITS(first)];
+        if (E_KIND(second) != K_LITERAL || E_BITS(second) > table_bits - E_BITS(first)) continue;
+        table[i] = ENTRY(E_BITS(first) + E_BITS(second), K_LITERAL_PAIR, E_BITS(first), E_VALUE(first) | (E_VALUE(second) << 8));
+    }
+}
+
+static inline uint64_t load_le64(const unsigned char* p) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+#else
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--) v = (v << 8) | p[i];
+    return v;
+#endif
+}
+
+/* Au moins 57 bits disponibles après chaque recharge. Près de la fin, des octets nuls sont ajoutés ; au-delà de
+   8 octets fictifs, des bits inexistants ont forcément été consommés. */
+#define REFILL() do { \
+    if (in_end - in >= 8) { \
+        bitbuf |= load_le64(in) << bitcount; \
+        in += (63 - bitcount) >> 3; \
+        bitcount |= 56; \
+    } else { \
+        while (bitcount <= 56) { \
+            uint64_t byte = 0; \
+            if (in < in_end) byte = *in++; \
+            else if (++overrun > 8) return PNG_INFLATE_TRUNCATED; \
+            bitbuf |= byte << bitcount; \
+            bitcount += 8; \
+        } \
+    } \
+} while (0)
+#define BITS(n) ((uint32_t)(bitbuf & ((1ull << (n)) - 1)))
+#define CONSUME(n) do { bitbuf >>= (n); bitcount -= (n); } while (0)
+#define DECODE_LITLEN(entry) do { \
+    entry = t->litlen[BITS(LITLEN_TABLEBITS)]; \
+    if (E_KIND(entry) == K_SUBTABLE) { \
+        CONSUME(LITLEN_TABLEBITS); \
+        entry = t->litlen[E_VALUE(entry) + BITS(E_EXTRA(entry))]; \
+    } \
+    CONSUME(E_BITS(entry)); \
+} while (0)
+/* Rend les octets entiers encore dans le tampon de bits ; échoue s'il faut y inclure des octets fictifs. */
+#define REWIND_TO_BYTE() do { \
+    CONSUME(bitcount & 7); \
+    if ((bitcount >> 3) < overrun) return PNG_INFLATE_TRUNCATED; \
+    in -= (bitcount >> 3) - overrun; \
+    bitbuf = 0; bitcount = 0; overrun = 0; \
+} while (0)
+/* Sortie pleine avant la fin du flux : le reste est ignoré, comme avec zlib, mais les bits lus pour la remplir
+   doivent tous exister (unread : bits consommés d'avance qui ne servent pas). */
+#define REAL_BITS(unread) (((bitcount + (unread)) >> 3) >= overrun)
+#define RETURN_FILLED(position, unread) do { \
+    if (!REAL_BITS(unread)) return PNG_INFLATE_TRUNCATED; \
+    *out_pos = (position); \
+    return PNG_INFLATE_OK; \
+} while (0)
+
+/* *filled passe à vrai dès que la sortie est pleine sans octet fictif lu : zlib s'arrêterait là. */
+static PngInflateStatus inflate_stream(InflateTables* t, const unsigned char* in, const unsigned char* in_end, unsigned char* out_begin, unsigned char* out_end, unsigned char** out_pos, bool* filled) {
+    unsigned char* out = out_begin;
+    uint64_t bitbuf = 0;
+    unsigned bitcount = 0;
+    size_t overrun = 0;
+    bool final = false;
+    *out_pos = out;
+    while (!final) {
+        REFILL();
+        final = BITS(1);
+        unsigned type = (unsigned)(bitbuf >> 1) & 3;
+        CONSUME(3);
+        if (type == 0) {
+            REWIND_TO_BYTE();
+            if (in_end - in < 4) return PNG_INFLATE_TRUNCATED;
+            unsigned len = in[0] | (in[1] << 8), nlen = in[2] | (in[3] << 8);
+            if (len != (~nlen & 0xFFFF)) return PNG_INFLATE_BAD_STORED;
+            in += 4;
+            /* Comme zlib, un bloc qui déborde de la sortie n'a pas besoin d'être complet. */
+            size_t room = (size_t)(out_end - out), avail = (size_t)(in_end - in);
+            if (len > room && avail >= room) { memcpy(out, in, room); RETURN_FILLED(out_end, 0); }
+            if (avail < len) return PNG_INFLATE_TRUNCATED;
+            memcpy(out, in, len);
+            out += len;
+            in += len;
+            if (out == out_end) *filled = true;
+            continue;
+        }
+        if (type == 3) return PNG_INFLATE_BAD_BLOCK;
+        if (type == 1) {
+            if (!t->fixed_ready) {
+                uint8_t lens[288 + 32];
+                memset(lens, 8, 144);
+                memset(lens + 144, 9, 112);
+                memset(lens + 256, 7, 24);
+                memset(lens + 280, 8, 8);
+                memset(lens + 288, 5, 32);
+                build_table(t->litlen, lens, 288, TABLE_LITLEN, LITLEN_TABLEBITS);
+                build_table(t->dist, lens + 288, 32, TABLE_DIST, DIST_TABLEBITS);
+                pair_literals(t->litlen, LITLEN_TABLEBITS);
+                t->fixed_ready = true;
+            }
+        } else {
+            uint8_t lens[288 + 32];
+            uint8_t precode_lens[19] = {0};
+            REFILL();
+            unsigned hlit = 257 + BITS(5), hdist = 1 + (unsigned)((bitbuf >> 5) & 31), hclen = 4 + (unsigned)((bitbuf >> 10) & 15);
+            CONSUME(14);
+            if (hlit > 286 || hdist > 30) return PNG_INFLATE_BAD_CODES;
+            for (unsigned i = 0; i < hclen; i++) {
+                REFILL();
+                precode_lens[precode_order[i]] = (uint8_t)BITS(3);
+                CONSUME(3);
+            }
+            if (build_table(t->precode, precode_lens, 19, TABLE_PRECODE, PRECODE_TABLEBITS) != 0) return PNG_INFLATE_BAD_CODES;
+            for (unsigned i = 0; i < hlit + hdist; ) {
+                REFILL();
+                uint32_t entry = t->precode[BITS(PRECODE_TABLEBITS)];
+                if (E_KIND(entry) != K_LITERAL) return PNG_INFLATE_BAD_CODES;
+                CONSUME(E_BITS(entry));
+                unsigned sym = E_VALUE(entry), repeat;
+                uint8_t value = 0;
+                if (sym < 16) { lens[i++] = (uint8_t)sym; continue; }
+                if (sym == 16) {
+                    if (i == 0) return PNG_INFLATE_BAD_CODES;
+                    value = lens[i - 1];
+                    repeat = 3 + BITS(2); CONSUME(2);
+                } else if (sym == 17) {
+                    repeat = 3 + BITS(3); CONSUME(3);
+                } else {
+                    repeat = 11 + BITS(7); CONSUME(7);
+                }
+                if (i + repeat > hlit + hdist) return PNG_INFLATE_BAD_CODES;
+                memset(lens + i, value, repeat);
+                i += repeat;
+            }
+            if (lens[256] == 0) return PNG_INFLATE_BAD_CODES;
+            if (build_table(t->litlen, lens, hlit, TABLE_LITLEN, LITLEN_TABLEBITS) != 0 ||
+                build_table(t->dist, lens + hlit, hdist, TABLE_DIST, DIST_TABLEBITS) != 0) return PNG_INFLATE_BAD_CODES;
+            pair_literals(t->litlen, LITLEN_TABLEBITS);
+            t->fixed_ready = false;
+        }
+        /* Après une recharge (57 bits au moins) : jusqu'à trois codes littéraux de 15 bits, puis une recharge
+           au besoin avant les bits supplémentaires de longueur, la distance et les siens (33 bits au plus). */
+        for (;;) {
+            REFILL();
+            uint32_t entry;
+            DECODE_LITLEN(entry);
+            unsigned kind = E_KIND(entry);
+            for (int literals = 1; kind <= K_LITERAL_PAIR; literals++) {
+                if (out_end - out <= 2) {
+                    if (out == out_end) RETURN_FILLED(out, E_BITS(entry));
+                    *out++ = (unsigned char)E_VALUE(entry);
+                    if (kind == K_LITERAL_PAIR) {
+                        /* Seul le premier littéral tient : les bits du second ne sont pas lus. */
+                        if (out == out_end) RETURN_FILLED(out, E_BITS(entry) - E_EXTRA(entry));
+                        *out++ = (unsigned char)(E_VALUE(entry) >> 8);
+                    }
+                    if (out == out_end && REAL_BITS(0)) *filled = true;
+                    break;
+                }
+                /* Pour un littéral seul, le second octet écrit est écrasé par la suite. */
+                out[0] = (unsigned char)E_VALUE(entry);
+                out[1] = (unsigned char)(E_VALUE(entry) >> 8);
+                out += 1 + (kind == K_LITERAL_PAIR);
+                if (literals == 3) break;
+                DECODE_LITLEN(entry);
+                kind = E_KIND(entry);
+            }
+            if (kind <= K_LITERAL_PAIR) continue;
+            if (kind == K_END) break;
+            if (kind != K_BASE) return PNG_INFLATE_BAD_SYMBOL;
+            if (bitcount < 33) REFILL();
+            size_t length = E_VALUE(entry) + BITS(E_EXTRA(entry));
+            CONSUME(E_EXTRA(entry));
+            entry = t->dist[BITS(DIST_TABLEBITS)];
+            if (E_KIND(entry) == K_SUBTABLE) {
+                CONSUME(DIST_TABLEBITS);
+                entry = t->dist[E_VALUE(entry) + BITS(E_EXTRA(entry))];
+            }
+            if (E_KIND(entry) != K_BASE) return PNG_INFLATE_BAD_SYMBOL;
+            CONSUME(E_BITS(entry));
+            size_t distance = E_VALUE(entry) + BITS(E_EXTRA(entry));
+            CONSUME(E_EXTRA(entry));
+            /* Comme zlib, la distance n'est vérifiée que s'il reste de la place pour la copie. */
+            if (out == out_end) RETURN_FILLED(out, 0);
+            if (distance > (size_t)(out - out_begin)) return PNG_INFLATE_BAD_DISTANCE;
+            const unsigned char* src = out - distance;
+            size_t room = (size_t)(out_end - out);
+            if (length + 8 <= room && length >= 8) {
+                /* Copies de 8 octets, quitte à déborder de 7 octets qui seront réécrits ensuite. Pour une distance
+                   courte, le motif est d'abord posé octet par octet puis recopié depuis un multiple de la distance. */
+                unsigned char* dst = out;
+                unsigned char* end = out + length;
+                if (distance < 8) {
+                    for (int k = 0; k < 8; k++) dst[k] = src[k];
+                    size_t step = distance * ((8 + distance - 1) / distance);
+                    dst += 8;
+                    src = dst - step;
+                }
+                while (dst < end) { memcpy(dst, src, 8); dst += 8; src += 8; }
+                out = end;
+            } else {
+                size_t n = length < room ? length : room;
+                for (size_t k = 0; k < n; k++) out[k] = src[k];
+                out += n;
+                if (n < length) RETURN_FILLED(out, 0);
+                if (out == out_end && REAL_BITS(0)) *filled = true;
+            }
+        }
+    }
+    *out_pos = out;
+    if (out != out_end) return PNG_INFLATE_SHORT;
+    /* Une somme Adler-32 absente en fin de fichier est tolérée comme avec zlib ; présente, elle doit être juste. */
+    REWIND_TO_BYTE();
+    if (in_end - in < 4) return PNG_INFLATE_OK;
+    uint32_t stored = ((uint32_t)in[0] << 24) | ((uint32_t)in[1] << 16) | ((uint32_t)in[2] << 8) | in[3];
+    uLong computed = 1;
+    for (size_t done = 0; done < (size_t)(out_end - out_begin); ) {
+        size_t n = (size_t)(out_end - out_begin) - done;
+        if (n > (1u << 30)) n = 1u << 30;
+        computed = adler32(computed, out_begin + done, (uInt)n);
+        done += n;
+    }
+    return computed == stored ? PNG_INFLATE_OK : PNG_INFLATE_BAD_CHECKSUM;
+}
+
+PngInflateStatus png_inflate(const unsigned char* in, size_t in_size, unsigned char* out, size_t out_size, size_t* produced) {
+    *produced = 0;
+    if (in_size < 2) return PNG_INFLATE_TRUNCATED;
+    if ((in[0] & 0x0F) != 8 || (in[0] >> 4) > 7 || ((in[0] << 8) | in[1]) % 31 != 0 || (in[1] & 0x20)) return PNG_INFLATE_BAD_HEADER;
+    InflateTables tables;
+    tables.fixed_ready = false;
+    unsigned char* end = out;
+    bool filled = false;
+    PngInflateStatus status = inflate_stream(&tables, in + 2, in + in_size, out, out + out_size, &end, &filled);
+    /* Comme zlib, un flux qui s'arrête une fois la sortie complète est accepté ; le reste, s'il est là, est vérifié. */
+    if (filled && status == PNG_INFLATE_TRUNCATED) { status = PNG_INFLATE_OK; end = out + out_size; }
+    *produced = (size_t)(end - out);
+    return status;
+}
+
+PngInflateEngine png_inflate_resolve(PngInflateEngine engine) {
+    if (engine != PNG_INFLATE_DEFAULT) return engine;
+#ifdef PNG_INFLATE_USE_ZLIB
+    return PNG_INFLATE_ZLIB;
+#else
+    return PNG_INFLATE_BUILTIN;
+#endif
+}
+
+const char* png_inflate_engine_name(PngInflateEngine engine) {
+    return png_inflate_resolve(engine) == PNG_INFLATE_ZLIB ? "zlib" : "builtin";
+}
+
+int png_inflate_parse_engine(const char* name, PngInflateEngine* engine) {
+    if (strcmp(name, "zlib") == 0) *engine = PNG_INFLATE_ZLIB;
+    else if (strcmp(name, "builtin") == 0) *engine = PNG_INFLATE_BUILTIN;
+    else return -1;
+    return 0;
+}
+
+const char* png_inflate_status_string(PngInflateStatus status) {
+    switch (status) {
+        case PNG_INFLATE_OK: return "aucune erreur";
+        case PNG_INFLATE_BAD_HEADER: return "en-tête zlib invalide";
+        case PNG_INFLATE_BAD_BLOCK: return "type de bloc deflate invalide";
+        case PNG_INFLATE_BAD_STORED: return "longueur de bloc non compressé invalide";
+        case PNG_INFLATE_BAD_CODES: return "table de Huffman invalide";
+        case PNG_INFLATE_BAD_SYMBOL: return "code de Huffman invalide";
+        case PNG_INFLATE_BAD_DISTANCE: return "distance de copie hors des données";
+        case PNG_INFLATE_TRUNCATED: return "flux compressé tronqué";
+        case PNG_INFLATE_SHORT: return "flux terminé avant la fin de l'image";
+        case PNG_INFLATE_BAD_CHECKSUM: return "somme de contrôle Adler-32 incorrecte";
+    }
+    return "erreur inconnue";
+}
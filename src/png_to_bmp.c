@@ -1,92 +1,315 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <stdint.h>
-#include <string.h>
-#include <errno.h>
-
-#include "../headers/png_to_bmp.h"
-#include "../headers/png.h"
-#include "../headers/logger.h"
-
-#pragma pack(push, 1)
-
-typedef struct {
-    uint16_t bfType;
-    uint32_t bfSize;
-    uint16_t bfReserved1;
-    uint16_t bfReserved2;
-    uint32_t bfOffBits;
-} BITMAPFILEHEADER;
-
-typedef struct {
-    uint32_t biSize;
-    int32_t  biWidth;
-    int32_t  biHeight;
-    uint16_t biPlanes;
-    uint16_t biBitCount;
-    uint32_t biCompression;
-    uint32_t biSizeImage;
-    int32_t  biXPelsPerMeter;
-    int32_t  biYPelsPerMeter;
-    uint32_t biClrUsed;
-    uint32_t biClrImportant;
-} BITMAPINFOHEADER;
-
-#pragma pack(pop)
-
-int png_save_to_bmp(Logger* logger, const char* output_filename, const PngImage* png, const unsigned char* pixel_data) {
-    if (!png || !pixel_data) {
-        log_error(logger, "Données d'image invalides pour la conversion BMP.");
-        return -1;
-    }
-    if (png->bytes_per_pixel < 3) {
-        log_error(logger, "Conversion BMP non supportée pour les images avec moins de 3 octets par pixel.");
-        return -1;
-    }
-    FILE* bmp_file = fopen(output_filename, "wb");
-    if (!bmp_file) {
-        log_error(logger, "Erreur lors de la création du fichier BMP '%s': %s", output_filename, strerror(errno));
-        return -1;
-    }
-    const int width = png->width;
-    const int height = png->height;
-    const int bpp_png = png->bytes_per_pixel;
-    int padding = (4 - (width * 3) % 4) % 4;
-    uint32_t row_size_bmp = width * 3 + padding;
-    uint32_t pixel_data_size = row_size_bmp * height;
-    BITMAPFILEHEADER file_header;
-    file_header.bfType = 0x4D42;
-    file_header.bfSize = sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER) + pixel_data_size;
-    file_header.bfReserved1 = 0;
-    file_header.bfReserved2 = 0;
-    file_header.bfOffBits = sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER);
-    BITMAPINFOHEADER info_header;
-    info_header.biSize = sizeof(BITMAPINFOHEADER);
-    info_header.biWidth = width;
-    info_header.biHeight = height;
-    info_header.biPlanes = 1;
-    info_header.biBitCount = 24; 
-    info_header.biCompression = 0; 
-    info_header.biSizeImage = pixel_data_size;
-    info_header.biXPelsPerMeter = 2835; 
-    info_header.biYPelsPerMeter = 2835; 
-    info_header.biClrUsed = 0;
-    info_header.biClrImportant = 0;
-    fwrite(&file_header, sizeof(file_header), 1, bmp_file);
-    fwrite(&info_header, sizeof(info_header), 1, bmp_file);
-    unsigned char padding_bytes[3] = {0, 0, 0};
-    for (int y = height - 1; y >= 0; y--) {
-        const unsigned char* png_row = pixel_data + (y * width * bpp_png);
-        for (int x = 0; x < width; x++) {
-            const unsigned char* png_pixel = png_row + (x * bpp_png);
-            unsigned char bmp_pixel[3] = { png_pixel[2], png_pixel[1], png_pixel[0] };
-            fwrite(bmp_pixel, sizeof(bmp_pixel), 1, bmp_file);
-        }
-        if (padding > 0) {
-            fwrite(padding_bytes, 1, padding, bmp_file);
-        }
-    }
-    fclose(bmp_file);
-    log_message(logger, "Image sauvegardée avec succès sous : %s", output_filename);
-    return 0;
-}
\ No newline at end of file
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+#include "../headers/png_to_bmp.h"
+#include "../headers/png.h"
+#include "../headers/logger.h"
+
+#define BMP_ROWS_PER_WRITE 64
+
+/* Un BMP qui partage son inode avec le cache de conversion (lien physique) est remplacé, jamais réécrit sur place. */
+static FILE* open_bmp_output(const char* filename) {
+#ifndef _WIN32
+    struct stat st;
+    if (stat(filename, &st) == 0 && S_ISREG(st.st_mode) && st.st_nlink > 1) unlink(filename);
+#endif
+    return fopen(filename, "wb");
+}
+
+#pragma pack(push, 1)
+
+typedef struct {
+    uint16_t bfType;
+    uint32_t bfSize;
+    uint16_t bfReserved1;
+    uint16_t bfReserved2;
+    uint32_t bfOffBits;
+} BITMAPFILEHEADER;
+
+typedef struct {
+    uint32_t biSize;
+    int32_t  biWidth;
+    int32_t  biHeight;
+    uint16_t biPlanes;
+    uint16_t biBitCount;
+    uint32_t biCompression;
+    uint32_t biSizeImage;
+    int32_t  biXPelsPerMeter;
+    int32_t  biYPelsPerMeter;
+    uint32_t biClrUsed;
+    uint32_t biClrImportant;
+} BITMAPINFOHEADER;
+
+/* En-tête des BMP 32 bits : masques des canaux (alpha compris) et espace sRGB. */
+typedef struct {
+    BITMAPINFOHEADER info;
+    uint32_t bV5RedMask;
+    uint32_t bV5GreenMask;
+    uint32_t bV5BlueMask;
+    uint32_t bV5AlphaMask;
+    uint32_t bV5CSType;
+    int32_t  bV5Endpoints[9];
+    uint32_t bV5GammaRed;
+    uint32_t bV5GammaGreen;
+    uint32_t bV5GammaBlue;
+    uint32_t bV5Intent;
+    uint32_t bV5ProfileData;
+    uint32_t bV5ProfileSize;
+    uint32_t bV5Reserved;
+} BITMAPV5HEADER;
+
+#pragma pack(pop)
+
+#define BMP_BI_RGB 0
+#define BMP_BI_BITFIELDS 3
+#define BMP_LCS_SRGB 0x73524742
+#define BMP_LCS_GM_IMAGES 4
+
+typedef struct BmpStreamWriter {
+    FILE* file;
+    uint32_t height;
+    uint32_t row_size;
+    uint32_t width;
+    uint32_t bits;
+    uint32_t pixel_offset;
+    unsigned char* row_buffer;
+} BmpStreamWriter;
+
+/* Bits par pixel du fichier : les images décodées en PNG_FORMAT_RGB sont écrites en 24 bits. */
+static uint32_t bmp_bits(const PngImage* png) {
+    return png->pixel_format == PNG_FORMAT_RGB ? 24 : png->bits_per_pixel;
+}
+
+#define BMP_MAX_HEADERS (sizeof(BITMAPFILEHEADER) + sizeof(BITMAPV5HEADER) + 256 * 4)
+
+/* En-têtes et table des couleurs dans headers (BMP_MAX_HEADERS octets) ; retourne leur taille. */
+static uint32_t build_bmp_headers(const PngImage* png, unsigned char* headers, uint32_t* row_size_out) {
+    const uint32_t bits = bmp_bits(png);
+    const uint32_t colors = png->pixel_format == PNG_FORMAT_BMP_INDEXED ? png->index_color_count : 0;
+    uint32_t row_size_bmp = (uint32_t)png_row_size(png->width, bits, PNG_FORMAT_BMP);
+    uint32_t pixel_data_size = row_size_bmp * png->height;
+    BITMAPV5HEADER v5;
+    memset(&v5, 0, sizeof(v5));
+    BITMAPINFOHEADER* info_header = &v5.info;
+    info_header->biSize = bits == 32 ? sizeof(BITMAPV5HEADER) : sizeof(BITMAPINFOHEADER);
+    info_header->biWidth = (int32_t)png->width;
+    info_header->biHeight = (int32_t)png->height;
+    info_header->biPlanes = 1;
+    info_header->biBitCount = (uint16_t)bits;
+    info_header->biCompression = bits == 32 ? BMP_BI_BITFIELDS : BMP_BI_RGB;
+    info_header->biSizeImage = pixel_data_size;
+    info_header->biXPelsPerMeter = 2835; 
+    info_header->biYPelsPerMeter = 2835; 
+    info_header->biClrUsed = colors;
+    info_header->biClrImportant = 0;
+    if (bits == 32) {
+        v5.bV5RedMask = 0x00FF0000;
+        v5.bV5GreenMask = 0x0000FF00;
+        v5.bV5BlueMask = 0x000000FF;
+        v5.bV5AlphaMask = 0xFF000000;
+        v5.bV5CSType = BMP_LCS_SRGB;
+        v5.bV5Intent = BMP_LCS_GM_IMAGES;
+    }
+    BITMAPFILEHEADER file_header;
+    file_header.bfType = 0x4D42;
+    file_header.bfOffBits = sizeof(BITMAPFILEHEADER) + info_header->biSize + colors * 4;
+    file_header.bfSize = file_header.bfOffBits + pixel_data_size;
+    file_header.bfReserved1 = 0;
+    file_header.bfReserved2 = 0;
+    memcpy(headers, &file_header, sizeof(file_header));
+    memcpy(headers + sizeof(file_header), &v5, info_header->biSize);
+    unsigned char* table = headers + sizeof(file_header) + info_header->biSize;
+    for (uint32_t i = 0; i < colors; i++) {
+        const RGBA* c = &png->index_colors[i];
+        table[i * 4] = c->b; table[i * 4 + 1] = c->g; table[i * 4 + 2] = c->r; table[i * 4 + 3] = 0;
+    }
+    *row_size_out = row_size_bmp;
+    return file_header.bfOffBits;
+}
+
+static int write_bmp_headers(FILE* bmp_file, const PngImage* png, uint32_t* row_size_out, uint32_t* pixel_offset) {
+    unsigned char headers[BMP_MAX_HEADERS];
+    *pixel_offset = build_bmp_headers(png, headers, row_size_out);
+    return fwrite(headers, *pixel_offset, 1, bmp_file) == 1 ? 0 : -1;
+}
+
+int png_buffer_reserve(PngBuffer* buffer, size_t size) {
+    if (size <= buffer->capacity) return 0;
+    size_t capacity = buffer->capacity ? buffer->capacity : 4096;
+    while (capacity < size) capacity *= 2;
+    unsigned char* data = realloc(buffer->data, capacity);
+    if (!data) return -1;
+    buffer->data = data;
+    buffer->capacity = capacity;
+    return 0;
+}
+
+/* Les pixels sont décodés directement à leur place dans le fichier, derrière les en-têtes. */
+static unsigned char* bmp_memory_allocate(void* user, const PngImage* png, size_t size) {
+    PngBuffer* out = user;
+    unsigned char headers[BMP_MAX_HEADERS];
+    uint32_t row_size;
+    size_t offset = build_bmp_headers(png, headers, &row_size);
+    if (png_buffer_reserve(out, offset + size) != 0) return NULL;
+    out->size = offset + size;
+    return out->data + offset;
+}
+
+static double monotonic_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int png_save_to_bmp(Logger* logger, const char* output_filename, const PngImage* png, const unsigned char* pixel_data) {
+    return png_save_to_bmp_ex(logger, output_filename, png, pixel_data, NULL);
+}
+
+int png_save_to_bmp_ex(Logger* logger, const char* output_filename, const PngImage* png, const unsigned char* pixel_data, PngStats* stats) {
+    double start = stats ? monotonic_seconds() : 0.0;
+    if (!png || !pixel_data) {
+        log_error(logger, "Données d'image invalides pour la conversion BMP.");
+        return -1;
+    }
+    if (png->pixel_format == PNG_FORMAT_RGB ? png->bytes_per_pixel != 3 : png->pixel_format == PNG_FORMAT_BMP_AUTO) {
+        log_error(logger, "Format de pixels non supporté pour la conversion BMP.");
+        return -1;
+    }
+    FILE* bmp_file = open_bmp_output(output_filename);
+    if (!bmp_file) {
+        log_error(logger, "Erreur lors de la création du fichier BMP '%s': %s", output_filename, strerror(errno));
+        return -1;
+    }
+    /* Les écritures sont déjà groupées : inutile de recopier dans le tampon de stdio. */
+    setvbuf(bmp_file, NULL, _IONBF, 0);
+    const uint32_t width = png->width;
+    const uint32_t height = png->height;
+    uint32_t row_size_bmp, pixel_offset;
+    int status = write_bmp_headers(bmp_file, png, &row_size_bmp, &pixel_offset);
+    if (status == 0 && png->pixel_format != PNG_FORMAT_RGB) {
+        /* Décodé directement dans la disposition BMP : une seule écriture pour tous les pixels. */
+        size_t size = (size_t)row_size_bmp * height;
+        if (fwrite(pixel_data, 1, size, bmp_file) != size) status = -1;
+    } else if (status == 0) {
+        unsigned char* rows = calloc(BMP_ROWS_PER_WRITE, row_size_bmp);
+        if (!rows) status = -1;
+        for (uint32_t done = 0; status == 0 && done < height; ) {
+            uint32_t count = height - done < BMP_ROWS_PER_WRITE ? height - done : BMP_ROWS_PER_WRITE;
+            for (uint32_t i = 0; i < count; i++) {
+                const unsigned char* png_row = pixel_data + (size_t)(height - 1 - done - i) * png->row_size;
+                unsigned char* bmp_row = rows + (size_t)i * row_size_bmp;
+                for (uint32_t x = 0; x < width; x++) {
+                    bmp_row[x * 3] = png_row[x * 3 + 2];
+                    bmp_row[x * 3 + 1] = png_row[x * 3 + 1];
+                    bmp_row[x * 3 + 2] = png_row[x * 3];
+                }
+            }
+            if (fwrite(rows, row_size_bmp, count, bmp_file) != count) status = -1;
+            done += count;
+        }
+        free(rows);
+    }
+    if (fclose(bmp_file) != 0) status = -1;
+    if (status != 0) {
+        log_error(logger, "Erreur d'écriture du fichier BMP '%s'.", output_filename);
+        return -1;
+    }
+    if (stats) {
+        double elapsed = monotonic_seconds() - start;
+        stats->write_seconds += elapsed;
+        stats->total_seconds += elapsed;
+        stats->bytes_out += pixel_offset + (uint64_t)row_size_bmp * height;
+    }
+    log_message(logger, "Image sauvegardée avec succès sous : %s", output_filename);
+    return 0;
+}
+
+int png_to_bmp_memory(const uint8_t* in, size_t size, PngBuffer* out, const PngDecodeOptions* options) {
+    return png_to_bmp_memory_ex(NULL, in, size, out, options);
+}
+
+int png_to_bmp_memory_ex(PngDecoder* decoder, const uint8_t* in, size_t size, PngBuffer* out, const PngDecodeOptions* options) {
+    PngDecodeOptions bmp_options;
+    if (options) bmp_options = *options;
+    else png_options_init(&bmp_options);
+    if (bmp_options.format == PNG_FORMAT_RGB) bmp_options.format = PNG_FORMAT_BMP;
+    bmp_options.allocate = bmp_memory_allocate;
+    bmp_options.allocate_user = out;
+    PngDecoder* dec = decoder ? decoder : png_decoder_create();
+    PngImage png;
+    out->size = 0;
+    int status = dec ? png_decode_into(dec, in, size, &bmp_options, &png) : -1;
+    if (status == 0) {
+        double start = bmp_options.stats ? monotonic_seconds() : 0.0;
+        uint32_t row_size;
+        build_bmp_headers(&png, out->data, &row_size);
+        if (bmp_options.stats) {
+            double elapsed = monotonic_seconds() - start;
+            bmp_options.stats->write_seconds += elapsed;
+            bmp_options.stats->total_seconds += elapsed;
+            bmp_options.stats->bytes_out += out->size;
+        }
+    } else {
+        out->size = 0;
+    }
+    if (!decoder) png_decoder_destroy(dec);
+    return status;
+}
+
+static int bmp_stream_begin(void* user, const PngImage* png) {
+    BmpStreamWriter* writer = user;
+    writer->width = png->width;
+    writer->height = png->height;
+    writer->bits = bmp_bits(png);
+    if (write_bmp_headers(writer->file, png, &writer->row_size, &writer->pixel_offset) != 0) return -1;
+    writer->row_buffer = calloc(1, writer->row_size);
+    if (!writer->row_buffer) return -1;
+    /* Préallocation : les lignes arrivent de haut en bas mais le BMP est stocké de bas en haut. */
+    long last_byte = (long)writer->pixel_offset + (long)writer->row_size * writer->height - 1;
+    if (fseek(writer->file, last_byte, SEEK_SET) != 0 || fputc(0, writer->file) == EOF) return -1;
+    return 0;
+}
+
+static int bmp_stream_row(void* user, uint32_t y, const unsigned char* rgb_row) {
+    BmpStreamWriter* writer = user;
+    /* Les lignes arrivent déjà dans la disposition BMP ; seul le bourrage reste à ajouter. */
+    memcpy(writer->row_buffer, rgb_row, ((size_t)writer->width * writer->bits + 7) / 8);
+    long offset = (long)writer->pixel_offset + (long)writer->row_size * (writer->height - 1 - y);
+    if (fseek(writer->file, offset, SEEK_SET) != 0) return -1;
+    return fwrite(writer->row_buffer, 1, writer->row_size, writer->file) == writer->row_size ? 0 : -1;
+}
+
+int png_stream_to_bmp(Logger* logger, const char* input_filename, const char* output_filename, const PngDecodeOptions* options) {
+    BmpStreamWriter writer;
+    memset(&writer, 0, sizeof(writer));
+    writer.file = open_bmp_output(output_filename);
+    if (!writer.file) {
+        log_error(logger, "Erreur lors de la création du fichier BMP '%s': %s", output_filename, strerror(errno));
+        return -1;
+    }
+    PngDecodeOptions bmp_options;
+    if (options) bmp_options = *options;
+    else png_options_init(&bmp_options);
+    if (bmp_options.format == PNG_FORMAT_RGB) bmp_options.format = PNG_FORMAT_BMP;
+    PngRowSink sink = { bmp_stream_begin, bmp_stream_row, &writer };
+    int status = png_stream_from_file(input_filename, &bmp_options, &sink);
+    free(writer.row_buffer);
+    if (fclose(writer.file) != 0) status = -1;
+    if (status != 0) {
+        log_error(logger, "Echec de la conversion en flux de '%s' vers '%s'.", input_filename, output_filename);
+        return -1;
+    }
+    if (bmp_options.stats) bmp_options.stats->bytes_out += writer.pixel_offset + (uint64_t)writer.row_size * writer.height;
+    log_message(logger, "Image sauvegardée avec succès sous : %s", output_filename);
+    return 0;
+}
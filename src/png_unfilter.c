@@ -0,0 +1,344 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "../headers/png_unfilter.h"
+
+#if !defined(PNG_NO_SIMD) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PNG_UNFILTER_X86 1
+#include <immintrin.h>
+#endif
+
+int png_unfilter_row_reference(uint8_t filter_type, const unsigned char* src, unsigned char* dst, const unsigned char* prev_line, size_t stride, size_t filter_bpp) {
+    for (size_t x = 0; x < stride; x++) {
+        uint8_t raw = src[x];
+        uint8_t left = (x >= filter_bpp) ? dst[x - filter_bpp] : 0;
+        uint8_t up = (prev_line != NULL) ? prev_line[x] : 0;
+        uint8_t up_left = (prev_line != NULL && x >= filter_bpp) ? prev_line[x - filter_bpp] : 0;
+        switch (filter_type) {
+            case 0: dst[x] = raw; break; case 1: dst[x] = raw + left; break; case 2: dst[x] = raw + up; break;
+            case 3: dst[x] = raw + ((left + up) / 2); break;
+            case 4: { int p = left + up - up_left; int pa = abs(p - left), pb = abs(p - up), pc = abs(p - up_left); dst[x] = raw + ((pa <= pb && pa <= pc) ? left : (pb <= pc ? up : up_left)); break; }
+            default: return -1;
+        }
+    }
+    return 0;
+}
+
+static inline uint8_t paeth_predict(int a, int b, int c) {
+    int pa = abs(b - c), pb = abs(a - c), pc = abs(a + b - 2 * c);
+    int nearest = (pb < pa) ? b : a;
+    int smallest = (pb < pa) ? pb : pa;
+    return (uint8_t)((pc < smallest) ? c : nearest);
+}
+
+static void unfilter_none(unsigned char* dst, const unsigned char* src, const unsigned char* prev, size_t stride) {
+    (void)prev;
+    memcpy(dst, src, stride);
+}
+
+static void unfilter_up(unsigned char* dst, const unsigned char* src, const unsigned char* prev, size_t stride) {
+    for (size_t x = 0; x < stride; x++) dst[x] = (unsigned char)(src[x] + prev[x]);
+}
+
+#define DEFINE_SCALAR_KERNELS(BPP) \
+static void unfilter_sub_##BPP(unsigned char* dst, const unsigned char* src, const unsigned char* prev, size_t stride) { \
+    size_t x = 0; \
+    (void)prev; \
+    for (; x < BPP && x < stride; x++) dst[x] = src[x]; \
+    for (; x < stride; x++) dst[x] = (unsigned char)(src[x] + dst[x - BPP]); \
+} \
+static void unfilter_avg_##BPP(unsigned char* dst, const unsigned char* src, const unsigned char* prev, size_t stride) { \
+    size_t x = 0; \
+    for (; x < BPP && x < stride; x++) dst[x] = (unsigned char)(src[x] + (prev[x] >> 1)); \
+    for (; x < stride; x++) dst[x] = (unsigned char)(src[x] + ((dst[x - BPP] + prev[x]) >> 1)); \
+} \
+static void unfilter_paeth_##BPP(unsigned char* dst, const unsigned char* src, const unsigned char* prev, size_t stride) { \
+    size_t x = 0; \
+    for (; x < BPP && x < stride; x++) dst[x] = (unsigned char)(src[x] + prev[x]); \
+    for (; x < stride; x++) dst[x] = (unsigned char)(src[x] + paeth_predict(dst[x - BPP], prev[x], prev[x - BPP])); \
+}
+
+DEFINE_SCALAR_KERNELS(1)
+DEFINE_SCALAR_KERNELS(2)
+DEFINE_SCALAR_KERNELS(3)
+DEFINE_SCALAR_KERNELS(4)
+DEFINE_SCALAR_KERNELS(6)
+DEFINE_SCALAR_KERNELS(8)
+
+#define SCALAR_KERNEL_ROW(NAME) { NULL, NAME##_1, NAME##_2, NAME##_3, NAME##_4, NULL, NAME##_6, NULL, NAME##_8 }
+
+#define SCALAR_KERNEL_TABLE { \
+    { NULL, unfilter_none, unfilter_none, unfilter_none, unfilter_none, NULL, unfilter_none, NULL, unfilter_none }, \
+    SCALAR_KERNEL_ROW(unfilter_sub), \
+    { NULL, unfilter_up, unfilter_up, unfilter_up, unfilter_up, NULL, unfilter_up, NULL, unfilter_up }, \
+    SCALAR_KERNEL_ROW(unfilter_avg), \
+    SCALAR_KERNEL_ROW(unfilter_paeth) \
+}
+
+static const PngUnfilterKernel scalar_kernels[5][9] = SCALAR_KERNEL_TABLE;
+static PngUnfilterKernel unfilter_kernels[5][9] = SCALAR_KERNEL_TABLE;
+
+#ifdef PNG_UNFILTER_X86
+
+#define TARGET(isa) __attribute__((target(isa)))
+
+TARGET("sse2") static void unfilter_up_sse2(unsigned char* dst, const unsigned char* src, const unsigned char* prev, size_t stride) {
+    size_t x = 0;
+    for (; x + 16 <= stride; x += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(src + x));
+        __m128i b = _mm_loadu_si128((const __m128i*)(prev + x));
+        _mm_storeu_si128((__m128i*)(dst + x), _mm_add_epi8(a, b));
+    }
+    for (; x < stride; x++) dst[x] = (unsigned char)(src[x] + prev[x]);
+}
+
+TARGET("avx2") static void unfilter_up_avx2(unsigned char* dst, const unsigned char* src, const unsigned char* prev, size_t stride) {
+    size_t x = 0;
+    for (; x + 32 <= stride; x += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(src + x));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(prev + x));
+        _mm256_storeu_si256((__m256i*)(dst + x), _mm256_add_epi8(a, b));
+    }
+    for (; x < stride; x++) dst[x] = (unsigned char)(src[x] + prev[x]);
+}
+
+/* Sub : somme préfixe par décalages dans le registre, la retenue est le dernier pixel du bloc précédent diffusé. */
+TARGET("sse2") static void unfilter_sub4_sse2(unsigned char* dst, const unsigned char* src, const unsigned char* prev, size_t stride) {
+    __m128i carry = _mm_setzero_si128();
+    size_t x = 0;
+    (void)prev;
+    for (; x + 16 <= stride; x += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(src + x));
+        a = _mm_add_epi8(a, _mm_slli_si128(a, 4));
+        a = _mm_add_epi8(a, _mm_slli_si128(a, 8));
+        a = _mm_add_epi8(a, carry);
+        _mm_storeu_si128((__m128i*)(dst + x), a);
+        carry = _mm_shuffle_epi32(a, 0xFF);
+    }
+    for (; x < stride; x++) dst[x] = (unsigned char)(src[x] + (x >= 4 ? dst[x - 4] : 0));
+}
+
+TARGET("sse2") static void unfilter_sub8_sse2(unsigned char* dst, const unsigned char* src, const unsigned char* prev, size_t stride) {
+    __m128i carry = _mm_setzero_si128();
+    size_t x = 0;
+    (void)prev;
+    for (; x + 16 <= stride; x += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(src + x));
+        a = _mm_add_epi8(a, _mm_slli_si128(a, 8));
+        a = _mm_add_epi8(a, carry);
+        _mm_storeu_si128((__m128i*)(dst + x), a);
+        carry = _mm_unpackhi_epi64(a, a);
+    }
+    for (; x < stride; x++) dst[x] = (unsigned char)(src[x] + (x >= 8 ? dst[x - 8] : 0));
+}
+
+/* bpp 3 et 6 : 12 octets utiles par itération, les 4 derniers octets écrits sont recalculés au tour suivant. */
+TARGET("ssse3") static void unfilter_sub3_ssse3(unsigned char* dst, const unsigned char* src, const unsigned char* prev, size_t stride) {
+    const __m128i last_pixel = _mm_setr_epi8(9, 10, 11, 9, 10, 11, 9, 10, 11, 9, 10, 11, -1, -1, -1, -1);
+    __m128i carry = _mm_setzero_si128();
+    size_t x = 0;
+    (void)prev;
+    for (; x + 16 <= stride; x += 12) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(src + x));
+        a = _mm_add_epi8(a, _mm_slli_si128(a, 3));
+        a = _mm_add_epi8(a, _mm_slli_si128(a, 6));
+        a = _mm_add_epi8(a, carry);
+        _mm_storeu_si128((__m128i*)(dst + x), a);
+        carry = _mm_shuffle_epi8(a, last_pixel);
+    }
+    for (; x < stride; x++) dst[x] = (unsigned char)(src[x] + (x >= 3 ? dst[x - 3] : 0));
+}
+
+TARGET("ssse3") static void unfilter_sub6_ssse3(unsigned char* dst, const unsigned char* src, const unsigned char* prev, size_t stride) {
+    const __m128i last_pixel = _mm_setr_epi8(6, 7, 8, 9, 10, 11, 6, 7, 8, 9, 10, 11, -1, -1, -1, -1);
+    __m128i carry = _mm_setzero_si128();
+    size_t x = 0;
+    (void)prev;
+    for (; x + 16 <= stride; x += 12) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(src + x));
+        a = _mm_add_epi8(a, _mm_slli_si128(a, 6));
+        a = _mm_add_epi8(a, carry);
+        _mm_storeu_si128((__m128i*)(dst + x), a);
+        carry = _mm_shuffle_epi8(a, last_pixel);
+    }
+    for (; x < stride; x++) dst[x] = (unsigned char)(src[x] + (x >= 6 ? dst[x - 6] : 0));
+}
+
+TARGET("avx2") static void unfilter_sub4_avx2(unsigned char* dst, const unsigned char* src, const unsigned char* prev, size_t stride) {
+    __m256i carry = _mm256_setzero_si256();
+    const __m256i last_dword = _mm256_set1_epi32(7);
+    size_t x = 0;
+    (void)prev;
+    for (; x + 32 <= stride; x += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(src + x));
+        a = _mm256_add_epi8(a, _mm256_slli_si256(a, 4));
+        a = _mm256_add_epi8(a, _mm256_slli_si256(a, 8));
+        a = _mm256_add_epi8(a, _mm256_shuffle_epi32(_mm256_permute2x128_si256(a, a, 0x08), 0xFF));
+        a = _mm256_add_epi8(a, carry);
+        _mm256_storeu_si256((__m256i*)(dst + x), a);
+        carry = _mm256_permutevar8x32_epi32(a, last_dword);
+    }
+    for (; x < stride; x++) dst[x] = (unsigned char)(src[x] + (x >= 4 ? dst[x - 4] : 0));
+}
+
+TARGET("avx2") static void unfilter_sub8_avx2(unsigned char* dst, const unsigned char* src, const unsigned char* prev, size_t stride) {
+    __m256i carry = _mm256_setzero_si256();
+    size_t x = 0;
+    (void)prev;
+    for (; x + 32 <= stride; x += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(src + x));
+        a = _mm256_add_epi8(a, _mm256_slli_si256(a, 8));
+        a = _mm256_add_epi8(a, _mm256_shuffle_epi32(_mm256_permute2x128_si256(a, a, 0x08), 0xEE));
+        a = _mm256_add_epi8(a, carry);
+        _mm256_storeu_si256((__m256i*)(dst + x), a);
+        carry = _mm256_permute4x64_epi64(a, 0xFF);
+    }
+    for (; x < stride; x++) dst[x] = (unsigned char)(src[x] + (x >= 8 ? dst[x - 8] : 0));
+}
+
+TARGET("sse2") static inline __m128i load_pixel(const unsigned char* p, size_t bpp) {
+    uint64_t v = 0;
+    memcpy(&v, p, bpp);
+    return _mm_loadl_epi64((const __m128i*)&v);
+}
+
+TARGET("sse2") static inline void store_pixel(unsigned char* p, __m128i pixel, size_t bpp) {
+    uint64_t v;
+    _mm_storel_epi64((__m128i*)&v, pixel);
+    memcpy(p, &v, bpp);
+}
+
+TARGET("sse2") static inline __m128i abs_epi16(__m128i x) {
+    return _mm_max_epi16(x, _mm_sub_epi16(_mm_setzero_si128(), x));
+}
+
+TARGET("sse2") static inline __m128i if_then_else(__m128i c, __m128i t, __m128i e) {
+    return _mm_or_si128(_mm_and_si128(c, t), _mm_andnot_si128(c, e));
+}
+
+/* Average et Paeth : un pixel par itération, jusqu'à 8 octets traités en parallèle (16 bits par canal pour Paeth).
+   Tant qu'il reste de la place dans la ligne, les pixels de 3 et 6 octets sont lus et écrits sur 4 et 8 octets. */
+#define WIDE_BYTES(BPP) ((BPP) == 3 ? 4 : (BPP) == 6 ? 8 : (BPP))
+
+#define AVG_STEP(BPP, N) { \
+    __m128i b = load_pixel(prev + x, N); \
+    __m128i avg = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one)); \
+    a = _mm_add_epi8(load_pixel(src + x, N), avg); \
+    store_pixel(dst + x, a, N); \
+}
+
+#define PAETH_STEP(BPP, N) { \
+    __m128i b = _mm_unpacklo_epi8(load_pixel(prev + x, N), zero); \
+    __m128i pa = abs_epi16(_mm_sub_epi16(b, c)); \
+    __m128i pb = abs_epi16(_mm_sub_epi16(a, c)); \
+    __m128i pc = abs_epi16(_mm_sub_epi16(_mm_add_epi16(a, b), _mm_add_epi16(c, c))); \
+    __m128i smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb)); \
+    __m128i nearest = if_then_else(_mm_cmpeq_epi16(smallest, pa), a, if_then_else(_mm_cmpeq_epi16(smallest, pb), b, c)); \
+    __m128i out = _mm_add_epi8(load_pixel(src + x, N), _mm_packus_epi16(nearest, nearest)); \
+    store_pixel(dst + x, out, N); \
+    a = _mm_unpacklo_epi8(out, zero); \
+    c = b; \
+}
+
+#define DEFINE_SSE2_KERNELS(BPP) \
+TARGET("sse2") static void unfilter_avg##BPP##_sse2(unsigned char* dst, const unsigned char* src, const unsigned char* prev, size_t stride) { \
+    const __m128i one = _mm_set1_epi8(1); \
+    __m128i a = _mm_setzero_si128(); \
+    size_t x = 0; \
+    for (; x + WIDE_BYTES(BPP) <= stride; x += BPP) AVG_STEP(BPP, WIDE_BYTES(BPP)) \
+    for (; x + BPP <= stride; x += BPP) AVG_STEP(BPP, BPP) \
+} \
+TARGET("sse2") static void unfilter_paeth##BPP##_sse2(unsigned char* dst, const unsigned char* src, const unsigned char* prev, size_t stride) { \
+    const __m128i zero = _mm_setzero_si128(); \
+    __m128i a = zero, c = zero; \
+    size_t x = 0; \
+    for (; x + WIDE_BYTES(BPP) <= stride; x += BPP) PAETH_STEP(BPP, WIDE_BYTES(BPP)) \
+    for (; x + BPP <= stride; x += BPP) PAETH_STEP(BPP, BPP) \
+}
+
+DEFINE_SSE2_KERNELS(3)
+DEFINE_SSE2_KERNELS(4)
+DEFINE_SSE2_KERNELS(6)
+DEFINE_SSE2_KERNELS(8)
+
+static PngCpuLevel detect_cpu_level(void) {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return PNG_CPU_AVX2;
+    if (__builtin_cpu_supports("ssse3")) return PNG_CPU_SSSE3;
+    if (__builtin_cpu_supports("sse2")) return PNG_CPU_SSE2;
+    return PNG_CPU_SCALAR;
+}
+
+#else
+
+static PngCpuLevel detect_cpu_level(void) {
+    return PNG_CPU_SCALAR;
+}
+
+#endif
+
+const char* png_unfilter_level_name(PngCpuLevel level) {
+    switch (level) {
+        case PNG_CPU_SCALAR: return "scalar";
+        case PNG_CPU_SSE2: return "sse2";
+        case PNG_CPU_SSSE3: return "ssse3";
+        case PNG_CPU_AVX2: return "avx2";
+        default: return "best";
+    }
+}
+
+static void select_kernels(PngCpuLevel level) {
+    memcpy(unfilter_kernels, scalar_kernels, sizeof(unfilter_kernels));
+#ifdef PNG_UNFILTER_X86
+    if (level >= PNG_CPU_SSE2) {
+        for (int bpp = 1; bpp <= 8; bpp++) if (unfilter_kernels[2][bpp]) unfilter_kernels[2][bpp] = unfilter_up_sse2;
+        unfilter_kernels[1][4] = unfilter_sub4_sse2; unfilter_kernels[1][8] = unfilter_sub8_sse2;
+        unfilter_kernels[3][3] = unfilter_avg3_sse2; unfilter_kernels[3][4] = unfilter_avg4_sse2;
+        unfilter_kernels[3][6] = unfilter_avg6_sse2; unfilter_kernels[3][8] = unfilter_avg8_sse2;
+        unfilter_kernels[4][3] = unfilter_paeth3_sse2; unfilter_kernels[4][4] = unfilter_paeth4_sse2;
+        unfilter_kernels[4][6] = unfilter_paeth6_sse2; unfilter_kernels[4][8] = unfilter_paeth8_sse2;
+    }
+    if (level >= PNG_CPU_SSSE3) {
+        unfilter_kernels[1][3] = unfilter_sub3_ssse3; unfilter_kernels[1][6] = unfilter_sub6_ssse3;
+    }
+    if (level >= PNG_CPU_AVX2) {
+        for (int bpp = 1; bpp <= 8; bpp++) if (unfilter_kernels[2][bpp]) unfilter_kernels[2][bpp] = unfilter_up_avx2;
+        unfilter_kernels[1][4] = unfilter_sub4_avx2; unfilter_kernels[1][8] = unfilter_sub8_avx2;
+    }
+#endif
+}
+
+static pthread_once_t default_kernels_once = PTHREAD_ONCE_INIT;
+
+static void select_default_kernels(void) {
+    select_kernels(detect_cpu_level());
+}
+
+void png_unfilter_ensure_init(void) {
+    pthread_once(&default_kernels_once, select_default_kernels);
+}
+
+PngCpuLevel png_unfilter_init(PngCpuLevel max_level) {
+    /* Le choix par défaut passe d'abord : un décodage ultérieur ne peut plus écraser la limite demandée. */
+    png_unfilter_ensure_init();
+    PngCpuLevel level = detect_cpu_level();
+    if (level > max_level) level = max_level;
+    select_kernels(level);
+    return level;
+}
+
+int png_unfilter_row(uint8_t filter_type, const unsigned char* src, unsigned char* dst, const unsigned char* prev_line, size_t stride, size_t filter_bpp) {
+    if (filter_type > 4 || filter_bpp == 0 || filter_bpp > 8) return -1;
+    if (prev_line == NULL) {
+        /* Première ligne : Up équivaut à None et Paeth à Sub ; Average garde le chemin de référence. */
+        if (filter_type == 2) filter_type = 0;
+        else if (filter_type == 4) filter_type = 1;
+        else if (filter_type == 3) return png_unfilter_row_reference(filter_type, src, dst, NULL, stride, filter_bpp);
+    }
+    PngUnfilterKernel kernel = unfilter_kernels[filter_type][filter_bpp];
+    if (!kernel) return png_unfilter_row_reference(filter_type, src, dst, prev_line, stride, filter_bpp);
+    kernel(dst, src, prev_line, stride);
+    return 0;
+}
@@ -0,0 +1,460 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "../headers/server.h"
+
+#ifdef _WIN32
+
+int server_run(Logger* logger, const ServerConfig* config) {
+    (void)config;
+    log_error(logger, "Le mode --serve n'est pas disponible sous Windows.");
+    return -1;
+}
+
+int server_connect(const char* socket_path) { (void)socket_path; return -1; }
+int server_send_request(int fd, const ServerRequest* request, const void* data) { (void)fd; (void)request; (void)data; return -1; }
+int server_read_reply(int fd, ServerStatus* status, PngBuffer* payload) { (void)fd; (void)status; (void)payload; return -1; }
+
+#else
+
+#include <signal.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+/* Une connexion inactive libère son thread au bout de ce délai ; un envoi ou une réception bloqués aussi. */
+#define SERVER_IDLE_TIMEOUT_MS 60000
+#define SERVER_IO_TIMEOUT_S 30
+
+typedef struct ConnectionQueue {
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    int* fds;
+    size_t capacity;
+    size_t head;
+    size_t count;
+    bool closed;
+} ConnectionQueue;
+
+struct Server;
+
+typedef struct ServerWorker {
+    pthread_t thread;
+    struct Server* server;
+    PngDecoder* decoder;
+    PngBuffer input;
+    PngBuffer output;
+    PngStats stats;
+    uint64_t requests;
+    uint64_t failures;
+} ServerWorker;
+
+typedef struct Server {
+    Logger* logger;
+    const ServerConfig* config;
+    ConnectionQueue queue;
+    ServerWorker* workers;
+    int worker_count;
+} Server;
+
+/* Le gestionnaire de signal écrit dans ce tube sans jamais le vider : sa lecture reste possible pour tous les
+   threads qui le surveillent. */
+static int stop_pipe[2] = { -1, -1 };
+static volatile sig_atomic_t stop_requested = 0;
+
+static void on_stop_signal(int sig) {
+    (void)sig;
+    int saved = errno;
+    stop_requested = 1;
+    if (write(stop_pipe[1], "", 1) < 0) { /* tube plein : déjà signalé */ }
+    errno = saved;
+}
+
+static void put_u32(unsigned char* p, uint32_t v) {
+    p[0] = (unsigned char)v; p[1] = (unsigned char)(v >> 8); p[2] = (unsigned char)(v >> 16); p[3] = (unsigned char)(v >> 24);
+}
+
+static uint32_t get_u32(const unsigned char* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static int read_full(int fd, void* buffer, size_t size) {
+    unsigned char* p = buffer;
+    while (size > 0) {
+        ssize_t got = read(fd, p, size);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return -1;
+        p += got;
+        size -= (size_t)got;
+    }
+    return 0;
+}
+
+static int write_full(int fd, const void* buffer, size_t size) {
+    const unsigned char* p = buffer;
+    while (size > 0) {
+        ssize_t put = write(fd, p, size);
+        if (put < 0 && errno == EINTR) continue;
+        if (put <= 0) return -1;
+        p += put;
+        size -= (size_t)put;
+    }
+    return 0;
+}
+
+static int fill_address(struct sockaddr_un* address, const char* socket_path) {
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address->sun_path)) return -1;
+    strcpy(address->sun_path, socket_path);
+    return 0;
+}
+
+int server_connect(const char* socket_path) {
+    struct sockaddr_un address;
+    if (fill_address(&address, socket_path) != 0) return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int server_send_request(int fd, const ServerRequest* request, const void* data) {
+    unsigned char header[SERVER_REQUEST_HEADER_SIZE];
+    memcpy(header, "PBRQ", 4);
+    header[4] = request->kind;
+    header[5] = request->format;
+    header[6] = request->has_background ? SERVER_FLAG_BACKGROUND : 0;
+    header[7] = 0;
+    put_u32(header + 8, ((uint32_t)request->background.r << 16) | ((uint32_t)request->background.g << 8) | request->background.b);
+    put_u32(header + 12, request->size);
+    if (write_full(fd, header, sizeof(header)) != 0) return -1;
+    return request->size ? write_full(fd, data, request->size) : 0;
+}
+
+int server_read_reply(int fd, ServerStatus* status, PngBuffer* payload) {
+    unsigned char header[SERVER_REPLY_HEADER_SIZE];
+    if (read_full(fd, header, sizeof(header)) != 0 || memcmp(header, "PBRS", 4) != 0) return -1;
+    *status = (ServerStatus)get_u32(header + 4);
+    uint32_t size = get_u32(header + 8);
+    /* Un octet nul de plus : un motif d'échec se lit comme une chaîne. */
+    if (png_buffer_reserve(payload, (size_t)size + 1) != 0) return -1;
+    if (size && read_full(fd, payload->data, size) != 0) return -1;
+    payload->data[size] = '\0';
+    payload->size = size;
+    return 0;
+}
+
+static int send_reply(int fd, ServerStatus status, const void* data, size_t size) {
+    unsigned char header[SERVER_REPLY_HEADER_SIZE];
+    memcpy(header, "PBRS", 4);
+    put_u32(header + 4, (uint32_t)status);
+    put_u32(header + 8, (uint32_t)size);
+    if (write_full(fd, header, sizeof(header)) != 0) return -1;
+    return size ? write_full(fd, data, size) : 0;
+}
+
+static int send_error(int fd, ServerStatus status, const char* reason) {
+    return send_reply(fd, status, reason, strlen(reason));
+}
+
+static bool queue_push(ConnectionQueue* queue, int fd) {
+    pthread_mutex_lock(&queue->lock);
+    /* File pleine : on cesse d'accepter, le signal d'arrêt est vérifié régulièrement. */
+    while (queue->count == queue->capacity && !stop_requested) {
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_nsec += 100000000L;
+        if (until.tv_nsec >= 1000000000L) { until.tv_sec++; until.tv_nsec -= 1000000000L; }
+        pthread_cond_timedwait(&queue->not_full, &queue->lock, &until);
+    }
+    bool pushed = queue->count < queue->capacity;
+    if (pushed) {
+        queue->fds[(queue->head + queue->count++) % queue->capacity] = fd;
+        pthread_cond_signal(&queue->not_empty);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return pushed;
+}
+
+static int queue_pop(ConnectionQueue* queue) {
+    int fd = -1;
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == 0 && !queue->closed) pthread_cond_wait(&queue->not_empty, &queue->lock);
+    if (queue->count > 0) {
+        fd = queue->fds[queue->head];
+        queue->head = (queue->head + 1) % queue->capacity;
+        queue->count--;
+        pthread_cond_signal(&queue->not_full);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return fd;
+}
+
+static void queue_close(ConnectionQueue* queue) {
+    pthread_mutex_lock(&queue->lock);
+    queue->closed = true;
+    pthread_cond_broadcast(&queue->not_empty);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+static void decode_request_options(const ServerConfig* config, const unsigned char* header, PngDecodeOptions* options) {
+    *options = config->options;
+    if (header[5] != SERVER_FORMAT_DEFAULT && header[5] <= PNG_FORMAT_BMP_AUTO) options->format = (PngPixelFormat)header[5];
+    if (header[6] & SERVER_FLAG_BACKGROUND) {
+        uint32_t rgb = get_u32(header + 8);
+        options->background.r = (rgb >> 16) & 0xFF;
+        options->background.g = (rgb >> 8) & 0xFF;
+        options->background.b = rgb & 0xFF;
+    }
+}
+
+/* Conversion d'un fichier désigné par son chemin : écrit dans destination, ou renvoyé si elle est absente. */
+static int serve_path(ServerWorker* worker, int fd, char* paths, PngDecodeOptions* options) {
+    Logger* logger = worker->server->logger;
+    char* destination = strchr(paths, '\t');
+    if (destination) *destination++ = '\0';
+    PngFileMap map;
+    if (png_map_file(paths, &map) != 0) {
+        log_error(logger, "Lecture impossible : %s", paths);
+        worker->failures++;
+        return send_error(fd, SERVER_IO_ERROR, "lecture du PNG impossible");
+    }
+    PngImage img;
+    int status = destination ? png_decode_into(worker->decoder, map.data, map.size, options, &img)
+                             : png_to_bmp_memory_ex(worker->decoder, map.data, map.size, &worker->output, options);
+    png_unmap_file(&map);
+    if (status != 0) {
+        log_error(logger, "Echec du décodage : %s (%s)", paths, png_decoder_error(worker->decoder));
+        worker->failures++;
+        return send_error(fd, SERVER_DECODE_FAILED, png_decoder_error(worker->decoder));
+    }
+    if (!destination) return send_reply(fd, SERVER_OK, worker->output.data, worker->output.size);
+    if (png_save_to_bmp_ex(logger, destination, &img, img.final_pixel_data, options->stats) != 0) {
+        worker->failures++;
+        return send_error(fd, SERVER_IO_ERROR, "écriture du BMP impossible");
+    }
+    return send_reply(fd, SERVER_OK, NULL, 0);
+}
+
+/* Lit et traite une requête ; -1 ferme la connexion (fin, rupture ou requête illisible). */
+static int serve_request(ServerWorker* worker, int fd) {
+    const ServerConfig* config = worker->server->config;
+    unsigned char header[SERVER_REQUEST_HEADER_SIZE];
+    if (read_full(fd, header, sizeof(header)) != 0) return -1;
+    worker->requests++;
+    const uint32_t size = get_u32(header + 12);
+    const uint8_t kind = header[4];
+    if (memcmp(header, "PBRQ", 4) != 0 || (kind != SERVER_REQUEST_DATA && kind != SERVER_REQUEST_PATH)) {
+        worker->failures++;
+        send_error(fd, SERVER_BAD_REQUEST, "requête invalide");
+        return -1;
+    }
+    if (size > config->max_input) {
+        worker->failures++;
+        send_error(fd, SERVER_TOO_LARGE, "requête trop volumineuse");
+        return -1;
+    }
+    if (png_buffer_reserve(&worker->input, (size_t)size + 1) != 0) {
+        worker->failures++;
+        send_error(fd, SERVER_TOO_LARGE, "mémoire insuffisante");
+        return -1;
+    }
+    if (size && read_full(fd, worker->input.data, size) != 0) return -1;
+    worker->input.data[size] = '\0';
+    PngDecodeOptions options;
+    decode_request_options(config, header, &options);
+    options.stats = config->stats ? &worker->stats : NULL;
+    if (kind == SERVER_REQUEST_PATH) return serve_path(worker, fd, (char*)worker->input.data, &options);
+    if (png_to_bmp_memory_ex(worker->decoder, worker->input.data, size, &worker->output, &options) != 0) {
+        log_error(worker->server->logger, "Echec du décodage d'une requête de %u octets (%s)", size, png_decoder_error(worker->decoder));
+        worker->failures++;
+        return send_error(fd, SERVER_DECODE_FAILED, png_decoder_error(worker->decoder));
+    }
+    log_debug(worker->server->logger, "Requête servie : %u octets PNG, %zu octets BMP", size, worker->output.size);
+    return send_reply(fd, SERVER_OK, worker->output.data, worker->output.size);
+}
+
+/* Requêtes successives d'une connexion. Après l'arrêt, une requête déjà arrivée est encore servie, puis la
+   connexion est fermée. */
+static void serve_connection(ServerWorker* worker, int fd) {
+    for (;;) {
+        struct pollfd fds[2] = { { fd, POLLIN, 0 }, { stop_pipe[0], POLLIN, 0 } };
+        int ready = poll(fds, 2, SERVER_IDLE_TIMEOUT_MS);
+        if (ready < 0 && errno == EINTR) continue;
+        if (ready <= 0 || !(fds[0].revents & (POLLIN | POLLHUP))) break;
+        if (serve_request(worker, fd) != 0 || fds[1].revents) break;
+    }
+    close(fd);
+}
+
+static void* worker_main(void* arg) {
+    ServerWorker* worker = arg;
+    int fd;
+    while ((fd = queue_pop(&worker->server->queue)) >= 0) serve_connection(worker, fd);
+    return NULL;
+}
+
+static int open_listener(Logger* logger, const char* socket_path, int backlog) {
+    struct sockaddr_un address;
+    if (fill_address(&address, socket_path) != 0) {
+        log_error(logger, "Chemin de socket trop long : %s", socket_path);
+        return -1;
+    }
+    /* Un fichier de socket laissé par un serveur arrêté brutalement est remplacé, pas celui d'un serveur actif. */
+    int probe = server_connect(socket_path);
+    if (probe >= 0) {
+        close(probe);
+        log_error(logger, "Un serveur écoute déjà sur %s", socket_path);
+        return -1;
+    }
+    unlink(socket_path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || bind(fd, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(fd, backlog) != 0) {
+        log_error(logger, "Impossible d'écouter sur %s : %s", socket_path, strerror(errno));
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void set_io_timeout(int fd) {
+    struct timeval timeout = { SERVER_IO_TIMEOUT_S, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+static void accept_loop(Server* server, int listener) {
+    while (!stop_requested) {
+        struct pollfd fds[2] = { { listener, POLLIN, 0 }, { stop_pipe[0], POLLIN, 0 } };
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            log_error(server->logger, "Attente des connexions impossible : %s", strerror(errno));
+            break;
+        }
+        if (fds[1].revents) break;
+        int fd = accept(listener, NULL, NULL);
+        if (fd < 0) {
+            /* Plus de descripteurs : on laisse les threads en libérer plutôt que de boucler sur poll. */
+            if (errno == EMFILE || errno == ENFILE) {
+                struct timespec pause = { 0, 100000000L };
+                nanosleep(&pause, NULL);
+            }
+            continue;
+        }
+        set_io_timeout(fd);
+        if (!queue_push(&server->queue, fd)) close(fd);
+    }
+}
+
+int server_run(Logger* logger, const ServerConfig* config) {
+    Server server;
+    memset(&server, 0, sizeof(server));
+    server.logger = logger;
+    server.config = config;
+    server.worker_count = config->threads > 0 ? config->threads : 1;
+    ConnectionQueue* queue = &server.queue;
+    queue->capacity = config->queue_length > 0 ? (size_t)config->queue_length : 4 * (size_t)server.worker_count;
+    queue->fds = malloc(queue->capacity * sizeof(int));
+    server.workers = calloc(server.worker_count, sizeof(ServerWorker));
+    if (!queue->fds || !server.workers || pipe(stop_pipe) != 0) {
+        log_error(logger, "Initialisation du serveur impossible.");
+        free(queue->fds);
+        free(server.workers);
+        return -1;
+    }
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->not_empty, NULL);
+    pthread_cond_init(&queue->not_full, NULL);
+    stop_requested = 0;
+
+    struct sigaction action, old_int, old_term, old_pipe;
+    memset(&action, 0, sizeof(action));
+    sigemptyset(&action.sa_mask);
+    action.sa_handler = on_stop_signal;
+    sigaction(SIGINT, &action, &old_int);
+    sigaction(SIGTERM, &action, &old_term);
+    /* Un client parti avant sa réponse ne doit pas arrêter le serveur. */
+    action.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &action, &old_pipe);
+
+    int status = -1;
+    int started = 0;
+    int listener = open_listener(logger, config->socket_path, (int)queue->capacity);
+    if (listener < 0) goto cleanup;
+    /* Décodeurs créés d'avance : leurs tampons et tables de composition restent chauds d'une requête à l'autre. */
+    for (int w = 0; w < server.worker_count; w++) {
+        ServerWorker* worker = &server.workers[w];
+        worker->server = &server;
+        worker->decoder = png_decoder_create();
+        if (!worker->decoder || pthread_create(&worker->thread, NULL, worker_main, worker) != 0) break;
+        started++;
+    }
+    if (started == 0) {
+        log_error(logger, "Aucun thread de conversion n'a pu démarrer.");
+    } else {
+        log_message(logger, "Serveur à l'écoute sur %s : %d threads, %zu connexions en attente au plus.", config->socket_path, started, queue->capacity);
+        accept_loop(&server, listener);
+        status = 0;
+    }
+    close(listener);
+    unlink(config->socket_path);
+    log_message(logger, "Arrêt du serveur : fin des requêtes en cours.");
+cleanup:
+    queue_close(queue);
+    for (int w = 0; w < started; w++) pthread_join(server.workers[w].thread, NULL);
+    uint64_t requests = 0, failures = 0;
+    for (int w = 0; w < server.worker_count; w++) {
+        ServerWorker* worker = &server.workers[w];
+        requests += worker->requests;
+        failures += worker->failures;
+        if (config->stats) png_stats_add(config->stats, &worker->stats);
+        png_decoder_destroy(worker->decoder);
+        free(worker->input.data);
+        free(worker->output.data);
+    }
+    if (listener >= 0) log_message(logger, "Serveur arrêté : %llu requêtes, %llu échecs.", (unsigned long long)requests, (unsigned long long)failures);
+    while (queue->count > 0) {
+        close(queue->fds[queue->head]);
+        queue->head = (queue->head + 1) % queue->capacity;
+        queue->count--;
+    }
+    sigaction(SIGINT, &old_int, NULL);
+    sigaction(SIGTERM, &old_term, NULL);
+    sigaction(SIGPIPE, &old_pipe, NULL);
+    close(stop_pipe[0]);
+    close(stop_pipe[1]);
+    stop_pipe[0] = stop_pipe[1] = -1;
+    pthread_cond_destroy(&queue->not_full);
+    pthread_cond_destroy(&queue->not_empty);
+    pthread_mutex_destroy(&queue->lock);
+    free(queue->fds);
+    free(server.workers);
+    return status;
+}
+
+#endif
+
+const char* server_status_string(ServerStatus status) {
+    switch (status) {
+        case SERVER_OK: return "succès";
+        case SERVER_BAD_REQUEST: return "requête invalide";
+        case SERVER_TOO_LARGE: return "requête trop volumineuse";
+        case SERVER_DECODE_FAILED: return "échec du décodage";
+        case SERVER_IO_ERROR: return "erreur d'entrée/sortie";
+    }
+    return "statut inconnu";
+}
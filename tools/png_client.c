@@ -0,0 +1,224 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "../headers/png.h"
+#include "../headers/png_to_bmp.h"
+#include "../headers/server.h"
+
+/* Client de test du mode --serve : envoie chaque paire source/destination sur une seule connexion, --repeat fois,
+   et affiche le débit obtenu sur la sortie d'erreur. */
+static const char* usage =
+    "Usage: %s [--path] [--format auto|24|32|index] [--background RRGGBB] [--repeat N] <socket> <source.png|-> <destination.bmp|-> [<source.png> <destination.bmp> ...]\n"
+    "       %s --check <socket>\n"
+    "  --path : le serveur lit la source et écrit la destination lui-même (chemins vus par le serveur).\n"
+    "  --check : un PNG malformé doit être refusé (échec du décodage) sans empêcher les requêtes suivantes.\n";
+
+static double monotonic_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int write_output(const char* destination, const PngBuffer* bmp) {
+    FILE* out = strcmp(destination, "-") == 0 ? stdout : fopen(destination, "wb");
+    if (!out) return -1;
+    int status = fwrite(bmp->data, 1, bmp->size, out) == bmp->size ? 0 : -1;
+    if (out != stdout) status = fclose(out) == 0 ? status : -1;
+    else fflush(stdout);
+    return status;
+}
+
+static int convert(int fd, ServerRequest* request, int by_path, const char* source, const char* destination, PngBuffer* reply) {
+    PngFileMap map = { NULL, 0, false };
+    char* paths = NULL;
+    const void* data;
+    if (by_path) {
+        size_t length = strlen(source) + 1 + strlen(destination);
+        paths = malloc(length + 1);
+        if (!paths) return -1;
+        /* Destination "-" : le BMP revient dans la réponse. */
+        if (strcmp(destination, "-") == 0) strcpy(paths, source);
+        else sprintf(paths, "%s\t%s", source, destination);
+        request->kind = SERVER_REQUEST_PATH;
+        request->size = (uint32_t)strlen(paths);
+        data = paths;
+    } else {
+        if ((strcmp(source, "-") == 0 ? png_read_stream(stdin, &map) : png_map_file(source, &map)) != 0) {
+            fprintf(stderr, "Lecture impossible : %s\n", source);
+            return -1;
+        }
+        request->kind = SERVER_REQUEST_DATA;
+        request->size = (uint32_t)map.size;
+        data = map.data;
+    }
+    ServerStatus status = SERVER_OK;
+    int result = server_send_request(fd, request, data) == 0 && server_read_reply(fd, &status, reply) == 0 ? 0 : -1;
+    free(paths);
+    png_unmap_file(&map);
+    if (result != 0) {
+        fprintf(stderr, "Connexion au serveur interrompue.\n");
+        return -1;
+    }
+    if (status != SERVER_OK) {
+        fprintf(stderr, "%s : %s (%s)\n", source, server_status_string(status), (const char*)reply->data);
+        return 1;
+    }
+    if (reply->size && write_output(destination, reply) != 0) {
+        fprintf(stderr, "Ecriture impossible : %s\n", destination);
+        return 1;
+    }
+    return 0;
+}
+
+static void put_be32(unsigned char* p, uint32_t v) { p[0] = (unsigned char)(v >> 24); p[1] = (unsigned char)(v >> 16); p[2] = (unsigned char)(v >> 8); p[3] = (unsigned char)v; }
+
+static unsigned char* put_chunk(unsigned char* p, const char* type, const unsigned char* data, uint32_t length) {
+    put_be32(p, length);
+    memcpy(p + 4, type, 4);
+    if (length) memcpy(p + 8, data, length);
+    put_be32(p + 8 + length, (uint32_t)crc32(0L, p + 4, 4 + length));
+    return p + 12 + length;
+}
+
+/* PNG RGB 8 bits de side x side aux pixels nuls ; late : un second IHDR de late x late après les 16 premiers
+   octets de données, avec un flux zlib à sa taille (débordait les tampons du décodeur). */
+static unsigned char* build_check_png(uint32_t side, uint32_t late, size_t* size) {
+    static const unsigned char signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+    const uint32_t data_side = late ? late : side;
+    const uLong raw_size = (uLong)data_side * (1 + data_side * 3);
+    uLongf compressed_size = compressBound(raw_size);
+    unsigned char* raw = calloc(raw_size, 1);
+    unsigned char* compressed = malloc(compressed_size);
+    unsigned char* png = malloc(8 + 25 * 2 + 12 * 3 + compressed_size);
+    int status = raw && compressed && png && compress(compressed, &compressed_size, raw, raw_size) == Z_OK ? 0 : -1;
+    free(raw);
+    if (status != 0) { free(compressed); free(png); return NULL; }
+    unsigned char ihdr[13] = {0, 0, 0, 0, 0, 0, 0, 0, 8, 2, 0, 0, 0};
+    put_be32(ihdr, side); put_be32(ihdr + 4, side);
+    memcpy(png, signature, 8);
+    unsigned char* p = put_chunk(png + 8, "IHDR", ihdr, 13);
+    uint32_t head = late ? 16 : (uint32_t)compressed_size;
+    p = put_chunk(p, "IDAT", compressed, head);
+    if (late) {
+        put_be32(ihdr, late); put_be32(ihdr + 4, late);
+        p = put_chunk(p, "IHDR", ihdr, 13);
+        p = put_chunk(p, "IDAT", compressed + head, (uint32_t)(compressed_size - head));
+    }
+    p = put_chunk(p, "IEND", NULL, 0);
+    free(compressed);
+    *size = (size_t)(p - png);
+    return png;
+}
+
+static int check_request(int fd, const unsigned char* png, size_t size, ServerStatus expected, const char* what) {
+    ServerRequest request;
+    memset(&request, 0, sizeof(request));
+    request.kind = SERVER_REQUEST_DATA;
+    request.format = SERVER_FORMAT_DEFAULT;
+    request.size = (uint32_t)size;
+    PngBuffer reply = { NULL, 0, 0 };
+    ServerStatus status = SERVER_OK;
+    int result = server_send_request(fd, &request, png) == 0 && server_read_reply(fd, &status, &reply) == 0 ? 0 : -1;
+    if (result != 0) fprintf(stderr, "%s : connexion interrompue\n", what);
+    else if (status != expected) {
+        fprintf(stderr, "%s : %s au lieu de %s\n", what, server_status_string(status), server_status_string(expected));
+        result = -1;
+    } else if (expected == SERVER_OK && reply.size == 0) {
+        fprintf(stderr, "%s : réponse vide\n", what);
+        result = -1;
+    }
+    free(reply.data);
+    return result;
+}
+
+/* Une requête malformée échoue proprement ; la suivante, sur la même connexion puis sur une nouvelle, aboutit. */
+static int run_check(const char* socket_path) {
+    size_t bad_size, good_size;
+    unsigned char* bad = build_check_png(16, 2048, &bad_size);
+    unsigned char* good = build_check_png(16, 0, &good_size);
+    int fd = bad && good ? server_connect(socket_path) : -1;
+    int status = fd >= 0 ? 0 : -1;
+    if (status == 0) status = check_request(fd, bad, bad_size, SERVER_DECODE_FAILED, "IHDR après IDAT");
+    if (status == 0) status = check_request(fd, good, good_size, SERVER_OK, "requête suivante");
+    if (fd >= 0) close(fd);
+    if (status == 0 && (fd = server_connect(socket_path)) < 0) {
+        fprintf(stderr, "Connexion impossible à %s après la requête malformée\n", socket_path);
+        status = -1;
+    }
+    if (status == 0) {
+        status = check_request(fd, good, good_size, SERVER_OK, "nouvelle connexion");
+        close(fd);
+    }
+    free(bad);
+    free(good);
+    fprintf(stderr, "Vérification du serveur : %s\n", status == 0 ? "réussie" : "échec");
+    return status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int main(int argc, char* argv[]) {
+    ServerRequest request;
+    memset(&request, 0, sizeof(request));
+    request.format = SERVER_FORMAT_DEFAULT;
+    int by_path = 0;
+    int repeat = 1;
+    int first = 1;
+    if (argc == 3 && strcmp(argv[1], "--check") == 0) {
+        signal(SIGPIPE, SIG_IGN);
+        return run_check(argv[2]);
+    }
+    for (; first < argc && strncmp(argv[first], "--", 2) == 0; first++) {
+        if (strcmp(argv[first], "--path") == 0) {
+            by_path = 1;
+        } else if (strcmp(argv[first], "--format") == 0 && first + 1 < argc) {
+            PngPixelFormat format;
+            if (png_parse_format(argv[++first], &format) != 0) break;
+            request.format = (uint8_t)format;
+        } else if (strcmp(argv[first], "--background") == 0 && first + 1 < argc) {
+            unsigned int rgb;
+            if (sscanf(argv[++first], "%6x", &rgb) != 1) break;
+            request.has_background = true;
+            request.background.r = (rgb >> 16) & 0xFF;
+            request.background.g = (rgb >> 8) & 0xFF;
+            request.background.b = rgb & 0xFF;
+        } else if (strcmp(argv[first], "--repeat") == 0 && first + 1 < argc) {
+            repeat = atoi(argv[++first]);
+        } else {
+            break;
+        }
+    }
+    if (first + 3 > argc || (argc - first - 1) % 2 != 0 || repeat < 1 || (first < argc && strncmp(argv[first], "--", 2) == 0)) {
+        fprintf(stderr, usage, argv[0], argv[0]);
+        return EXIT_FAILURE;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    int fd = server_connect(argv[first]);
+    if (fd < 0) {
+        fprintf(stderr, "Connexion impossible à %s\n", argv[first]);
+        return EXIT_FAILURE;
+    }
+    PngBuffer reply = { NULL, 0, 0 };
+    unsigned long sent = 0, failed = 0;
+    double start = monotonic_seconds();
+    int status = 0;
+    for (int r = 0; r < repeat && status >= 0; r++) {
+        for (int i = first + 1; i + 1 < argc && status >= 0; i += 2) {
+            status = convert(fd, &request, by_path, argv[i], argv[i + 1], &reply);
+            sent++;
+            if (status != 0) failed++;
+        }
+    }
+    double elapsed = monotonic_seconds() - start;
+    if (repeat > 1 || sent > 1) {
+        fprintf(stderr, "%lu requêtes, %lu échecs, %.1f ms, %.0f requêtes/s\n", sent, failed, elapsed * 1000.0, elapsed > 0 ? sent / elapsed : 0.0);
+    }
+    close(fd);
+    free(reply.data);
+    return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}